@@ -26,6 +26,13 @@
 #include <stdint.h>
 #include <utility>
 #include <iterator>
+#include <vector>
+#include <algorithm>
+
+#if __cplusplus >= 201103L
+#include <atomic>
+#include <mutex>
+#endif
 
 namespace stx {
 
@@ -38,6 +45,7 @@ namespace stx {
  * array_hash_traits traits;
  * traits.slot_count = 256;
  * traits.allocation_chunk_size = 64;
+ * traits.initial_slot_count = 16;
  * hat_set<string> rawr(traits);
  * rawr.insert(...);
  * ...
@@ -46,13 +54,17 @@ namespace stx {
 class array_hash_traits
 {
 public:
-    array_hash_traits(int slot_count = 512, int allocation_chunk_size = 32) :
-        slot_count(slot_count), allocation_chunk_size(allocation_chunk_size)
+    array_hash_traits(int slot_count = 512, int allocation_chunk_size = 32,
+            int initial_slot_count = 1, int max_load_factor = 4,
+            int value_size = 0) :
+        slot_count(slot_count), allocation_chunk_size(allocation_chunk_size),
+        initial_slot_count(initial_slot_count),
+        max_load_factor(max_load_factor), value_size(value_size)
     {
     }
 
     /**
-     * Number of slots in the hash table. Higher values use more
+     * Maximum number of slots in the hash table. Higher values use more
      * memory but may show faster access times.
      *
      * Default 512. Must be a positive power of 2.
@@ -76,6 +88,38 @@ public:
      * Default 32. Must be non-negative.
      */
     int allocation_chunk_size;
+
+    /**
+     * Number of slots a new (or cleared) table starts with. The table
+     * doubles its slot count whenever it holds more than
+     * max_load_factor strings per slot, until it reaches slot_count.
+     * A value of 1 makes a small table a plain linear list, which keeps
+     * the many tiny buckets left behind by a burst from paying for 512
+     * slot pointers each. Set this value to slot_count to allocate
+     * every slot up front.
+     *
+     * Default 1. Must be a positive power of 2 <= slot_count.
+     */
+    int initial_slot_count;
+
+    /**
+     * Average number of strings per slot that triggers doubling the
+     * slot count. Lower values grow the table sooner, trading memory
+     * for shorter slot scans.
+     *
+     * Default 4. Must be positive.
+     */
+    int max_load_factor;
+
+    /**
+     * Number of bytes of value data stored right after each string, so
+     * a lookup finds the value in the same cache lines as the key. The
+     * bytes are not aligned. hat_map sets this to the size of its mapped
+     * type. Don't change it on a table that already holds strings.
+     *
+     * Default 0 (no values). Must be non-negative.
+     */
+    int value_size;
 };
 
 template <class T>
@@ -138,7 +182,7 @@ class array_hash<std::string>
     /**
      * Copy constructor.
      *
-     * O(n) where n = traits.slot_count
+     * O(n) where n = slot_count()
      */
     array_hash(const array_hash<std::string> &rhs)
     {
@@ -149,24 +193,28 @@ class array_hash<std::string>
     /**
      * Assignment operator.
      *
-     * O(n) where n = traits.slot_count
+     * O(n) where n = slot_count()
      */
     array_hash<std::string>& operator=(const array_hash<std::string> &rhs)
     {
         if (this != &rhs) {
-            _traits = rhs._traits;
-            _size = rhs._size;
-
             // Empty the current data array
             if (_data) {
                 _destroy();
             }
 
+            _traits = rhs._traits;
+            _size = rhs._size;
+            _bytes = rhs._bytes;
+            _lengths = rhs._lengths;
+            _unsort();
+            _slot_count = rhs._slot_count;
+
             // Copy the data from the other array hash
-            _data = new char *[_traits.slot_count];
-            for (int i = 0; i < _traits.slot_count; ++i) {
+            _data = new char *[_slot_count];
+            for (int i = 0; i < _slot_count; ++i) {
                 if (rhs._data[i]) {
-                    size_t space = *rhs._data[i];
+                    size_t space = *((size_type *) rhs._data[i]);
                     _data[i] = new char[space];
                     memcpy(_data[i], rhs._data[i], space);
                 } else {
@@ -219,6 +267,30 @@ class array_hash<std::string>
         return _size;
     }
 
+    /**
+     * Gets the number of bytes the strings in the table occupy, including
+     * their NULL terminators, length prefixes and values. Slot headers
+     * and unused allocation chunk space are not counted.
+     *
+     * O(1)
+     */
+    size_t bytes() const
+    {
+        return _bytes;
+    }
+
+    /**
+     * Gets the number of bytes a string adds to bytes() when it is
+     * inserted.
+     *
+     * @param length      length of the string, without its terminator
+     * @param value_size  size of the table's values
+     */
+    static size_t entry_bytes(size_t length, int value_size)
+    {
+        return sizeof(length_type) + length + 1 + value_size;
+    }
+
     /**
      * Determines whether the table is empty.
      *
@@ -239,6 +311,19 @@ class array_hash<std::string>
         return _traits;
     }
 
+    /**
+     * Gets the number of slots currently allocated in the table.
+     *
+     * This value starts at traits().initial_slot_count and grows as
+     * strings are inserted, up to traits().slot_count.
+     *
+     * O(1)
+     */
+    int slot_count() const
+    {
+        return _slot_count;
+    }
+
     /**
      * Inserts @a str into the table.
      *
@@ -249,20 +334,42 @@ class array_hash<std::string>
      *          already appears in the table
      */
     bool insert(const char *str)
+    {
+        bool inserted;
+        find_or_insert(str, inserted);
+        return inserted;
+    }
+
+    /**
+     * Finds @a str in the table, inserting it first if it isn't there.
+     * A newly inserted string's value bytes are zero.
+     *
+     * O(m) where m is the length of @a str
+     *
+     * @param str       string to find or insert
+     * @param inserted  set to true if @a str was inserted, false if it
+     *                  was already in the table
+     * @return  iterator to @a str in the table
+     */
+    iterator find_or_insert(const char *str, bool &inserted)
     {
         length_type length;
         int slot = _hash(str, length);
         char *p = _data[slot];
         if (p) {
             size_type occupied;
-            if (_search(str, p, length, occupied) != NULL) {
+            char *found = _search(str, p, length, occupied);
+            if (found != NULL) {
                 // str is already in the table. Nothing needs to be done.
-                return false;
+                inserted = false;
+                return iterator(slot, found, _data, _slot_count,
+                                _traits.value_size);
             }
 
             // Resize the slot if it doesn't have enough space.
             size_type current = *((size_type *) (p));
-            size_type required = occupied + sizeof(length_type) + length;
+            size_type required = occupied + sizeof(length_type) + length +
+                    _traits.value_size;
             if (required > current) {
                 _grow_slot(slot, current, required);
             }
@@ -273,7 +380,7 @@ class array_hash<std::string>
         } else {
             // Make a new slot for this string.
             size_type required = sizeof(size_type) + 2 * sizeof(length_type)
-                    + length;
+                    + length + _traits.value_size;
             _grow_slot(slot, 0, required);
 
             // Position for writing to the slot.
@@ -281,9 +388,74 @@ class array_hash<std::string>
         }
 
         // Write str into the slot.
-        _append_string(str, p, length);
+        _append_string(str, p, length, NULL);
+        _unsort();
         ++_size;
-        return true;
+        _bytes += sizeof(length_type) + length + _traits.value_size;
+        _lengths |= _length_bit(length - 1);
+        inserted = true;
+
+        // Spread the strings over more slots if the table is getting
+        // crowded.
+        if (_slot_count < _traits.slot_count &&
+                _size > (size_t) _slot_count * _traits.max_load_factor) {
+            _rehash(_slot_count * 2);
+            return find(str);
+        }
+        return iterator(slot, p, _data, _slot_count, _traits.value_size);
+    }
+
+    /**
+     * Changes the size of the value stored with every string, converting
+     * each value with @a f. Slots are rewritten in place of the old ones,
+     * without rehashing.
+     *
+     * O(n) where n is the number of bytes in the table
+     *
+     * @param value_size  new value size
+     * @param f           functor called as f(const char *from, char *to)
+     *                    for every value
+     */
+    template <class F>
+    void resize_values(int value_size, F f)
+    {
+        int old_size = _traits.value_size;
+        for (int i = 0; i < _slot_count; ++i) {
+            if (_data[i] == NULL) {
+                continue;
+            }
+
+            // Count the bytes the slot needs with the new values.
+            size_type required = sizeof(size_type) + sizeof(length_type);
+            char *p = _data[i] + sizeof(size_type);
+            length_type w = *((length_type *) p);
+            while (w != 0) {
+                required += sizeof(length_type) + w + value_size;
+                p += sizeof(length_type) + w + old_size;
+                w = *((length_type *) p);
+            }
+
+            char *old = _data[i];
+            _data[i] = NULL;
+            _grow_slot(i, 0, required);
+
+            // Copy the strings over with their converted values.
+            p = old + sizeof(size_type);
+            char *q = _data[i] + sizeof(size_type);
+            w = *((length_type *) p);
+            while (w != 0) {
+                memcpy(q, p, sizeof(length_type) + w);
+                f(p + sizeof(length_type) + w, q + sizeof(length_type) + w);
+                p += sizeof(length_type) + w + old_size;
+                q += sizeof(length_type) + w + value_size;
+                w = *((length_type *) p);
+            }
+            memset(q, 0, sizeof(length_type));
+            delete[] old;
+        }
+        _bytes += (value_size - old_size) * (long) _size;
+        _traits.value_size = value_size;
+        _unsort();
     }
 
     /**
@@ -348,14 +520,20 @@ class array_hash<std::string>
         // Only erase if the iterator does not point to the end
         // of the collection
         if (pos._p) {
-            _erase_word(pos._p, pos._slot);
+            int slot = pos._slot;
+            if (pos._cur) {
+                // Sorted iterators don't track their slot.
+                length_type length;
+                slot = _hash(*pos, length);
+            }
+            _erase_word(pos._p, slot);
         }
     }
 
     /**
      * Clears all the elements from the hash table.
      *
-     * O(n) where n is traits.slot_count
+     * O(n) where n is slot_count()
      */
     void clear()
     {
@@ -372,13 +550,23 @@ class array_hash<std::string>
     {
         std::swap(_data, rhs._data);
         std::swap(_size, rhs._size);
+        std::swap(_bytes, rhs._bytes);
+        std::swap(_lengths, rhs._lengths);
+        _index.swap(rhs._index);
+#if __cplusplus >= 201103L
+        bool sorted = _sorted.load(std::memory_order_relaxed);
+        _sorted.store(rhs._sorted.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+        rhs._sorted.store(sorted, std::memory_order_relaxed);
+#endif
+        std::swap(_slot_count, rhs._slot_count);
         std::swap(_traits, rhs._traits);
     }
 
     /**
      * Gets an iterator to the first element in the table.
      *
-     * O(n) where n = traits.slot_count
+     * O(n) where n = slot_count()
      */
     iterator begin() const
     {
@@ -392,7 +580,8 @@ class array_hash<std::string>
             }
             result._p = result._data[result._slot] + sizeof(size_type);
         }
-        result._slot_count = _traits.slot_count;
+        result._slot_count = _slot_count;
+        result._value_size = _traits.value_size;
         return result;
     }
 
@@ -403,7 +592,8 @@ class array_hash<std::string>
      */
     iterator end() const
     {
-        return iterator(_traits.slot_count, NULL, _data, _traits.slot_count);
+        return iterator(_slot_count, NULL, _data, _slot_count,
+                        _traits.value_size);
     }
 
     /**
@@ -419,13 +609,188 @@ class array_hash<std::string>
     /**
      * Gets a reverse iterator to the last element in reverse order.
      *
-     * O(n) where n = traits.slot_count
+     * O(n) where n = slot_count()
      */
     reverse_iterator rend() const
     {
         return reverse_iterator(begin());
     }
 
+    /**
+     * Gets an iterator to the lexicographically least element in the
+     * table. Incrementing the iterator visits the elements in sorted
+     * order, and end() compares equal to it after the greatest element.
+     *
+     * The first call after the table is modified sorts the table's
+     * elements into an index that is cached until the next insert or
+     * erase. Later calls are O(1).
+     *
+     * O(n log n) where n = @a size()
+     */
+    iterator sorted_begin() const
+    {
+        _sort();
+        return _sorted_iterator(_index.empty() ? NULL : &_index[0]);
+    }
+
+    /**
+     * Gets a sorted iterator to one past the greatest element in the
+     * table. Unlike end(), decrementing this iterator moves to the
+     * greatest element.
+     *
+     * O(n log n) where n = @a size(), O(1) if the table is already sorted
+     */
+    iterator sorted_end() const
+    {
+        _sort();
+        return _sorted_iterator(_index.empty() ? NULL :
+                                &_index[0] + _index.size());
+    }
+
+    /**
+     * Gets a sorted iterator to the least element that is not less than
+     * @a str.
+     *
+     * O(log n) where n = @a size() once the table is sorted
+     */
+    iterator sorted_lower_bound(const char *str) const
+    {
+        _sort();
+        if (_index.empty()) {
+            return end();
+        }
+        _key key = { str };
+        return _sorted_iterator(&_index[0] + (std::lower_bound(
+                _index.begin(), _index.end(), key, _key_compare())
+                - _index.begin()));
+    }
+
+    /**
+     * Gets a sorted iterator to the least element that is greater than
+     * @a str.
+     *
+     * O(log n) where n = @a size() once the table is sorted
+     */
+    iterator sorted_upper_bound(const char *str) const
+    {
+        _sort();
+        if (_index.empty()) {
+            return end();
+        }
+        _key key = { str };
+        return _sorted_iterator(&_index[0] + (std::upper_bound(
+                _index.begin(), _index.end(), key, _key_compare())
+                - _index.begin()));
+    }
+
+    /**
+     * Narrows a sorted range down to the strings that have @a ch at
+     * position @a pos.
+     *
+     * Every string in [@a first, @a last) must share the same first
+     * @a pos characters, as is the case for a range returned by an
+     * earlier call or by sorted_begin() and sorted_end() with @a pos = 0.
+     *
+     * O(log n) where n is the size of the range
+     *
+     * @param first, last  sorted iterators delimiting the range
+     * @param pos  position of the character to match
+     * @param ch   character to match. Must not be '\0'
+     * @return  the narrowed range, empty if no string matches
+     */
+    std::pair<iterator, iterator> sorted_narrow(const iterator &first,
+                                                const iterator &last,
+                                                size_t pos, char ch) const
+    {
+        if (first == last) {
+            return std::make_pair(first, last);
+        }
+        char * const *end = last._cur ? last._cur : first._last;
+        _char_compare compare = { pos };
+        unsigned char c = ch;
+        char * const *lo = std::lower_bound(first._cur, end, c, compare);
+        char * const *hi = std::upper_bound(lo, end, c, compare);
+        return std::make_pair(_sorted_iterator(lo), _sorted_iterator(hi));
+    }
+
+    /**
+     * Finds the longest string in the table that is a prefix of @a str.
+     *
+     * The hashes of all the prefixes of @a str are computed in one pass.
+     * The prefixes are then looked up from the longest down, skipping
+     * lengths that no string in the table has, until one is found.
+     *
+     * O(m + k) where m is the length of @a str and k is the combined
+     * length of the prefixes looked up
+     *
+     * @param str  string to match
+     * @return  iterator to the longest prefix of @a str in the table, or
+     *          @a end() if there is none
+     */
+    iterator longest_prefix(const char *str) const
+    {
+        size_t length = strlen(str);
+        int buffer[256];
+        std::vector<int> overflow;
+        int *hashes = buffer;
+        if (length >= 256) {
+            overflow.resize(length + 1);
+            hashes = &overflow[0];
+        }
+
+        // hashes[i] is the slot of the first i characters of str. Same
+        // seed and steps as _hash().
+        int h = 23;
+        for (size_t i = 0; i < length; ++i) {
+            hashes[i] = h & (_slot_count - 1);
+            h = _hash_step(h, str[i]);
+        }
+        hashes[length] = h & (_slot_count - 1);
+
+        for (size_t i = length + 1; i-- > 0; ) {
+            if ((_lengths & _length_bit(i)) == 0) {
+                continue;
+            }
+            char *p = _data[hashes[i]];
+            if (p && (p = _search_prefix(str, p, i))) {
+                return iterator(hashes[i], p, _data, _slot_count,
+                                _traits.value_size);
+            }
+        }
+        return end();
+    }
+
+    /**
+     * Calls @a f with the length of every string in the table that is a
+     * prefix of @a str, shortest first.
+     *
+     * Like longest_prefix(), this hashes the prefixes of @a str in one
+     * pass and only looks up lengths that some string in the table has.
+     *
+     * O(m + k) where m is the length of @a str and k is the combined
+     * length of the prefixes looked up
+     *
+     * @param str  string to match
+     * @param f    functor called as f(size_t length)
+     */
+    template <class F>
+    void each_prefix(const char *str, F &f) const
+    {
+        int h = 23;  // same seed and steps as _hash()
+        for (size_t i = 0; ; ++i) {
+            if (_lengths & _length_bit(i)) {
+                char *p = _data[h & (_slot_count - 1)];
+                if (p && _search_prefix(str, p, i)) {
+                    f(i);
+                }
+            }
+            if (str[i] == '\0') {
+                break;
+            }
+            h = _hash_step(h, str[i]);
+        }
+    }
+
     /**
      * Searches for @a str in the table.
      *
@@ -448,7 +813,7 @@ class array_hash<std::string>
         }
         size_type s;
         p = _search(str, p, length, s);
-        return iterator(slot, p, _data, _traits.slot_count);
+        return iterator(slot, p, _data, _slot_count, _traits.value_size);
     }
 
     /**
@@ -473,17 +838,12 @@ class array_hash<std::string>
     bool operator==(const array_hash<std::string>& rhs)
     {
         if (size() == rhs.size()) {
-            // don't want to do a memory comparison because traits
-            // may differ
-            iterator me = begin();
-            iterator them = rhs.begin();
-            iterator stop = end();
-            while (me != stop) {
-                if (strcmp(*me, *them) != 0) {
+            // don't want to compare element by element in iteration
+            // order because the traits and slot counts may differ
+            for (iterator me = begin(); me != end(); ++me) {
+                if (!rhs.exists(*me)) {
                     return false;
                 }
-                ++me;
-                ++them;
             }
             return true;
         }
@@ -510,14 +870,15 @@ class array_hash<std::string>
         // const iterator
         typedef const char * reference;
 
-        iterator() : _slot(0), _p(NULL), _data(NULL)
+        iterator() : _slot(0), _p(NULL), _data(NULL), _slot_count(0),
+                _value_size(0), _first(NULL), _cur(NULL), _last(NULL)
         {
         }
 
         /**
          * Move this iterator forward to the next element in the table.
          *
-         * worst case O(n) where n = traits.slot_count
+         * worst case O(n) where n = slot_count()
          *
          * Calling this function on an end() iterator does nothing.
          *
@@ -525,9 +886,19 @@ class array_hash<std::string>
          */
         iterator& operator++()
         {
+            if (_cur) {
+                // Move to the next string in the sorted index.
+                if (_p) {
+                    ++_cur;
+                    _p = _cur == _last ? NULL : *_cur;
+                }
+                return *this;
+            }
+
             // Move p to the next string in this slot.
             if (_p) {
-                _p += *((length_type *) _p) + sizeof(length_type);
+                _p += *((length_type *) _p) + sizeof(length_type) +
+                      _value_size;
                 if (*((length_type *) _p) == 0) {
                     // Move down to the next slot.
                     ++_slot;
@@ -550,7 +921,7 @@ class array_hash<std::string>
         /**
          * Move this iterator backward to the previous element in the table.
          *
-         * worst case O(n) where n = traits.slot_count
+         * worst case O(n) where n = slot_count()
          *
          * Calling this function on a begin iterator does nothing.
          *
@@ -558,13 +929,23 @@ class array_hash<std::string>
          */
         iterator& operator--()
         {
+            if (_cur) {
+                // Move to the previous string in the sorted index.
+                if (_cur != _first) {
+                    --_cur;
+                    _p = *_cur;
+                }
+                return *this;
+            }
+
             if (_p) {
                 // Find the iterator's current location in the slot
                 char *next = _data[_slot] + sizeof(size_type);
                 char *prev = next;
                 while (next != _p) {
                     prev = next;
-                    next += *((length_type *) next) + sizeof(length_type);
+                    next += *((length_type *) next) + sizeof(length_type) +
+                            _value_size;
                 }
 
                 if (prev != next) {
@@ -600,7 +981,7 @@ class array_hash<std::string>
             while (*((length_type *)next) != 0) {
                 _p = next;
                 length_type l = *((length_type *)next);
-                next += sizeof(length_type) + l;
+                next += sizeof(length_type) + l + _value_size;
             }
             return *this;
         }
@@ -608,7 +989,7 @@ class array_hash<std::string>
         /**
          * Postfix increment operator.
          *
-         * worst case O(n) where n = traits.slot_count
+         * worst case O(n) where n = slot_count()
          */
         iterator operator++(int)
         {
@@ -620,7 +1001,7 @@ class array_hash<std::string>
         /**
          * Postfix decrement operator.
          *
-         * worst case O(n) where n = traits.slot_count
+         * worst case O(n) where n = slot_count()
          */
         iterator operator--(int)
         {
@@ -644,12 +1025,44 @@ class array_hash<std::string>
             return NULL;
         }
 
+        /**
+         * Gets the length of the string this iterator points to without
+         * scanning it.
+         *
+         * O(1)
+         *
+         * @return  length of the string, not counting the terminating NUL
+         */
+        size_t length() const
+        {
+            if (_p) {
+                return *((length_type *) _p) - 1;
+            }
+            return 0;
+        }
+
+        /**
+         * Gets the value data stored after the string this iterator
+         * points to (see array_hash_traits::value_size).
+         *
+         * O(1)
+         *
+         * @return  pointer to the value bytes. They are not aligned
+         */
+        char *value() const
+        {
+            if (_p) {
+                return _p + sizeof(length_type) + *((length_type *) _p);
+            }
+            return NULL;
+        }
+
         /**
          * Standard equality operator.
          *
          * O(1)
          */
-        bool operator==(const iterator& rhs)
+        bool operator==(const iterator& rhs) const
         {
             return _p == rhs._p;
         }
@@ -659,7 +1072,7 @@ class array_hash<std::string>
          *
          * O(1)
          */
-        bool operator!=(const iterator& rhs)
+        bool operator!=(const iterator& rhs) const
         {
             return !operator==(rhs);
         }
@@ -669,9 +1082,18 @@ class array_hash<std::string>
         char *_p;
         char **_data;
         int _slot_count;
-
-        iterator(int slot, char *p, char **data, int slot_count) :
-                _slot(slot), _p(p), _data(data), _slot_count(slot_count)
+        int _value_size;
+
+        // Position in the table's sorted index. _cur is NULL unless this
+        // iterator was made by one of the sorted_* functions.
+        char * const *_first;
+        char * const *_cur;
+        char * const *_last;
+
+        iterator(int slot, char *p, char **data, int slot_count,
+                 int value_size) :
+                _slot(slot), _p(p), _data(data), _slot_count(slot_count),
+                _value_size(value_size), _first(NULL), _cur(NULL), _last(NULL)
         {
         }
     };
@@ -679,16 +1101,157 @@ class array_hash<std::string>
 private:
     array_hash_traits _traits;
     size_t _size;
+    size_t _bytes;  // bytes used by the strings in the table
+
+    // Bit i is set if a string of length i (or >= 63 for the last bit)
+    // has been inserted since the table was last emptied. Erasing
+    // doesn't clear bits, so this may list lengths that are gone.
+    uint64_t _lengths;
+    int _slot_count;  // number of slots currently in _data
     char **_data;
 
+    // Pointers to the table's strings in sorted order. Built on demand
+    // and emptied whenever the table changes.
+    mutable std::vector<char *> _index;
+#if __cplusplus >= 201103L
+    mutable std::atomic<bool> _sorted;  // true once _index is complete
+#endif
+
+    /// Orders pointers to strings in the table by the strings' contents
+    struct _entry_less
+    {
+        bool operator()(const char *a, const char *b) const
+        {
+            return strcmp(a + sizeof(length_type),
+                          b + sizeof(length_type)) < 0;
+        }
+    };
+
+    /// A string being searched for in the sorted index
+    struct _key
+    {
+        const char *str;
+    };
+
+    /// Compares strings in the table against a _key
+    struct _key_compare
+    {
+        bool operator()(const char *entry, const _key &key) const
+        {
+            return strcmp(entry + sizeof(length_type), key.str) < 0;
+        }
+
+        bool operator()(const _key &key, const char *entry) const
+        {
+            return strcmp(key.str, entry + sizeof(length_type)) < 0;
+        }
+    };
+
+    /// Compares one character of strings in the table
+    struct _char_compare
+    {
+        size_t pos;
+
+        bool operator()(const char *entry, unsigned char c) const
+        {
+            return (unsigned char) entry[sizeof(length_type) + pos] < c;
+        }
+
+        bool operator()(unsigned char c, const char *entry) const
+        {
+            return c < (unsigned char) entry[sizeof(length_type) + pos];
+        }
+    };
+
+    /**
+     * Builds the sorted index if the table has changed since it was
+     * last built.
+     */
+    void _sort() const
+    {
+#if __cplusplus >= 201103L
+        // Const tables may be shared between threads, so the first one
+        // to get here builds the index and the rest wait for it.
+        if (_sorted.load(std::memory_order_acquire)) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(_sort_lock());
+        if (_sorted.load(std::memory_order_relaxed)) {
+            return;
+        }
+#else
+        if (_index.size() == _size) {
+            return;
+        }
+#endif
+        _index.clear();
+        _index.reserve(_size);
+        for (iterator it = begin(); it != end(); ++it) {
+            _index.push_back(it._p);
+        }
+        std::sort(_index.begin(), _index.end(), _entry_less());
+#if __cplusplus >= 201103L
+        _sorted.store(true, std::memory_order_release);
+#endif
+    }
+
+    /**
+     * Empties the sorted index after the table changes.
+     */
+    void _unsort()
+    {
+        _index.clear();
+#if __cplusplus >= 201103L
+        _sorted.store(false, std::memory_order_relaxed);
+#endif
+    }
+
+#if __cplusplus >= 201103L
+    /**
+     * Gets the lock that guards building this table's sorted index.
+     * Tables share a few locks by address rather than each carrying a
+     * mutex, which would outweigh a small table.
+     */
+    std::mutex &_sort_lock() const
+    {
+        static std::mutex locks[64];
+        return locks[((uintptr_t) this / sizeof(void *)) % 64];
+    }
+#endif
+
+    /**
+     * Makes an iterator into the sorted index.
+     *
+     * @param cur  position in the sorted index
+     */
+    iterator _sorted_iterator(char * const *cur) const
+    {
+        iterator result;
+        result._value_size = _traits.value_size;
+        if (cur) {
+            result._first = &_index[0];
+            result._last = result._first + _index.size();
+            result._cur = cur;
+            result._p = cur == result._last ? NULL : *cur;
+        }
+        return result;
+    }
+
     /**
      * Initializes the internal data pointers.
      */
     void _init()
     {
-        _data = new char *[_traits.slot_count];
-        memset(_data, NULL, _traits.slot_count * sizeof(char*));
+        _slot_count = _traits.initial_slot_count;
+        if (_slot_count < 1 || _slot_count > _traits.slot_count) {
+            _slot_count = _traits.slot_count;
+        }
+        _data = new char *[_slot_count];
+        memset(_data, 0, _slot_count * sizeof(char*));
         _size = 0;
+        _bytes = 0;
+        _lengths = 0;
+        _unsort();
     }
 
     /**
@@ -696,7 +1259,7 @@ private:
      */
     void _destroy()
     {
-        for (int i = 0; i < _traits.slot_count; ++i) {
+        for (int i = 0; i < _slot_count; ++i) {
             delete[] _data[i];
         }
         delete[] _data;
@@ -718,15 +1281,22 @@ private:
         length = 0;
         while (str[length]) {
             // Hash this character.
-            h = h ^ ((h << 5) + (h >> 2) + str[length]);
+            h = _hash_step(h, str[length]);
             ++length;
         }
 
         ++length; // include space for the NULL terminator
-        return h & (_traits.slot_count - 1); // same as h %
-                                             // _traits.slot_count if
-                                             // _traits.slot_count is a
-                                             // power of 2
+        return h & (_slot_count - 1); // same as h % _slot_count
+                                      // because _slot_count is a
+                                      // power of 2
+    }
+
+    /**
+     * Mixes one more character into a hash value computed by _hash().
+     */
+    static int _hash_step(int h, char c)
+    {
+        return h ^ ((h << 5) + (h >> 2) + c);
     }
 
     /**
@@ -761,13 +1331,49 @@ private:
                     return p - sizeof(length_type);
                 }
             }
-            p += w;
+            p += w + _traits.value_size;
             w = *((length_type *) p);
         }
         occupied = p - start + sizeof(length_type);
         return NULL;
     }
 
+    /**
+     * Searches a slot for the string made of the first @a length
+     * characters of @a str.
+     *
+     * @param str     string whose prefix to search for. Need not end
+     *                after @a length characters
+     * @param p       slot to search
+     * @param length  length of the prefix, not counting a NUL
+     *
+     * @return  pointer to the string and its corresponding length if it
+     *          is in the slot, NULL otherwise
+     */
+    char *_search_prefix(const char *str, char *p, size_t length) const
+    {
+        p += sizeof(size_type);
+        length_type w = *((length_type *) p);
+        while (w != 0) {
+            p += sizeof(length_type);
+            if (w == length + 1 && memcmp(str, p, length) == 0) {
+                return p - sizeof(length_type);
+            }
+            p += w + _traits.value_size;
+            w = *((length_type *) p);
+        }
+        return NULL;
+    }
+
+    /**
+     * Gets the bit of _lengths that stands for strings of @a length
+     * characters.
+     */
+    static uint64_t _length_bit(size_t length)
+    {
+        return (uint64_t) 1 << (length < 63 ? length : 63);
+    }
+
     /**
      * Increases the capacity of a slot to be >= required.
      *
@@ -798,7 +1404,65 @@ private:
     }
 
     /**
-     * Appends a string to a list of strings in a slot.
+     * Redistributes every string in the table over @a slot_count slots.
+     *
+     * Strings are copied slot by slot into the new slot array, so each
+     * new slot is grown at most once per allocation chunk and never
+     * rescanned.
+     *
+     * @param slot_count  new number of slots. Must be a power of 2
+     */
+    void _rehash(int slot_count)
+    {
+        char **old = _data;
+        int old_count = _slot_count;
+
+        _slot_count = slot_count;
+        _data = new char *[_slot_count];
+        memset(_data, 0, _slot_count * sizeof(char*));
+
+        // used[i] is the number of bytes in use in new slot i, including
+        // the terminating 0 length.
+        size_type *used = new size_type[_slot_count];
+        memset(used, 0, _slot_count * sizeof(size_type));
+
+        for (int i = 0; i < old_count; ++i) {
+            if (old[i] == NULL) {
+                continue;
+            }
+
+            char *p = old[i] + sizeof(size_type);
+            length_type w = *((length_type *) p);
+            while (w != 0) {
+                const char *str = p + sizeof(length_type);
+                length_type length;
+                int slot = _hash(str, length);
+
+                size_type current = _data[slot] ?
+                        *((size_type *) _data[slot]) : 0;
+                size_type start = used[slot] ? used[slot] :
+                        sizeof(size_type) + sizeof(length_type);
+                size_type required = start + sizeof(length_type) + length +
+                        _traits.value_size;
+                if (required > current) {
+                    _grow_slot(slot, current, required);
+                }
+                _append_string(str,
+                        _data[slot] + start - sizeof(length_type), length,
+                        str + length);
+                used[slot] = required;
+
+                p += sizeof(length_type) + w + _traits.value_size;
+                w = *((length_type *) p);
+            }
+            delete[] old[i];
+        }
+        delete[] used;
+        delete[] old;
+    }
+
+    /**
+     * Appends a string and its value to a list of strings in a slot.
      *
      * Assumes the slot is big enough to hold the string.
      *
@@ -806,16 +1470,25 @@ private:
      * @param p       pointer to the location in the slot this string
      *                should occupy
      * @param length  length of @a str
+     * @param value   value bytes to store after the string, or NULL to
+     *                store zeros
      */
-    void _append_string(const char *str, char *p, length_type length)
+    void _append_string(const char *str, char *p, length_type length,
+                        const char *value)
     {
         // Write the length of the string, the string itself, the NULL
-        // terminator, and a 0 after all of that (for the length of the
-        // next string).
+        // terminator, the value, and a 0 after all of that (for the
+        // length of the next string).
         memcpy(p, &length, sizeof(length_type));
         p += sizeof(length_type);
         memcpy(p, str, length);
         p += length;
+        if (value) {
+            memcpy(p, value, _traits.value_size);
+        } else {
+            memset(p, 0, _traits.value_size);
+        }
+        p += _traits.value_size;
         length = 0;
         memcpy(p, &length, sizeof(length_type));
     }
@@ -828,12 +1501,12 @@ private:
      */
     void _erase_word(char *p, int slot)
     {
-        int length = *(length_type *) (p);
+        int length = *(length_type *) (p) + _traits.value_size;
         size_type size = *((size_type *) _data[slot]);
 
-        // Erase the word by overwriting it.
-        int n = size - (p - _data[slot]);
-        memcpy(p, p + sizeof(length_type) + length, n);
+        // Erase the word by overwriting it with the rest of the slot.
+        int n = size - (p - _data[slot]) - sizeof(length_type) - length;
+        memmove(p, p + sizeof(length_type) + length, n);
 
         // If that made the slot empty, erase the slot.
         if (*((length_type *) (_data[slot] + sizeof(size_type))) == 0) {
@@ -841,6 +1514,8 @@ private:
             _data[slot] = NULL;
         }
         --_size;
+        _bytes -= sizeof(length_type) + length;
+        _unsort();
     }
 };
 
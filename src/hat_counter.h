@@ -0,0 +1,563 @@
+/*
+ * Copyright 2010-2011 Chris Vaszauskas and Tyler Richard
+ *
+ * This file is part of a HAT-trie implementation following the paper
+ * entitled "HAT-trie: A Cache-concious Trie-based Data Structure for
+ * Strings" by Nikolas Askitis and Ranjan Sinha.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAT_COUNTER_H
+#define HAT_COUNTER_H
+
+#include <algorithm>
+#include <vector>
+
+#include "hat_trie.h"
+
+namespace stx {
+
+template <class T> class hat_counter;
+
+/**
+ * @brief HAT-trie that counts how many times each string is added
+ *
+ * Each string's count is stored inline with it, like a hat_map value.
+ * Counters start one byte wide. When a count outgrows its width, every
+ * counter in the trie is widened in place to 2, 4 or 8 bytes. This
+ * happens at most three times over the life of the counter. Until then,
+ * a counter of mostly rare tokens pays one byte per token for its
+ * counts.
+ *
+ * @code
+ * hat_counter<string> counter;
+ * while (cin >> word) {
+ *     counter.increment(word);
+ * }
+ * counter.top_k(10);  // the ten most frequent words
+ * @endcode
+ *
+ * Note: the only available template parameter is std::string. Using
+ * any other template parameter will result in a compile-time error.
+ */
+template <>
+class hat_counter<std::string> {
+
+  private:
+    typedef hat_trie<std::string>  hat_trie_type;
+
+  public:
+    // STL types
+    typedef hat_trie_type::size_type  size_type;
+    typedef hat_trie_type::key_type   key_type;
+    typedef uint64_t                  count_type;
+    typedef std::pair<key_type, count_type> value_type;
+
+    /**
+     * @brief Iterates over the strings in a hat_counter and their counts
+     */
+    class iterator : public std::iterator<std::bidirectional_iterator_tag,
+                                          value_type> {
+        friend class hat_counter;
+
+      public:
+        typedef value_type reference;
+
+        iterator() : _width(0) { }
+
+        iterator &operator++() {
+            ++_it;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator result = *this;
+            ++_it;
+            return result;
+        }
+
+        iterator &operator--() {
+            --_it;
+            return *this;
+        }
+
+        iterator operator--(int) {
+            iterator result = *this;
+            --_it;
+            return result;
+        }
+
+        /**
+         * Iterator dereference operator.
+         *
+         * @return  the string this iterator points to and its count
+         */
+        value_type operator*() const {
+            return value_type(_it.key(), count());
+        }
+
+        /**
+         * Gets the string this iterator points to without allocating.
+         *
+         * @return  reference to the string. It is only valid until the
+         *          iterator is moved or destroyed
+         */
+        const key_type &key() const {
+            return _it.key();
+        }
+
+        /**
+         * Gets the count of the string this iterator points to.
+         */
+        count_type count() const {
+            return _read(_it.value(), _width);
+        }
+
+        bool operator==(const iterator &rhs) const {
+            return _it == rhs._it;
+        }
+
+        bool operator!=(const iterator &rhs) const {
+            return _it != rhs._it;
+        }
+
+      private:
+        hat_trie_type::iterator _it;
+        int _width;
+
+        iterator(const hat_trie_type::iterator &it, int width) :
+                _it(it), _width(width) { }
+    };
+
+    typedef iterator const_iterator;
+
+    /**
+     * Default constructor.
+     *
+     * @param traits     hat trie customization traits
+     * @param ah_traits  array hash customization traits. Its
+     *                   @a value_size is managed by the counter
+     */
+    hat_counter(const hat_trie_traits &traits = hat_trie_traits(),
+                const array_hash_traits &ah_traits = array_hash_traits()) :
+            trie(traits, _value_traits(ah_traits)), _width(1), _total(0) { }
+
+    /**
+     * Adds @a delta occurrences of a string.
+     *
+     * The trie is descended once, unless the new count doesn't fit in
+     * the current counter width. In that case every counter is widened
+     * first.
+     *
+     * O(m)  m = length of the string
+     *
+     * @param key    string to count
+     * @param delta  number of occurrences to add. A string that isn't
+     *               in the counter yet is left out if this is 0
+     * @return  the new count of @a key
+     */
+    count_type increment(const char *key, count_type delta = 1) {
+        if (delta == 0) {
+            hat_trie_type::iterator it = trie.find(key);
+            return it == trie.end() ? 0 : _read(it.value(), _width);
+        }
+        bool inserted;
+        char *p = trie.find_or_insert(key, inserted);
+        count_type count = _read(p, _width) + delta;
+        if (count > _max(_width)) {
+            _widen(count);
+            p = trie.find(key).value();
+        }
+        _write(p, _width, count);
+        _total += delta;
+        return count;
+    }
+
+    /**
+     * Adds @a delta occurrences of a string.
+     *
+     * @param key    string to count
+     * @param delta  number of occurrences to add
+     * @return  the new count of @a key
+     */
+    count_type increment(const key_type &key, count_type delta = 1) {
+        return increment(key.c_str(), delta);
+    }
+
+    /**
+     * Adds @a delta occurrences of a string and gets an iterator to it.
+     *
+     * Like increment(), but the iterator is built during the same
+     * descent, see hat_trie::emplace().
+     *
+     * @param key    string to count
+     * @param delta  number of occurrences to add. A string that isn't
+     *               in the counter yet is left out if this is 0
+     * @return  iterator to @a key, end() if it was left out
+     */
+    iterator insert(const key_type &key, count_type delta = 1) {
+        if (delta == 0) {
+            return find(key);
+        }
+        hat_trie_type::iterator it = trie.emplace(key).first;
+        count_type count = _read(it.value(), _width) + delta;
+        if (count > _max(_width)) {
+            _widen(count);
+            it = trie.find(key);
+        }
+        _write(it.value(), _width, count);
+        _total += delta;
+        return iterator(it, _width);
+    }
+
+    /**
+     * Removes @a delta occurrences of a string. The string is removed
+     * once its count reaches 0.
+     *
+     * @param key    string to uncount
+     * @param delta  number of occurrences to remove
+     * @return  the new count of @a key
+     */
+    count_type decrement(const key_type &key, count_type delta = 1) {
+        hat_trie_type::iterator it = trie.find(key);
+        if (it == trie.end()) {
+            return 0;
+        }
+        count_type count = _read(it.value(), _width);
+        if (count <= delta) {
+            trie.erase(it);
+            _total -= count;
+            return 0;
+        }
+        _write(it.value(), _width, count - delta);
+        _total -= delta;
+        return count - delta;
+    }
+
+    /**
+     * Gets the count of a string.
+     *
+     * O(m)  m = length of the string
+     *
+     * @param key  string to look up
+     * @return  number of occurrences of @a key, 0 if it was never added
+     */
+    count_type count(const key_type &key) const {
+        hat_trie_type::iterator it = trie.find(key);
+        return it == trie.end() ? 0 : _read(it.value(), _width);
+    }
+
+    /**
+     * Removes a string and its count.
+     *
+     * @param key  string to remove
+     * @return  the count @a key had
+     */
+    count_type erase(const key_type &key) {
+        hat_trie_type::iterator it = trie.find(key);
+        if (it == trie.end()) {
+            return 0;
+        }
+        count_type count = _read(it.value(), _width);
+        trie.erase(it);
+        _total -= count;
+        return count;
+    }
+
+    /**
+     * Gets the @a k strings with the highest counts.
+     *
+     * Keeps a heap of the best @a k strings seen in one traversal, so
+     * only strings that make it into the heap are copied.
+     *
+     * O(n log k)  n = number of distinct strings
+     *
+     * @param k  number of strings to get
+     * @return  up to @a k strings and their counts, highest count first.
+     *          Ties are broken by string order
+     */
+    std::vector<value_type> top_k(size_t k) const {
+        std::vector<value_type> heap;
+        if (k == 0) {
+            return heap;
+        }
+        heap.reserve(k + 1);
+        for (hat_trie_type::iterator it = trie.begin(); it != trie.end();
+                ++it) {
+            count_type count = _read(it.value(), _width);
+            if (heap.size() == k) {
+                // heap.front() is the worst of the best k so far.
+                const value_type &worst = heap.front();
+                if (count < worst.second || (count == worst.second &&
+                        it.key() >= worst.first)) {
+                    continue;
+                }
+                std::pop_heap(heap.begin(), heap.end(), _better);
+                heap.pop_back();
+            }
+            heap.push_back(value_type(it.key(), count));
+            std::push_heap(heap.begin(), heap.end(), _better);
+        }
+        std::sort_heap(heap.begin(), heap.end(), _better);
+        return heap;
+    }
+
+    /**
+     * Gets the number of distinct strings counted.
+     */
+    size_type size() const {
+        return trie.size();
+    }
+
+    /**
+     * Gets the sum of all the counts.
+     */
+    count_type total() const {
+        return _total;
+    }
+
+    /**
+     * Determines whether no strings have been counted.
+     */
+    bool empty() const {
+        return trie.empty();
+    }
+
+    /**
+     * Gets the number of bytes each count currently takes.
+     *
+     * @return  1, 2, 4 or 8
+     */
+    int width() const {
+        return _width;
+    }
+
+    /**
+     * Removes all the strings. Counters go back to one byte.
+     */
+    void clear() {
+        trie.clear();
+        trie.resize_values(1, _converter(_width, 1));
+        _width = 1;
+        _total = 0;
+    }
+
+    /**
+     * Gets an iterator to the first string in the counter.
+     */
+    iterator begin() const {
+        return iterator(trie.begin(), _width);
+    }
+
+    /**
+     * Gets an iterator to the lexicographically least string.
+     * Incrementing it visits the strings in sorted order.
+     */
+    iterator ordered_begin() const {
+        return iterator(trie.ordered_begin(), _width);
+    }
+
+    /**
+     * Gets an iterator to one past the last string in the counter.
+     */
+    iterator end() const {
+        return iterator(trie.end(), _width);
+    }
+
+    /**
+     * Gets an iterator to a string.
+     *
+     * @param key  string to search for
+     * @return  iterator to @a key, or end() if it was never added
+     */
+    iterator find(const key_type &key) const {
+        return iterator(trie.find(key), _width);
+    }
+
+    /**
+     * Finds the first string that is not less than @a key.
+     *
+     * @param key  string to search for
+     * @return  ordered iterator to the first such string, or end()
+     */
+    iterator lower_bound(const key_type &key) const {
+        return iterator(trie.lower_bound(key), _width);
+    }
+
+    /**
+     * Finds the first string that is greater than @a key.
+     *
+     * @param key  string to search for
+     * @return  ordered iterator to the first such string, or end()
+     */
+    iterator upper_bound(const key_type &key) const {
+        return iterator(trie.upper_bound(key), _width);
+    }
+
+    /**
+     * Removes the string an iterator points to, with its count.
+     *
+     * @param pos  iterator to the string to remove
+     */
+    void erase(const iterator &pos) {
+        _total -= pos.count();
+        trie.erase(pos._it);
+    }
+
+    /**
+     * Swaps the data in two hat_counter objects.
+     *
+     * O(1)
+     *
+     * @param rhs  hat_counter object to swap data with
+     */
+    void swap(hat_counter &rhs) {
+        using std::swap;
+        trie.swap(rhs.trie);
+        swap(_width, rhs._width);
+        swap(_total, rhs._total);
+    }
+
+    /**
+     * Determines whether two counters hold the same strings with the
+     * same counts.
+     *
+     * @param rhs  counter to compare with
+     * @return  true iff the counters are equal
+     */
+    bool operator==(const hat_counter &rhs) const {
+        if (size() != rhs.size() || total() != rhs.total()) {
+            return false;
+        }
+        for (iterator it = begin(); it != end(); ++it) {
+            if (rhs.count(it.key()) != it.count()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator!=(const hat_counter &rhs) const {
+        return !(*this == rhs);
+    }
+
+  private:
+    hat_trie_type trie;
+    int _width;  // bytes per count
+    count_type _total;
+
+    /// Converts counts from one width to another, see resize_values()
+    struct _converter {
+        int from;
+        int to;
+
+        _converter(int from, int to) : from(from), to(to) { }
+
+        void operator()(const char *value, char *result) const {
+            _write(result, to, _read(value, from));
+        }
+    };
+
+    /**
+     * Widens every counter so that @a count fits.
+     */
+    void _widen(count_type count) {
+        int width = _width;
+        while (count > _max(width)) {
+            width *= 2;
+        }
+        trie.resize_values(width, _converter(_width, width));
+        _width = width;
+    }
+
+    /**
+     * Gets the largest count that fits in @a width bytes.
+     */
+    static count_type _max(int width) {
+        return width == 8 ? ~(count_type) 0 :
+                ((count_type) 1 << (8 * width)) - 1;
+    }
+
+    /**
+     * Reads a count of @a width bytes. Counts are not aligned.
+     */
+    static count_type _read(const char *p, int width) {
+        switch (width) {
+        case 1:
+            return (uint8_t) *p;
+        case 2: {
+            uint16_t count;
+            memcpy(&count, p, sizeof(count));
+            return count;
+        }
+        case 4: {
+            uint32_t count;
+            memcpy(&count, p, sizeof(count));
+            return count;
+        }
+        default: {
+            uint64_t count;
+            memcpy(&count, p, sizeof(count));
+            return count;
+        }
+        }
+    }
+
+    /**
+     * Writes a count of @a width bytes.
+     */
+    static void _write(char *p, int width, count_type count) {
+        switch (width) {
+        case 1:
+            *p = (char) (uint8_t) count;
+            break;
+        case 2: {
+            uint16_t value = (uint16_t) count;
+            memcpy(p, &value, sizeof(value));
+            break;
+        }
+        case 4: {
+            uint32_t value = (uint32_t) count;
+            memcpy(p, &value, sizeof(value));
+            break;
+        }
+        default:
+            memcpy(p, &count, sizeof(count));
+            break;
+        }
+    }
+
+    /**
+     * Orders top_k() results: higher counts first, then smaller strings.
+     */
+    static bool _better(const value_type &a, const value_type &b) {
+        return a.second > b.second ||
+                (a.second == b.second && a.first < b.first);
+    }
+
+    /**
+     * Copies array hash traits, sizing their values for one byte
+     * counters.
+     */
+    static array_hash_traits _value_traits(array_hash_traits ah_traits) {
+        ah_traits.value_size = 1;
+        return ah_traits;
+    }
+
+};
+
+}  // namespace stx
+
+#endif  // HAT_COUNTER_H
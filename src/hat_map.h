@@ -0,0 +1,649 @@
+/*
+ * Copyright 2010-2011 Chris Vaszauskas and Tyler Richard
+ *
+ * This file is part of a HAT-trie implementation following the paper
+ * entitled "HAT-trie: A Cache-concious Trie-based Data Structure for
+ * Strings" by Nikolas Askitis and Ranjan Sinha.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAT_MAP_H
+#define HAT_MAP_H
+
+#include <stdexcept>
+
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
+
+#include "hat_trie.h"
+
+namespace stx {
+
+template <class K, class T> class hat_map;
+
+/**
+ * @brief HAT-trie based map that implements most of the STL map interface
+ *
+ * Values are stored inline: right after their key inside a container's
+ * slot, or in a small block owned by the trie node that marks the key.
+ * A map therefore costs no more allocations than a hat_set with the
+ * same keys. Bursts and rehashes move values with memcpy, so the mapped
+ * type must be trivially copyable, and values are not aligned (like the
+ * length prefixes in array_hash).
+ *
+ * Since an unaligned value can't be bound to a T&, operator[], at() and
+ * iterator::value() return a mapped_reference, which copies the value in
+ * and out with memcpy. It converts to T and can be assigned and
+ * incremented like the value itself:
+ *
+ * @code
+ * ++counts[word];
+ * counts.at("the") = 0;
+ * int n = counts["the"];
+ * @endcode
+ *
+ * Because values live next to their keys, there are no stable
+ * references: a mapped_reference is only valid until the next insert or
+ * erase.
+ *
+ * Note: the only available key type is std::string. Using any other
+ * key type will result in a compile-time error.
+ */
+template <class T>
+class hat_map<std::string, T> {
+
+  private:
+    typedef hat_trie<std::string>     hat_trie_type;
+    typedef hat_map<std::string, T>   _self;
+
+#if __cplusplus >= 201103L
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "hat_map values are moved with memcpy");
+#endif
+
+  public:
+    // STL types
+    typedef hat_trie_type::size_type         size_type;
+    typedef hat_trie_type::key_type          key_type;
+    typedef T                                mapped_type;
+    typedef std::pair<const key_type, T>     value_type;
+
+    /**
+     * @brief Refers to a value stored in a hat_map
+     *
+     * Reads and writes the unaligned value with memcpy.
+     */
+    class mapped_reference {
+        friend class hat_map;
+
+      public:
+        operator mapped_type() const {
+            return _read(_p);
+        }
+
+        mapped_reference &operator=(const mapped_type &value) {
+            memcpy(_p, &value, sizeof(T));
+            return *this;
+        }
+
+        mapped_reference &operator=(const mapped_reference &rhs) {
+            return *this = _read(rhs._p);
+        }
+
+        mapped_reference &operator+=(const mapped_type &delta) {
+            return *this = _read(_p) + delta;
+        }
+
+        mapped_reference &operator-=(const mapped_type &delta) {
+            return *this = _read(_p) - delta;
+        }
+
+        mapped_reference &operator++() {
+            mapped_type value = _read(_p);
+            return *this = ++value;
+        }
+
+        mapped_reference &operator--() {
+            mapped_type value = _read(_p);
+            return *this = --value;
+        }
+
+        mapped_type operator++(int) {
+            mapped_type result = _read(_p);
+            ++*this;
+            return result;
+        }
+
+        mapped_type operator--(int) {
+            mapped_type result = _read(_p);
+            --*this;
+            return result;
+        }
+
+      private:
+        char *_p;  // the value's bytes in the trie
+
+        explicit mapped_reference(char *p) : _p(p) { }
+    };
+
+    /**
+     * @brief Iterates over the key-value pairs in a hat_map
+     *
+     * Dereferencing yields a copy of the pair. Use key() and value() to
+     * reach the key and the stored value without copying.
+     */
+    class iterator : public std::iterator<std::bidirectional_iterator_tag,
+                                          value_type> {
+        friend class hat_map;
+
+      public:
+        typedef value_type reference;
+
+        iterator() { }
+
+        iterator &operator++() {
+            ++_it;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator result = *this;
+            ++_it;
+            return result;
+        }
+
+        iterator &operator--() {
+            --_it;
+            return *this;
+        }
+
+        iterator operator--(int) {
+            iterator result = *this;
+            --_it;
+            return result;
+        }
+
+        /**
+         * Iterator dereference operator.
+         *
+         * @return  copy of the key-value pair this iterator points to
+         */
+        value_type operator*() const {
+            return value_type(_it.key(), value());
+        }
+
+        /**
+         * Gets the key this iterator points to without allocating.
+         *
+         * @return  reference to the key. It is only valid until the
+         *          iterator is moved or destroyed
+         */
+        const key_type &key() const {
+            return _it.key();
+        }
+
+        /**
+         * Gets the value this iterator points to.
+         *
+         * @return  reference to the value stored in the trie
+         */
+        mapped_reference value() const {
+            return mapped_reference(_it.value());
+        }
+
+        bool operator==(const iterator &rhs) const {
+            return _it == rhs._it;
+        }
+
+        bool operator!=(const iterator &rhs) const {
+            return _it != rhs._it;
+        }
+
+      private:
+        hat_trie_type::iterator _it;
+
+        iterator(const hat_trie_type::iterator &it) : _it(it) { }
+    };
+
+    typedef iterator const_iterator;
+
+    /**
+     * Default constructor.
+     *
+     * O(1)
+     *
+     * @param traits     hat trie customization traits
+     * @param ah_traits  array hash customization traits. Its
+     *                   @a value_size is set to sizeof(T)
+     */
+    hat_map(const hat_trie_traits &traits = hat_trie_traits(),
+            const array_hash_traits &ah_traits = array_hash_traits()) :
+            trie(traits, _value_traits(ah_traits)) { }
+
+    /**
+     * Builds a HAT map from the key-value pairs in [first, last).
+     *
+     * @param first, last  iterators specifying a range of pairs to
+     *                     initialize the map with
+     */
+    template <class input_iterator>
+    hat_map(const input_iterator &first, const input_iterator &last,
+            const hat_trie_traits &traits = hat_trie_traits(),
+            const array_hash_traits &ah_traits = array_hash_traits()) :
+            trie(traits, _value_traits(ah_traits)) {
+        insert(first, last);
+    }
+
+    /**
+     * Searches for a key in the map.
+     *
+     * O(m)  m = length of the string
+     *
+     * @param key  key to search for
+     * @return  true iff @a key is in the map
+     */
+    bool exists(const key_type &key) const {
+        return trie.exists(key);
+    }
+
+    /**
+     * Counts the number of times a key appears in the map.
+     *
+     * O(m)  m = length of the string
+     *
+     * @param key  key to search for
+     * @return  1 if @a key is in the map, 0 otherwise
+     */
+    size_type count(const key_type &key) const {
+        return trie.count(key);
+    }
+
+    /**
+     * Determines whether this map is empty.
+     *
+     * O(1)
+     *
+     * @return  true iff the map has no data
+     */
+    bool empty() const {
+        return trie.empty();
+    }
+
+    /**
+     * Gets the number of key-value pairs in the map.
+     *
+     * O(1)
+     *
+     * @return  number of pairs in the map
+     */
+    size_type size() const {
+        return trie.size();
+    }
+
+    /**
+     * Gets the traits associated with this map's trie.
+     *
+     * @return  traits associated with this trie
+     */
+    const hat_trie_traits &traits() const {
+        return trie.traits();
+    }
+
+    /**
+     * Gets the array hash traits associated with the hash tables in
+     * this map.
+     *
+     * @return  array hash traits associated with this map
+     */
+    const array_hash_traits &hash_traits() const {
+        return trie.hash_traits();
+    }
+
+    /**
+     * Removes all the pairs in the map.
+     */
+    void clear() {
+        trie.clear();
+    }
+
+    /**
+     * Inserts a key-value pair into the map. An existing value is left
+     * untouched, like std::map::insert.
+     *
+     * Returns a bool for the same reason hat_set::insert does.
+     *
+     * O(m)  m = length of the key
+     *
+     * @param pair  key and value to insert
+     * @return  true if the key was inserted, false if it was already
+     *          in the map
+     */
+    bool insert(const value_type &pair) {
+        bool inserted;
+        _emplace(pair.first.c_str(), pair.second, inserted);
+        return inserted;
+    }
+
+    /**
+     * Inserts a key-value pair into the map, or assigns the value if the
+     * key is already there.
+     *
+     * O(m)  m = length of the key. The trie is descended once
+     *
+     * @param key    key to insert
+     * @param value  value to store under @a key
+     * @return  true if the key was inserted, false if it was assigned
+     */
+    bool insert_or_assign(const key_type &key, const mapped_type &value) {
+        bool inserted;
+        char *p = _emplace(key.c_str(), value, inserted);
+        if (!inserted) {
+            memcpy(p, &value, sizeof(T));
+        }
+        return inserted;
+    }
+
+    /**
+     * Gets the value of a key, inserting T() under the key first if it
+     * isn't in the map.
+     *
+     * Unlike calling find() and then insert(), this descends the trie
+     * once, even when the insertion bursts a container. Counting words
+     * is as simple as:
+     *
+     * @code
+     * hat_map<string, int> counts;
+     * while (cin >> word) {
+     *     ++counts[word];
+     * }
+     * @endcode
+     *
+     * O(m)  m = length of the key
+     *
+     * @param key  key to look up
+     * @return  reference to the value of @a key. It is valid until the
+     *          next insert or erase
+     */
+    mapped_reference operator[](const key_type &key) {
+        return (*this)[key.c_str()];
+    }
+
+    /**
+     * Gets the value of a key, inserting T() under the key first if it
+     * isn't in the map.
+     *
+     * Uses C-strings instead of C++ strings, to save a string copy when
+     * the keys come from a buffer.
+     *
+     * @param key  key to look up
+     * @return  reference to the value of @a key
+     */
+    mapped_reference operator[](const char *key) {
+        bool inserted;
+        return mapped_reference(_emplace(key, mapped_type(), inserted));
+    }
+
+    /**
+     * Inserts a key-value pair into the map unless the key is already
+     * there, and gets an iterator to the key's pair.
+     *
+     * O(m)  m = length of the key. The trie is descended once
+     *
+     * @param key    key to insert
+     * @param value  value for @a key if it is inserted
+     * @return  pair of an iterator to the pair with @a key and true if
+     *          it was inserted, false if the key was already in the map
+     */
+    std::pair<iterator, bool> try_emplace(const key_type &key,
+                                          const mapped_type &value) {
+        std::pair<hat_trie_type::iterator, bool> result = trie.emplace(key);
+        if (result.second) {
+            memcpy(result.first.value(), &value, sizeof(T));
+        }
+        return std::make_pair(iterator(result.first), result.second);
+    }
+
+    /**
+     * Inserts several key-value pairs into the map.
+     *
+     * @param first, last  iterators specifying a range of pairs to add
+     */
+    template <class input_iterator>
+    void insert(input_iterator first, const input_iterator &last) {
+        for (; first != last; ++first) {
+            insert(value_type(first->first, first->second));
+        }
+    }
+
+    /**
+     * Erases a key and its value from the map.
+     *
+     * @param key  key to erase
+     * @return  number of pairs erased
+     */
+    size_type erase(const key_type &key) {
+        return trie.erase(key);
+    }
+
+    /**
+     * Erases a key and its value from the map.
+     *
+     * @param pos  iterator to the pair to erase
+     */
+    void erase(const iterator &pos) {
+        trie.erase(pos._it);
+    }
+
+    /**
+     * Gets the value of a key.
+     *
+     * O(m)  m = length of the key
+     *
+     * @param key  key to look up
+     * @return  reference to the value of @a key
+     * @throw std::out_of_range  if @a key is not in the map
+     */
+    mapped_reference at(const key_type &key) {
+        return mapped_reference(_find(key));
+    }
+
+    /**
+     * Gets a copy of the value of a key.
+     *
+     * O(m)  m = length of the key
+     *
+     * @param key  key to look up
+     * @return  the value of @a key
+     * @throw std::out_of_range  if @a key is not in the map
+     */
+    mapped_type at(const key_type &key) const {
+        return _read(_find(key));
+    }
+
+    /**
+     * Gets an iterator to the first pair in the map.
+     *
+     * @return  iterator to the first pair in the map
+     */
+    iterator begin() const {
+        return trie.begin();
+    }
+
+    /**
+     * Gets an iterator to the pair with the lexicographically least
+     * key. Incrementing it visits the pairs in key order.
+     *
+     * @return  ordered iterator to the first pair in the map
+     */
+    iterator ordered_begin() const {
+        return trie.ordered_begin();
+    }
+
+    /**
+     * Gets an iterator to one past the last pair in the map.
+     *
+     * @return  iterator to one past the last pair in the map
+     */
+    iterator end() const {
+        return trie.end();
+    }
+
+    /**
+     * Searches for a key in the map.
+     *
+     * @param key  key to search for
+     * @return  iterator to the pair with @a key, or end() if there is
+     *          none
+     */
+    iterator find(const key_type &key) const {
+        return trie.find(key);
+    }
+
+    /**
+     * Finds the first pair whose key is not less than @a key.
+     *
+     * @param key  key to search for
+     * @return  ordered iterator to the first such pair, or end()
+     */
+    iterator lower_bound(const key_type &key) const {
+        return trie.lower_bound(key);
+    }
+
+    /**
+     * Finds the first pair whose key is greater than @a key.
+     *
+     * @param key  key to search for
+     * @return  ordered iterator to the first such pair, or end()
+     */
+    iterator upper_bound(const key_type &key) const {
+        return trie.upper_bound(key);
+    }
+
+    /**
+     * Finds the pairs whose keys start with @a prefix, in key order.
+     *
+     * @param prefix  prefix to search for
+     * @return  pair of ordered iterators delimiting the pairs
+     */
+    std::pair<iterator, iterator> prefix_range(const key_type &prefix) const {
+        std::pair<hat_trie_type::iterator, hat_trie_type::iterator> range =
+                trie.prefix_range(prefix);
+        return std::make_pair(iterator(range.first), iterator(range.second));
+    }
+
+    /**
+     * Swaps the data in two hat_map objects.
+     *
+     * O(1)
+     *
+     * @param rhs  hat_map object to swap data with
+     */
+    void swap(_self &rhs) {
+        trie.swap(rhs.trie);
+    }
+
+    /**
+     * Determines whether two maps hold the same keys with equal values.
+     *
+     * @param rhs  map to compare with
+     * @return  true iff the maps are equal
+     */
+    bool operator==(const _self &rhs) const {
+        if (size() != rhs.size()) {
+            return false;
+        }
+        for (iterator it = begin(); it != end(); ++it) {
+            hat_trie_type::iterator other = rhs.trie.find(it.key());
+            if (other == rhs.trie.end() ||
+                    !(_read(it._it.value()) == _read(other.value()))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator!=(const _self &rhs) const {
+        return !(*this == rhs);
+    }
+
+  private:
+    hat_trie_type trie;
+
+    /**
+     * Finds a key, inserting it with @a value first if it isn't there.
+     *
+     * @param key       key to find or insert
+     * @param value     value for @a key if it is inserted
+     * @param inserted  set to true if @a key was inserted
+     * @return  the value bytes of @a key
+     */
+    char *_emplace(const char *key, const mapped_type &value,
+                   bool &inserted) {
+        char *p = trie.find_or_insert(key, inserted);
+        if (inserted) {
+            memcpy(p, &value, sizeof(T));
+        }
+        return p;
+    }
+
+    /**
+     * Finds the value bytes of a key.
+     *
+     * @throw std::out_of_range  if @a key is not in the map
+     */
+    char *_find(const key_type &key) const {
+        hat_trie_type::iterator it = trie.find(key);
+        if (it == trie.end()) {
+            throw std::out_of_range("hat_map::at");
+        }
+        return it.value();
+    }
+
+    /**
+     * Reads a value from its unaligned bytes.
+     */
+    static mapped_type _read(const char *p) {
+        mapped_type result;
+        memcpy(&result, p, sizeof(T));
+        return result;
+    }
+
+    /**
+     * Copies array hash traits, sizing their values for T.
+     *
+     * @param ah_traits  traits to copy
+     * @return  @a ah_traits with value_size set to sizeof(T)
+     */
+    static array_hash_traits _value_traits(array_hash_traits ah_traits) {
+        ah_traits.value_size = sizeof(T);
+        return ah_traits;
+    }
+
+};
+
+/**
+ * Swaps the data in two hat_maps.
+ *
+ * @param lhs, rhs  hat_map objects to swap
+ */
+template <class T>
+void swap(hat_map<std::string, T> &lhs, hat_map<std::string, T> &rhs) {
+    lhs.swap(rhs);
+}
+
+}  // namespace stx
+
+#endif  // HAT_MAP_H
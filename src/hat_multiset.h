@@ -0,0 +1,411 @@
+/*
+ * Copyright 2010-2011 Chris Vaszauskas and Tyler Richard
+ *
+ * This file is part of a HAT-trie implementation following the paper
+ * entitled "HAT-trie: A Cache-concious Trie-based Data Structure for
+ * Strings" by Nikolas Askitis and Ranjan Sinha.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAT_MULTISET_H
+#define HAT_MULTISET_H
+
+#include "hat_counter.h"
+
+namespace stx {
+
+template <class T> class hat_multiset;
+
+/**
+ * @brief HAT-trie based multiset that implements most of the STL
+ * multiset interface
+ *
+ * Each distinct string is stored once, with a count of its occurrences
+ * (see hat_counter). The default iterators expand the counts, visiting a
+ * string once per occurrence like a std::multiset. The counted iterators
+ * visit each distinct string once, with its count.
+ *
+ * Note: the only available template parameter is std::string. Using
+ * any other template parameter will result in a compile-time error.
+ */
+template <>
+class hat_multiset<std::string> {
+
+  private:
+    typedef hat_counter<std::string> counter_type;
+    typedef hat_multiset<std::string> _self;
+
+  public:
+    // STL types
+    typedef counter_type::size_type   size_type;
+    typedef counter_type::key_type    key_type;
+    typedef key_type                  value_type;
+    typedef counter_type::count_type  count_type;
+
+    /// Visits each distinct string once, with its count
+    typedef counter_type::iterator    counted_iterator;
+
+    /**
+     * @brief Iterates over the strings in a hat_multiset, once per
+     * occurrence
+     */
+    class iterator : public std::iterator<std::bidirectional_iterator_tag,
+                                          const key_type> {
+        friend class hat_multiset;
+
+      public:
+        // Dereferencing builds the string, so it is returned by value.
+        typedef key_type reference;
+
+        iterator() : _occurrence(0) { }
+
+        iterator &operator++() {
+            if (++_occurrence == _it.count()) {
+                ++_it;
+                _occurrence = 0;
+            }
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator result = *this;
+            operator++();
+            return result;
+        }
+
+        iterator &operator--() {
+            if (_occurrence == 0) {
+                --_it;
+                _occurrence = _it.count() - 1;
+            } else {
+                --_occurrence;
+            }
+            return *this;
+        }
+
+        iterator operator--(int) {
+            iterator result = *this;
+            operator--();
+            return result;
+        }
+
+        /**
+         * Iterator dereference operator.
+         *
+         * @return  string this iterator points to
+         */
+        key_type operator*() const {
+            return _it.key();
+        }
+
+        /**
+         * Gets the string this iterator points to without allocating.
+         *
+         * @return  reference to the string. It is only valid until the
+         *          iterator is moved or destroyed
+         */
+        const key_type &key() const {
+            return _it.key();
+        }
+
+        /**
+         * Gets the counted iterator to the string this iterator points
+         * to. Incrementing it skips the rest of the string's occurrences.
+         */
+        const counted_iterator &counted() const {
+            return _it;
+        }
+
+        bool operator==(const iterator &rhs) const {
+            return _it == rhs._it && _occurrence == rhs._occurrence;
+        }
+
+        bool operator!=(const iterator &rhs) const {
+            return !operator==(rhs);
+        }
+
+      private:
+        counted_iterator _it;
+        count_type _occurrence;  // which occurrence of the string
+
+        iterator(const counted_iterator &it, count_type occurrence = 0) :
+                _it(it), _occurrence(occurrence) { }
+    };
+
+    typedef iterator const_iterator;
+
+    /**
+     * Default constructor.
+     *
+     * O(1)
+     *
+     * @param traits     hat trie customization traits
+     * @param ah_traits  array hash customization traits
+     */
+    hat_multiset(const hat_trie_traits &traits = hat_trie_traits(),
+                 const array_hash_traits &ah_traits = array_hash_traits()) :
+            counter(traits, ah_traits) { }
+
+    /**
+     * Builds a HAT multiset from the data in [first, last).
+     *
+     * @param first, last  iterators specifying a range of elements to
+     *                     initialize the multiset with
+     */
+    template <class input_iterator>
+    hat_multiset(input_iterator first, const input_iterator &last,
+                 const hat_trie_traits &traits = hat_trie_traits(),
+                 const array_hash_traits &ah_traits = array_hash_traits()) :
+            counter(traits, ah_traits) {
+        insert(first, last);
+    }
+
+    /**
+     * Searches for a string in the multiset.
+     *
+     * @param word  string to search for
+     * @return  true iff @a word occurs at least once
+     */
+    bool exists(const key_type &word) const {
+        return counter.count(word) > 0;
+    }
+
+    /**
+     * Counts the occurrences of a string.
+     *
+     * O(m)  m = length of the string
+     *
+     * @param word  string to search for
+     * @return  number of times @a word occurs in the multiset
+     */
+    size_type count(const key_type &word) const {
+        return counter.count(word);
+    }
+
+    /**
+     * Determines whether this multiset is empty.
+     */
+    bool empty() const {
+        return counter.empty();
+    }
+
+    /**
+     * Gets the number of elements in the multiset, counting every
+     * occurrence.
+     *
+     * O(1)
+     */
+    size_type size() const {
+        return counter.total();
+    }
+
+    /**
+     * Gets the number of distinct strings in the multiset.
+     *
+     * O(1)
+     */
+    size_type distinct_size() const {
+        return counter.size();
+    }
+
+    /**
+     * Removes all the elements in the multiset.
+     */
+    void clear() {
+        counter.clear();
+    }
+
+    /**
+     * Adds an occurrence of a string.
+     *
+     * O(m)  m = length of the string
+     *
+     * @param word  string to insert
+     * @return  iterator to the new occurrence, the last one of @a word
+     */
+    iterator insert(const value_type &word) {
+        counted_iterator it = counter.insert(word);
+        return iterator(it, it.count() - 1);
+    }
+
+    /**
+     * Adds an occurrence of a string.
+     *
+     * @param pos   unused
+     * @param word  string to insert
+     * @return  iterator to the new occurrence
+     */
+    iterator insert(const iterator &, const value_type &word) {
+        return insert(word);
+    }
+
+    /**
+     * Adds an occurrence of every string in [first, last).
+     *
+     * @param first, last  iterators specifying a range of strings
+     */
+    template <class input_iterator>
+    void insert(input_iterator first, const input_iterator &last) {
+        for (; first != last; ++first) {
+            counter.increment(*first);
+        }
+    }
+
+    /**
+     * Erases every occurrence of a string.
+     *
+     * @param word  string to erase
+     * @return  number of occurrences erased
+     */
+    size_type erase(const key_type &word) {
+        return counter.erase(word);
+    }
+
+    /**
+     * Erases one occurrence of a string.
+     *
+     * @param pos  iterator to the occurrence to erase
+     */
+    void erase(const iterator &pos) {
+        if (pos._it.count() == 1) {
+            counter.erase(pos._it);
+        } else {
+            counter.decrement(pos.key());
+        }
+    }
+
+    /**
+     * Gets an iterator to the first occurrence of a string.
+     *
+     * @param word  string to search for
+     * @return  iterator to the first occurrence of @a word, or end()
+     */
+    iterator find(const key_type &word) const {
+        return counter.find(word);
+    }
+
+    /**
+     * Finds the first element that is not less than @a word.
+     *
+     * @param word  string to search for
+     * @return  ordered iterator to the first such element, or end()
+     */
+    iterator lower_bound(const key_type &word) const {
+        return counter.lower_bound(word);
+    }
+
+    /**
+     * Finds the first element that is greater than @a word.
+     *
+     * @param word  string to search for
+     * @return  ordered iterator to the first such element, or end()
+     */
+    iterator upper_bound(const key_type &word) const {
+        return counter.upper_bound(word);
+    }
+
+    /**
+     * Finds the occurrences of a string.
+     *
+     * @param word  string to search for
+     * @return  pair of iterators spanning every occurrence of @a word.
+     *          Both are end() if @a word doesn't occur
+     */
+    std::pair<iterator, iterator> equal_range(const key_type &word) const {
+        counted_iterator it = counter.find(word);
+        if (it == counter.end()) {
+            return std::make_pair(end(), end());
+        }
+        counted_iterator next = it;
+        return std::make_pair(iterator(it), iterator(++next));
+    }
+
+    /**
+     * Gets an iterator to the first element in the multiset.
+     */
+    iterator begin() const {
+        return counter.begin();
+    }
+
+    /**
+     * Gets an iterator to the lexicographically least element.
+     * Incrementing it visits the elements in sorted order.
+     */
+    iterator ordered_begin() const {
+        return counter.ordered_begin();
+    }
+
+    /**
+     * Gets an iterator to one past the last element in the multiset.
+     */
+    iterator end() const {
+        return counter.end();
+    }
+
+    /**
+     * Gets an iterator to the first distinct string in the multiset.
+     *
+     * @code
+     * hat_multiset<string>::counted_iterator it;
+     * for (it = words.counted_begin(); it != words.counted_end(); ++it) {
+     *     cout << it.key() << " x" << it.count() << endl;
+     * }
+     * @endcode
+     */
+    counted_iterator counted_begin() const {
+        return counter.begin();
+    }
+
+    /**
+     * Gets an iterator to the lexicographically least distinct string.
+     */
+    counted_iterator ordered_counted_begin() const {
+        return counter.ordered_begin();
+    }
+
+    /**
+     * Gets an iterator to one past the last distinct string.
+     */
+    counted_iterator counted_end() const {
+        return counter.end();
+    }
+
+    /**
+     * Swaps the data in two hat_multiset objects.
+     *
+     * O(1)
+     *
+     * @param rhs  hat_multiset object to swap data with
+     */
+    void swap(_self &rhs) {
+        counter.swap(rhs.counter);
+    }
+
+    bool operator==(const _self &rhs) const {
+        return counter == rhs.counter;
+    }
+
+    bool operator!=(const _self &rhs) const {
+        return counter != rhs.counter;
+    }
+
+  private:
+    counter_type counter;
+
+};
+
+}  // namespace stx
+
+#endif  // HAT_MULTISET_H
@@ -0,0 +1,475 @@
+/*
+ * Copyright 2010-2011 Chris Vaszauskas and Tyler Richard
+ *
+ * This file is part of a HAT-trie implementation following the paper
+ * entitled "HAT-trie: A Cache-concious Trie-based Data Structure for
+ * Strings" by Nikolas Askitis and Ranjan Sinha.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAT_SCORED_MAP_H
+#define HAT_SCORED_MAP_H
+
+#include <stdexcept>
+
+#include "hat_trie.h"
+
+namespace stx {
+
+template <class T> class hat_scored_map;
+
+/**
+ * @brief HAT-trie that maps strings to scores and finds the best scoring
+ * completions of a prefix
+ *
+ * Every node and container of the trie keeps the greatest score beneath
+ * it (see hat_trie_traits::scored). top_k() uses these maxima to search
+ * best-first, so finding the few best completions of a popular prefix
+ * doesn't visit every string that starts with it.
+ *
+ * @code
+ * hat_scored_map<string> completions;
+ * while (cin >> query) {
+ *     completions.increment(query);
+ * }
+ * completions.top_k("th", 10);  // ten most popular queries starting "th"
+ * @endcode
+ *
+ * Scores can only be changed through the map, so the iterators give
+ * them out by value.
+ *
+ * The maxima only prune above the containers, and top_k() scans every
+ * container it opens. A burst threshold around 1024 keeps that scan
+ * short. On two-word phrases it made one-letter queries about ten
+ * times faster than the default threshold.
+ *
+ * Note: the only available template parameter is std::string. Using
+ * any other template parameter will result in a compile-time error.
+ */
+template <>
+class hat_scored_map<std::string> {
+
+  private:
+    typedef hat_trie<std::string>       hat_trie_type;
+    typedef hat_scored_map<std::string> _self;
+
+  public:
+    // STL types
+    typedef hat_trie_type::size_type   size_type;
+    typedef hat_trie_type::key_type    key_type;
+    typedef hat_trie_type::score_type  score_type;
+    typedef std::pair<key_type, score_type> value_type;
+
+    /**
+     * @brief Iterates over the strings in a hat_scored_map and their
+     * scores
+     */
+    class iterator : public std::iterator<std::bidirectional_iterator_tag,
+                                          value_type> {
+        friend class hat_scored_map;
+
+      public:
+        typedef value_type reference;
+
+        iterator() { }
+
+        iterator &operator++() {
+            ++_it;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator result = *this;
+            ++_it;
+            return result;
+        }
+
+        iterator &operator--() {
+            --_it;
+            return *this;
+        }
+
+        iterator operator--(int) {
+            iterator result = *this;
+            --_it;
+            return result;
+        }
+
+        /**
+         * Iterator dereference operator.
+         *
+         * @return  the string this iterator points to and its score
+         */
+        value_type operator*() const {
+            return value_type(_it.key(), score());
+        }
+
+        /**
+         * Gets the string this iterator points to without allocating.
+         *
+         * @return  reference to the string. It is only valid until the
+         *          iterator is moved or destroyed
+         */
+        const key_type &key() const {
+            return _it.key();
+        }
+
+        /**
+         * Gets the score of the string this iterator points to.
+         */
+        score_type score() const {
+            return _read(_it.value());
+        }
+
+        bool operator==(const iterator &rhs) const {
+            return _it == rhs._it;
+        }
+
+        bool operator!=(const iterator &rhs) const {
+            return _it != rhs._it;
+        }
+
+      private:
+        hat_trie_type::iterator _it;
+
+        iterator(const hat_trie_type::iterator &it) : _it(it) { }
+    };
+
+    typedef iterator const_iterator;
+
+    /**
+     * Default constructor.
+     *
+     * O(1)
+     *
+     * @param traits     hat trie customization traits. Its @a scored
+     *                   flag is set
+     * @param ah_traits  array hash customization traits. Its
+     *                   @a value_size is set to sizeof(score_type)
+     */
+    hat_scored_map(const hat_trie_traits &traits = hat_trie_traits(),
+                   const array_hash_traits &ah_traits = array_hash_traits()) :
+            trie(_scored_traits(traits), _value_traits(ah_traits)) { }
+
+    /**
+     * Builds a scored map from the string-score pairs in [first, last).
+     *
+     * @param first, last  iterators specifying a range of pairs to
+     *                     initialize the map with
+     */
+    template <class input_iterator>
+    hat_scored_map(const input_iterator &first, const input_iterator &last,
+                   const hat_trie_traits &traits = hat_trie_traits(),
+                   const array_hash_traits &ah_traits = array_hash_traits()) :
+            trie(_scored_traits(traits), _value_traits(ah_traits)) {
+        insert(first, last);
+    }
+
+    /**
+     * Searches for a string in the map.
+     *
+     * @param key  string to search for
+     * @return  true iff @a key is in the map
+     */
+    bool exists(const key_type &key) const {
+        return trie.exists(key);
+    }
+
+    /**
+     * Counts the number of times a string appears in the map.
+     *
+     * @param key  string to search for
+     * @return  1 if @a key is in the map, 0 otherwise
+     */
+    size_type count(const key_type &key) const {
+        return trie.count(key);
+    }
+
+    /**
+     * Determines whether this map is empty.
+     */
+    bool empty() const {
+        return trie.empty();
+    }
+
+    /**
+     * Gets the number of strings in the map.
+     *
+     * O(1)
+     */
+    size_type size() const {
+        return trie.size();
+    }
+
+    /**
+     * Removes all the strings in the map.
+     */
+    void clear() {
+        trie.clear();
+    }
+
+    /**
+     * Inserts a string with a score. An existing score is left
+     * untouched, like std::map::insert.
+     *
+     * @param pair  string and score to insert
+     * @return  true if the string was inserted, false if it was already
+     *          in the map
+     */
+    bool insert(const value_type &pair) {
+        if (trie.exists(pair.first)) {
+            return false;
+        }
+        return trie.set_score(pair.first.c_str(), pair.second);
+    }
+
+    /**
+     * Inserts several string-score pairs into the map.
+     *
+     * @param first, last  iterators specifying a range of pairs to add
+     */
+    template <class input_iterator>
+    void insert(input_iterator first, const input_iterator &last) {
+        for (; first != last; ++first) {
+            insert(value_type(first->first, first->second));
+        }
+    }
+
+    /**
+     * Inserts a string with a score, or sets the score if the string is
+     * already there.
+     *
+     * O(m)  m = length of the string. The trie is descended once.
+     * Lowering the best score of a container also rescans it, see
+     * hat_trie::set_score()
+     *
+     * @param key    string to score
+     * @param score  new score of @a key
+     * @return  true if the string was inserted, false if it was assigned
+     */
+    bool insert_or_assign(const key_type &key, score_type score) {
+        return trie.set_score(key.c_str(), score);
+    }
+
+    /**
+     * Adds @a delta to the score of a string, inserting the string with
+     * a score of @a delta if it isn't there.
+     *
+     * @param key    string to score
+     * @param delta  amount to add
+     * @return  the new score of @a key
+     */
+    score_type increment(const key_type &key, score_type delta = 1) {
+        hat_trie_type::iterator it = trie.find(key);
+        if (it != trie.end()) {
+            delta += _read(it.value());
+        }
+        trie.set_score(key.c_str(), delta);
+        return delta;
+    }
+
+    /**
+     * Gets the score of a string.
+     *
+     * O(m)  m = length of the string
+     *
+     * @param key  string to look up
+     * @return  the score of @a key
+     * @throw std::out_of_range  if @a key is not in the map
+     */
+    score_type score(const key_type &key) const {
+        hat_trie_type::iterator it = trie.find(key);
+        if (it == trie.end()) {
+            throw std::out_of_range("hat_scored_map::score");
+        }
+        return _read(it.value());
+    }
+
+    /**
+     * Finds the @a k best scoring strings that start with @a prefix,
+     * see hat_trie::top_k().
+     *
+     * @param prefix  prefix the strings must start with. The empty
+     *                string matches every string
+     * @param k       number of strings to find
+     * @return  up to @a k strings and their scores, ordered by score
+     *          from the greatest and then by string
+     */
+    std::vector<value_type> top_k(const key_type &prefix, size_t k) const {
+        return trie.top_k(prefix, k);
+    }
+
+    /**
+     * Erases a string and its score from the map.
+     *
+     * @param key  string to erase
+     * @return  number of strings erased
+     */
+    size_type erase(const key_type &key) {
+        return trie.erase(key);
+    }
+
+    /**
+     * Erases a string and its score from the map.
+     *
+     * @param pos  iterator to the string to erase
+     */
+    void erase(const iterator &pos) {
+        trie.erase(pos._it);
+    }
+
+    /**
+     * Gets an iterator to the first string in the map.
+     */
+    iterator begin() const {
+        return trie.begin();
+    }
+
+    /**
+     * Gets an iterator to the lexicographically least string.
+     * Incrementing it visits the strings in sorted order.
+     */
+    iterator ordered_begin() const {
+        return trie.ordered_begin();
+    }
+
+    /**
+     * Gets an iterator to one past the last string in the map.
+     */
+    iterator end() const {
+        return trie.end();
+    }
+
+    /**
+     * Searches for a string in the map.
+     *
+     * @param key  string to search for
+     * @return  iterator to @a key, or end() if it isn't in the map
+     */
+    iterator find(const key_type &key) const {
+        return trie.find(key);
+    }
+
+    /**
+     * Finds the first string that is not less than @a key.
+     *
+     * @param key  string to search for
+     * @return  ordered iterator to the first such string, or end()
+     */
+    iterator lower_bound(const key_type &key) const {
+        return trie.lower_bound(key);
+    }
+
+    /**
+     * Finds the first string that is greater than @a key.
+     *
+     * @param key  string to search for
+     * @return  ordered iterator to the first such string, or end()
+     */
+    iterator upper_bound(const key_type &key) const {
+        return trie.upper_bound(key);
+    }
+
+    /**
+     * Finds the strings that start with @a prefix, in sorted order.
+     *
+     * @param prefix  prefix to search for
+     * @return  pair of ordered iterators delimiting the strings
+     */
+    std::pair<iterator, iterator> prefix_range(const key_type &prefix) const {
+        std::pair<hat_trie_type::iterator, hat_trie_type::iterator> range =
+                trie.prefix_range(prefix);
+        return std::make_pair(iterator(range.first), iterator(range.second));
+    }
+
+    /**
+     * Swaps the data in two hat_scored_map objects.
+     *
+     * O(1)
+     *
+     * @param rhs  hat_scored_map object to swap data with
+     */
+    void swap(_self &rhs) {
+        trie.swap(rhs.trie);
+    }
+
+    /**
+     * Determines whether two maps hold the same strings with equal
+     * scores.
+     *
+     * @param rhs  map to compare with
+     * @return  true iff the maps are equal
+     */
+    bool operator==(const _self &rhs) const {
+        if (size() != rhs.size()) {
+            return false;
+        }
+        for (iterator it = begin(); it != end(); ++it) {
+            hat_trie_type::iterator other = rhs.trie.find(it.key());
+            if (other == rhs.trie.end() ||
+                    it.score() != _read(other.value())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator!=(const _self &rhs) const {
+        return !(*this == rhs);
+    }
+
+  private:
+    hat_trie_type trie;
+
+    /**
+     * Reads a score from the unaligned value bytes of a string.
+     */
+    static score_type _read(const char *value) {
+        score_type result;
+        memcpy(&result, value, sizeof(score_type));
+        return result;
+    }
+
+    /**
+     * Copies hat trie traits, turning on subtree maxima.
+     */
+    static hat_trie_traits _scored_traits(hat_trie_traits traits) {
+        traits.scored = true;
+        return traits;
+    }
+
+    /**
+     * Copies array hash traits, sizing their values for a score.
+     */
+    static array_hash_traits _value_traits(array_hash_traits ah_traits) {
+        ah_traits.value_size = sizeof(score_type);
+        return ah_traits;
+    }
+
+};
+
+/**
+ * Swaps the data in two hat_scored_maps.
+ *
+ * @param lhs, rhs  hat_scored_map objects to swap
+ */
+inline void swap(hat_scored_map<std::string> &lhs,
+                 hat_scored_map<std::string> &rhs) {
+    lhs.swap(rhs);
+}
+
+}  // namespace stx
+
+#endif  // HAT_SCORED_MAP_H
@@ -31,6 +31,12 @@ template <class T> class hat_set;
 /**
  * @brief HAT-trie based set that implements most of the STL set interface
  *
+ * Like the STL containers, a set may be read from several threads at
+ * once as long as none of them modifies it. Ordered queries sort a
+ * container the first time they reach it, and in C++11 builds that
+ * sort is done under a lock. Before C++11 ordered queries on a shared
+ * set are not thread-safe.
+ *
  * Note: the only available template parameter is std::string. Using
  * any other template parameter will result in a compile-time error.
  */
@@ -49,6 +55,9 @@ class hat_set<std::string> {
 
     typedef hat_trie_type::iterator          iterator;
     typedef hat_trie_type::const_iterator    const_iterator;
+    typedef hat_trie_type::reverse_iterator  reverse_iterator;
+    typedef hat_trie_type::const_reverse_iterator const_reverse_iterator;
+    typedef hat_trie_type::cursor            cursor;
 
     /**
      * Default constructor.
@@ -167,24 +176,16 @@ class hat_set<std::string> {
      * Inserts a word into the trie.
      *
      * According to the standard, this function should return a
-     * pair<iterator, bool> rather than just a bool. The lack of a
-     * pair returning insert function is intentional because a pair
-     * returning insert takes twice as long as the bool version
-     * implemented now. The slowdown is significant enough to make
-     * insertion time comparable to an STL set (red-black tree), whuch
-     * is unacceptable for a high-performance data structure like a
-     * HAT-trie. Calling insert() then find() is the intended solution.
-     *
-     * I consider this acceptable because iterators are unstable. Like
-     * STL iterators, HAT-trie iterators are invalidated on any call to
-     * insert or erase because memory may be rearranged by a burst
-     * operation. Additionally, in a typical scenario, keys aren't operated
-     * on as they are inserted. Insertion and operation occur in two
-     * different passes, meaning any iterators collected during the
-     * insertion pass would be invalidated by the start of the operation
-     * pass anyway.
-     *
-     * Feel free to notify me if you disagree.
+     * pair<iterator, bool> rather than just a bool. The bool version
+     * came first because building the iterator used to mean a second
+     * descent with find(), which made insertion about as slow as an STL
+     * set. emplace() is the pair returning version. It assembles the
+     * iterator from the position the insertion found, so use it when
+     * the iterator is needed and this function when it isn't.
+     *
+     * Like STL iterators, HAT-trie iterators are invalidated on any call
+     * to insert or erase because memory may be rearranged by a burst
+     * operation.
      *
      * O(m)  m = length of the string
      *
@@ -248,6 +249,26 @@ class hat_set<std::string> {
         return trie.insert(pos, word);
     }
 
+    /**
+     * Inserts a word into the trie and gets an iterator to it.
+     *
+     * @code
+     * pair<hat_set<string>::iterator, bool> result = set.emplace(word);
+     * if (result.second) {
+     *     // word is new. result.first points to it.
+     * }
+     * @endcode
+     *
+     * O(m)  m = length of the string
+     *
+     * @param word  word to insert
+     * @return  pair of an iterator to @a word and true if it was
+     *          inserted, false if it was already in the trie
+     */
+    std::pair<iterator, bool> emplace(const value_type &word) {
+        return trie.emplace(word);
+    }
+
     /**
      * Erases a word from the trie.
      *
@@ -280,6 +301,23 @@ class hat_set<std::string> {
         return trie.begin();
     }
 
+    /**
+     * Gets an iterator to the lexicographically least element in the
+     * trie. Incrementing it visits the elements in sorted order.
+     *
+     * Each container sorts its elements the first time an ordered
+     * iterator enters it and keeps the sorted index until it is
+     * modified, so repeated ordered traversals of an unchanged trie only
+     * pay for the sort once.
+     *
+     * O(1) plus the cost of sorting each container as it is entered
+     *
+     * @return  ordered iterator to the first element in the trie
+     */
+    iterator ordered_begin() const {
+        return trie.ordered_begin();
+    }
+
     /**
      * Gets an iterator to one past the last element in the trie.
      *
@@ -291,6 +329,36 @@ class hat_set<std::string> {
         return trie.end();
     }
 
+    /**
+     * Gets a reverse iterator to the lexicographically greatest element
+     * in the trie. Incrementing it visits the elements in reverse sorted
+     * order.
+     *
+     * @code
+     * // the last ten words before "m"
+     * hat_set<string>::reverse_iterator it(trie.lower_bound("m"));
+     * for (int i = 0; i < 10 && it != trie.rend(); ++i, ++it) { ... }
+     * @endcode
+     *
+     * O(1) plus the cost of sorting each container as it is entered
+     *
+     * @return  reverse iterator to the greatest element in the trie
+     */
+    reverse_iterator rbegin() const {
+        return trie.rbegin();
+    }
+
+    /**
+     * Gets a reverse iterator to one past the least element in the trie.
+     *
+     * O(1)
+     *
+     * @return  reverse iterator to the end of a reverse traversal
+     */
+    reverse_iterator rend() const {
+        return trie.rend();
+    }
+
     /**
      * Searches for @a word in the trie.
      *
@@ -304,6 +372,326 @@ class hat_set<std::string> {
         return trie.find(word);
     }
 
+    /**
+     * Finds the first element that is not less than @a word.
+     *
+     * O(m + log b)  m = length of the string, b = size of the container
+     * the search ends in (plus sorting that container if it has changed
+     * since it was last sorted)
+     *
+     * @param word  word to search for
+     * @return  ordered iterator to the first element >= @a word, or
+     *          @a end() if there is none
+     */
+    iterator lower_bound(const key_type &word) const {
+        return trie.lower_bound(word);
+    }
+
+    /**
+     * Finds the first element that is greater than @a word.
+     *
+     * O(m + log b)  m = length of the string, b = size of the container
+     * the search ends in
+     *
+     * @param word  word to search for
+     * @return  ordered iterator to the first element > @a word, or
+     *          @a end() if there is none
+     */
+    iterator upper_bound(const key_type &word) const {
+        return trie.upper_bound(word);
+    }
+
+    /**
+     * Finds the range of elements equal to @a word.
+     *
+     * O(m + log b)  m = length of the string, b = size of the container
+     * the search ends in
+     *
+     * @param word  word to search for
+     * @return  pair of lower_bound(word) and upper_bound(word)
+     */
+    std::pair<iterator, iterator> equal_range(const key_type &word) const {
+        return trie.equal_range(word);
+    }
+
+    /**
+     * Finds the range of words that start with @a prefix.
+     *
+     * This function is an extension to the standard STL interface.
+     * Nothing is copied: the returned iterators walk the trie in place,
+     * visiting the matching words in sorted order.
+     *
+     * @code
+     * pair<hat_set<string>::iterator, hat_set<string>::iterator> range =
+     *     trie.prefix_range("user:");
+     * for (; range.first != range.second; ++range.first) { ... }
+     * @endcode
+     *
+     * O(m + log b)  m = length of the prefix, b = size of the container
+     * the search ends in
+     *
+     * @param prefix  prefix to search for
+     * @return  pair of iterators [first, last) spanning every word that
+     *          has @a prefix as a prefix
+     */
+    std::pair<iterator, iterator> prefix_range(const key_type &prefix) const {
+        return trie.prefix_range(prefix);
+    }
+
+    /**
+     * Calls @a f on every word in the trie, in the same order as
+     * begin().
+     *
+     * This function is an extension to the standard STL interface. It is
+     * faster than iterating because it walks the trie depth-first
+     * without keeping iterator state, building each word in one reused
+     * buffer.
+     *
+     * @code
+     * struct counter {
+     *     size_t bytes;
+     *     void operator()(const char *key, size_t length) { bytes += length; }
+     * };
+     * counter c = { 0 };
+     * c = trie.for_each(c);
+     * @endcode
+     *
+     * O(n)  n = number of nodes and words in the trie
+     *
+     * @param f  functor called as f(const char *key, size_t length). The
+     *           key is only valid for the duration of the call
+     * @return  @a f
+     */
+    template <class F>
+    F for_each(F f) const {
+        return trie.for_each(f);
+    }
+
+    /**
+     * Calls a copy of @a f on every word in the trie, using several
+     * threads.
+     *
+     * This function is an extension to the standard STL interface. The
+     * trie is cut into partitions that each cover a contiguous range of
+     * words, and each partition is visited by its own copy of @a f. Idle
+     * threads steal partitions from busy ones. Functors never run on two
+     * threads at once, so they don't need locking, but separate
+     * partitions run concurrently.
+     *
+     * @code
+     * // sorted export on four threads
+     * vector<collector> parts = trie.parallel_for_each(collector(), 4, true);
+     * for (size_t i = 0; i < parts.size(); ++i) { write(parts[i].keys); }
+     * @endcode
+     *
+     * O(n / t)  n = number of nodes and words in the trie, t = threads
+     *
+     * @param f        functor called as f(const char *key, size_t length)
+     * @param threads  number of threads to use, including the caller
+     * @param ordered  true to visit each partition in sorted order
+     * @return  the functor used for each partition, in key order
+     */
+    template <class F>
+    std::vector<F> parallel_for_each(F f, unsigned threads,
+                                     bool ordered = false) const {
+        return trie.parallel_for_each(f, threads, ordered);
+    }
+
+    /**
+     * Calls @a f on every word in the trie that starts with @a prefix.
+     *
+     * See for_each().
+     *
+     * O(m + log b + k)  m = length of the prefix, b = size of the
+     * container the prefix ends in, k = number of words visited
+     *
+     * @param prefix  prefix to search for
+     * @param f  functor called as f(const char *key, size_t length)
+     * @return  @a f
+     */
+    template <class F>
+    F for_each_prefix(const key_type &prefix, F f) const {
+        return trie.for_each_prefix(prefix, f);
+    }
+
+    /**
+     * Finds the longest word in the trie that is a prefix of @a query.
+     *
+     * This function is an extension to the standard STL interface. It
+     * is the lookup behind routing tables and URL classification rules.
+     *
+     * @code
+     * hat_set<string>::iterator rule = rules.longest_prefix(url);
+     * if (rule != rules.end()) { apply(*rule); }
+     * @endcode
+     *
+     * O(m)  m = length of @a query
+     *
+     * @param query  string to match
+     * @return  iterator to the longest word that is a prefix of
+     *          @a query, or @a end() if there is none
+     */
+    iterator longest_prefix(const key_type &query) const {
+        return trie.longest_prefix(query);
+    }
+
+    /**
+     * Calls @a f on every word in the trie that is a prefix of @a query,
+     * shortest first.
+     *
+     * This function is an extension to the standard STL interface, for
+     * dictionary-based segmentation and n-gram matching.
+     *
+     * @code
+     * struct match {
+     *     void operator()(const char *key, size_t length) { ... }
+     * };
+     * dictionary.prefixes_of(text.substr(pos, 32), match());
+     * @endcode
+     *
+     * O(m)  m = length of @a query
+     *
+     * @param query  string to match
+     * @param f      functor called as f(const char *key, size_t length),
+     *               where @a key points at the start of @a query
+     * @return  @a f
+     */
+    template <class F>
+    F prefixes_of(const key_type &query, F f) const {
+        return trie.prefixes_of(query, f);
+    }
+
+    /**
+     * Calls a functor on every word within edit distance @a k of
+     * @a query, in sorted order. Subtrees that can't come within @a k
+     * edits are skipped.
+     *
+     * @code
+     * struct suggestions {
+     *     vector<string> *words;
+     *     void operator()(const char *key, size_t length, size_t) {
+     *         words->push_back(string(key, length));
+     *     }
+     * };
+     *
+     * vector<string> words;
+     * suggestions s = { &words };
+     * dictionary.fuzzy_search("recieve", 2, s);
+     * @endcode
+     *
+     * @param query  string to match
+     * @param k      largest edit distance to report
+     * @param f      functor called as
+     *               f(const char *key, size_t length, size_t distance)
+     * @return  @a f
+     */
+    template <class F>
+    F fuzzy_search(const key_type &query, size_t k, F f) const {
+        return trie.fuzzy_search(query, k, f);
+    }
+
+    /**
+     * Calls a functor on every word that matches a glob pattern.
+     *
+     * The pattern may use @c ? for any character, @c * for any sequence,
+     * @c [a-z] and @c [!a-z] classes and @c \ escapes. Literal parts of
+     * the pattern descend the trie directly, so a pattern with a literal
+     * prefix only visits the subtree under it.
+     *
+     * @code
+     * for_each_word f;
+     * dictionary.match_pattern("th?[nr]*", f);
+     * @endcode
+     *
+     * @param pattern  glob pattern to match
+     * @param f        functor called as f(const char *key, size_t length)
+     * @return  @a f
+     */
+    template <class F>
+    F match_pattern(const key_type &pattern, F f) const {
+        return trie.match_pattern(pattern, f);
+    }
+
+    /**
+     * Gets a cursor positioned at the root of the trie.
+     *
+     * This function is an extension to the standard STL interface. A
+     * cursor consumes a prefix one character at a time and reports after
+     * each character whether the prefix is a word and whether any longer
+     * word starts with it, without searching from the root again.
+     *
+     * @code
+     * hat_set<string>::cursor c = trie.make_cursor();
+     * for (const char *p = text; *p && c.advance(*p); ++p) {
+     *     if (c.is_word()) { ... }
+     * }
+     * @endcode
+     *
+     * Each step is O(1) on a node and O(log b) inside a container, where
+     * b is the size of the container (plus sorting the container when
+     * the cursor first enters it, if it has changed since it was last
+     * sorted)
+     *
+     * @return  cursor over the empty prefix
+     */
+    cursor make_cursor() const {
+        return trie.make_cursor();
+    }
+
+    /**
+     * Replaces the contents of this set with the words that are in
+     * either of two sets.
+     *
+     * This function is an extension to the standard STL interface. The
+     * two tries are walked together node by node, and a subtree that
+     * only one side has is copied without looking at its words. See
+     * hat_trie::set_union(). Either argument may be this set.
+     *
+     * @param lhs, rhs  sets to combine. The result uses the traits of
+     *                  @a lhs
+     * @throw std::invalid_argument  if the sets' array hash traits
+     *                               differ
+     */
+    void set_union(const _self &lhs, const _self &rhs) {
+        trie.set_union(lhs.trie, rhs.trie);
+    }
+
+    /**
+     * Replaces the contents of this set with the words that are in both
+     * of two sets. A subtree that only one side has is skipped. See
+     * hat_trie::set_intersection().
+     *
+     * @param lhs, rhs  sets to intersect
+     */
+    void set_intersection(const _self &lhs, const _self &rhs) {
+        trie.set_intersection(lhs.trie, rhs.trie);
+    }
+
+    /**
+     * Replaces the contents of this set with the words of @a lhs that
+     * are not in @a rhs. See hat_trie::set_difference().
+     *
+     * @param lhs  set to take words from
+     * @param rhs  set of words to leave out
+     */
+    void set_difference(const _self &lhs, const _self &rhs) {
+        trie.set_difference(lhs.trie, rhs.trie);
+    }
+
+    /**
+     * Calls @a f on every word that is in exactly one of this set and
+     * @a rhs. See hat_trie::diff().
+     *
+     * @param rhs  set to compare with
+     * @param f    functor called as f(const char *key, size_t length,
+     *             bool in_lhs)
+     * @return  @a f
+     */
+    template <class F>
+    F diff(const _self &rhs, F f) const {
+        return trie.diff(rhs.trie, f);
+    }
+
     /**
      * Swaps the data in two hat_set objects.
      *
@@ -347,8 +735,8 @@ class hat_set<std::string> {
      *
      * @param out  output stream to print to. cout by default
      */
-    void print() {
-        trie.print();
+    void print(std::ostream &out = std::cout) const {
+        trie.print(out);
     }
 
     bool operator<(const hat_set<std::string>& rhs) {
@@ -380,6 +768,51 @@ class hat_set<std::string> {
 
 };
 
+/**
+ * Builds the union of two hat_sets.
+ *
+ * @code
+ * hat_set<string> both = set_union(yesterday, today);
+ * @endcode
+ *
+ * @param lhs, rhs  sets to combine
+ * @return  set of the words in either set, with the traits of @a lhs
+ */
+inline hat_set<std::string> set_union(const hat_set<std::string> &lhs,
+                                      const hat_set<std::string> &rhs) {
+    hat_set<std::string> result(lhs.traits(), lhs.hash_traits());
+    result.set_union(lhs, rhs);
+    return result;
+}
+
+/**
+ * Builds the intersection of two hat_sets.
+ *
+ * @param lhs, rhs  sets to intersect
+ * @return  set of the words in both sets, with the traits of @a lhs
+ */
+inline hat_set<std::string> set_intersection(
+        const hat_set<std::string> &lhs, const hat_set<std::string> &rhs) {
+    hat_set<std::string> result(lhs.traits(), lhs.hash_traits());
+    result.set_intersection(lhs, rhs);
+    return result;
+}
+
+/**
+ * Builds the difference of two hat_sets.
+ *
+ * @param lhs  set to take words from
+ * @param rhs  set of words to leave out
+ * @return  set of the words of @a lhs that are not in @a rhs, with the
+ *          traits of @a lhs
+ */
+inline hat_set<std::string> set_difference(
+        const hat_set<std::string> &lhs, const hat_set<std::string> &rhs) {
+    hat_set<std::string> result(lhs.traits(), lhs.hash_traits());
+    result.set_difference(lhs, rhs);
+    return result;
+}
+
 }  // namespace stx
 
 namespace std {
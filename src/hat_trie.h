@@ -36,7 +36,7 @@
 //    * size_type count(const key_type &) const
 //    * bool empty() const
 //    * iterator end()
-//      pair<iterator, iterator> equal_range(const key_type &) const
+//    * pair<iterator, iterator> equal_range(const key_type &) const
 //    * void erase(iterator)
 //    * void erase(const key_type &)
 //    * void erase(iterator, iterator)
@@ -46,19 +46,36 @@
 //    * iterator insert(iterator, const value_type &)
 //    * void insert(input_iterator first, input_iterator last)
 //    * key_compare key_comp() const
-//      iterator lower_bound(const key_type &) const
+//    * iterator lower_bound(const key_type &) const
 //      size_type max_size() const
 //      self_reference operator=(self)
-//      reverse_iterator rbegin()
-//      reverse_iterator rend()
+//    * reverse_iterator rbegin()
+//    * reverse_iterator rend()
 //    * size_type size() const
 //    * void swap(self &)
-//      iterator upper_bound(const key_type &) const
+//    * iterator upper_bound(const key_type &) const
 //    * value_compare value_comp() const
 //
 //   additions:
 //    * bool exists() const
-//      hat_trie prefix_match(const key_type &) const
+//    * pair<iterator, iterator> prefix_range(const key_type &) const
+//    * F for_each(F) const
+//    * F for_each_prefix(const key_type &, F) const
+//    * vector<F> parallel_for_each(F, unsigned, bool) const
+//    * cursor make_cursor() const
+//    * iterator longest_prefix(const key_type &) const
+//    * F prefixes_of(const key_type &, F) const
+//    * pair<iterator, bool> emplace(const key_type &)
+//    * char *find_or_insert(const char *, bool &)
+//    * void resize_values(int, F)
+//    * F fuzzy_search(const key_type &, size_t, F) const
+//    * F match_pattern(const key_type &, F) const
+//    * bool set_score(const char *, score_type)
+//    * vector<pair<key_type, score_type> > top_k(const key_type &, size_t) const
+//    * void set_union(const self &, const self &)
+//    * void set_intersection(const self &, const self &)
+//    * void set_difference(const self &, const self &)
+//    * F diff(const self &, F) const
 
 #ifndef HAT_TRIE_H
 #define HAT_TRIE_H
@@ -66,16 +83,36 @@
 #include <iostream>  // for std::ostream
 #include <string>
 #include <bitset>
+#include <vector>
+#include <cmath>  // for HUGE_VAL
+#include <new>
+#include <stdexcept>
+
+#if __cplusplus >= 201103L
+#include <deque>
+#include <mutex>
+#include <thread>
+#endif
 
 #include "array_hash.h"
 
 namespace stx {
 
-/// number of distinct characters a hat trie can store
-const int HT_ALPHABET_SIZE = 128;
+/// number of distinct characters a hat trie can store. Keys may use every
+/// byte value except '\0', which terminates them
+const int HT_ALPHABET_SIZE = 256;
+
+/// number of children in each block of a node's children array
+const int HT_BLOCK_SIZE = 16;
+
+/// number of blocks in a node's children array
+const int HT_BLOCK_COUNT = HT_ALPHABET_SIZE / HT_BLOCK_SIZE;
 
 typedef array_hash<std::string> bucket;
 
+/// maximum score of a subtree that holds no words, in a scored trie
+const double HT_NO_SCORE = -HUGE_VAL;
+
 /**
  * @brief Provides a way to tune the performance characteristics of a HAT-trie.
  *
@@ -91,8 +128,15 @@ typedef array_hash<std::string> bucket;
 class hat_trie_traits {
 
   public:
-    hat_trie_traits(size_t burst_threshold = 16384) {
+    hat_trie_traits(size_t burst_threshold = 16384, size_t burst_bytes = 0,
+                    size_t burst_scan_length = 0,
+                    size_t merge_threshold = 0) {
         this->burst_threshold = burst_threshold;
+        this->burst_bytes = burst_bytes;
+        this->burst_scan_length = burst_scan_length;
+        this->merge_threshold = merge_threshold;
+        this->scored = false;
+        this->digests = false;
     }
 
     /**
@@ -105,12 +149,96 @@ class hat_trie_traits {
      * Default 16384. Must be >= 0 and <= 32,768.
      */
     size_t burst_threshold;
+
+    /**
+     * A hat_trie container is also burst when the strings in it occupy
+     * more than this many bytes (see array_hash::bytes()). A key count
+     * treats a container of long URLs the same as a container of
+     * two-letter suffixes, although the URLs take many times longer to
+     * scan and many more cache lines to hold. A byte budget bursts the
+     * first one much sooner.
+     *
+     * Set this value to 0 to burst on key count alone.
+     *
+     * Default 0.
+     */
+    size_t burst_bytes;
+
+    /**
+     * A hat_trie container is also burst when it has grown to its
+     * maximum slot count and holds more than this many strings per slot
+     * on average, i.e. when an average lookup has to scan more than this
+     * many strings.
+     *
+     * Set this value to 0 to ignore slot scan length.
+     *
+     * Default 0.
+     */
+    size_t burst_scan_length;
+
+    /**
+     * When an erase leaves a burst subtree holding this many words or
+     * fewer, the subtree is merged back into a single container (the
+     * reverse of a burst). Without merging, a subtree that shrinks from
+     * 100k words to 50 keeps all of its nodes and near-empty containers
+     * until the trie is destroyed.
+     *
+     * Keep this value well below burst_threshold (burst_threshold / 4
+     * is a good start) so that words churning around the threshold don't
+     * make a subtree burst and merge over and over. Merging is disabled
+     * unless this value is less than burst_threshold. For the same
+     * reason, a subtree is only merged if the container would use at
+     * most half of burst_bytes and hold at most half the strings that
+     * burst_scan_length allows in a full-size container, when those
+     * policies are on.
+     *
+     * Set this value to 0 to never merge.
+     *
+     * Default 0.
+     */
+    size_t merge_threshold;
+
+    /**
+     * In a scored trie, the first bytes of every value hold a double
+     * score, and every node and container keeps the greatest score in
+     * its subtree up to date through inserts, erases, bursts and merges.
+     * top_k() uses these maxima to search only the subtrees that can
+     * still hold one of the best words. hat_scored_map turns this on.
+     *
+     * Scores must only be changed with set_score(), and the values of a
+     * scored trie can't be resized.
+     *
+     * The maxima live in a summary allocated right after each node and
+     * container of a scored trie, so they add 16 bytes (the summary also
+     * holds a digest, see @a digests) per node and container there and
+     * nothing to other tries.
+     *
+     * Default false.
+     */
+    bool scored;
+
+    /**
+     * With digests on, every node and container keeps a 64-bit digest
+     * of the words in its subtree: the sum of a hash of each word. The
+     * sum doesn't depend on how the words are laid out, so two tries
+     * with digests hold the same words iff (barring a hash collision)
+     * their roots have the same digest and size. operator== then costs
+     * O(1), and diff() skips every subtree whose digests match. Keeping
+     * the digests up to date costs one hash of the word per insert and
+     * erase, and one hash per word moved by a burst.
+     * The digests live in the same summary as the maxima of a scored
+     * trie (see @a scored), which adds 16 bytes per node and container of
+     * a trie with either option on.
+     *
+     * Default false.
+     */
+    bool digests;
 };
 
 /// Gets a reference to the string in the parameter
 template <class T> const std::string &ref(const T &t);
 
-const std::string &ref(const std::string &s) {
+inline const std::string &ref(const std::string &s) {
     return s;
 }
 
@@ -129,10 +257,75 @@ union child_ptr {
     htnode *node;
 };
 
+// valid values for an htnode_ptr
+enum { NODE_POINTER = 0, BUCKET_POINTER = 1 };
+
+// Bookkeeping about a subtree that only some tries keep. It is allocated
+// right after a node or container when the trie is scored or keeps
+// digests (see hat_trie_traits), so plain tries don't pay for it.
+struct htsummary {
+    htsummary() : max_score(HT_NO_SCORE), digest(0) { }
+
+    double max_score;  // greatest score in the subtree, if scored
+    uint64_t digest;   // sum of the hashes of the words in the subtree
+};
+
+/**
+ * Allocates a node or container, followed by an htsummary if @a summary
+ * is true.
+ *
+ * @param size     size of the node or container
+ * @param summary  whether to allocate and initialize the summary
+ */
+inline void *ht_allocate(size_t size, bool summary) {
+    if (summary == false) {
+        return ::operator new(size);
+    }
+    char *p = (char *) ::operator new(size + sizeof(htsummary));
+    new (p + size) htsummary();
+    return p;
+}
+
 // Stores information required by each hat trie node
+//
+// The children array is split on the high nibble of the character into
+// blocks of HT_BLOCK_SIZE pointers that are only allocated once a child
+// is stored in them. Keys tend to draw from a few ranges of the byte
+// alphabet (lowercase ASCII spans two blocks), so a node can hold all 256
+// byte values and still be smaller than a flat array of 128 pointers.
 struct htnode {
-    htnode(char ch = '\0') : ch(ch), parent(NULL) {
-        memset(children, NULL, sizeof(child_ptr) * HT_ALPHABET_SIZE);
+    htnode(char ch = '\0') :
+            ch(ch), child_count(0), parent(NULL), size(0), value(NULL) {
+        memset(blocks, 0, sizeof(blocks));
+    }
+
+    // Nodes are allocated with new (summary) htnode(...), see ht_allocate
+    static void *operator new(size_t size, bool summary) {
+        return ht_allocate(size, summary);
+    }
+
+    static void operator delete(void *p, bool) {
+        ::operator delete(p);
+    }
+
+    static void operator delete(void *p) {
+        ::operator delete(p);
+    }
+
+    // Gets the summary after a node allocated with one
+    htsummary &summary() {
+        return *(htsummary *) (this + 1);
+    }
+
+    const htsummary &summary() const {
+        return *(const htsummary *) (this + 1);
+    }
+
+    ~htnode() {
+        for (int i = 0; i < HT_BLOCK_COUNT; ++i) {
+            delete[] blocks[i];
+        }
+        delete[] value;
     }
 
     /// Getter for the word field
@@ -141,10 +334,99 @@ struct htnode {
     /// Setter for the word field
     void set_word(bool b) { types[HT_ALPHABET_SIZE] = b; }
 
+    /// Gets the child under character @a c, or a NULL child_ptr
+    child_ptr child(unsigned char c) const {
+        child_ptr *block = blocks[c / HT_BLOCK_SIZE];
+        if (block) {
+            return block[c % HT_BLOCK_SIZE];
+        }
+        child_ptr result;
+        result.node = NULL;
+        return result;
+    }
+
+    /// Stores a node or container of type @a type under character @a c
+    void set_child(unsigned char c, child_ptr p, uint8_t type) {
+        child_ptr *&block = blocks[c / HT_BLOCK_SIZE];
+        if (block == NULL) {
+            block = new child_ptr[HT_BLOCK_SIZE];
+            memset(block, 0, sizeof(child_ptr) * HT_BLOCK_SIZE);
+        }
+        if (block[c % HT_BLOCK_SIZE].node == NULL) {
+            ++child_count;
+        }
+        block[c % HT_BLOCK_SIZE] = p;
+        types[c] = type;
+    }
+
+    /// Removes the child under character @a c
+    void clear_child(unsigned char c) {
+        child_ptr *&block = blocks[c / HT_BLOCK_SIZE];
+        block[c % HT_BLOCK_SIZE].node = NULL;
+        --child_count;
+
+        // Give the block back once it's empty.
+        for (int i = 0; i < HT_BLOCK_SIZE; ++i) {
+            if (block[i].node) {
+                return;
+            }
+        }
+        delete[] block;
+        block = NULL;
+    }
+
+    /**
+     * Finds the first character >= @a pos that has a child.
+     *
+     * @return  the character, or HT_ALPHABET_SIZE if there is none
+     */
+    int next_child(int pos) const {
+        while (pos < HT_ALPHABET_SIZE) {
+            child_ptr *block = blocks[pos / HT_BLOCK_SIZE];
+            if (block == NULL) {
+                // Skip the whole block.
+                pos = (pos / HT_BLOCK_SIZE + 1) * HT_BLOCK_SIZE;
+            } else if (block[pos % HT_BLOCK_SIZE].node) {
+                return pos;
+            } else {
+                ++pos;
+            }
+        }
+        return HT_ALPHABET_SIZE;
+    }
+
+    /**
+     * Finds the last character <= @a pos that has a child.
+     *
+     * @return  the character, or -1 if there is none
+     */
+    int prev_child(int pos) const {
+        while (pos >= 0) {
+            child_ptr *block = blocks[pos / HT_BLOCK_SIZE];
+            if (block == NULL) {
+                // Skip the whole block.
+                pos = pos / HT_BLOCK_SIZE * HT_BLOCK_SIZE - 1;
+            } else if (block[pos % HT_BLOCK_SIZE].node) {
+                return pos;
+            } else {
+                --pos;
+            }
+        }
+        return -1;
+    }
+
     char ch;
+    uint16_t child_count;  // number of non-NULL entries in children
     htnode *parent;
+    size_t size;  // number of words in this node's subtree
     std::bitset<HT_ALPHABET_SIZE + 1> types;  // +1 is an end of word flag
-    child_ptr children[HT_ALPHABET_SIZE];  // pointers to children
+    child_ptr *blocks[HT_BLOCK_COUNT];  // pointers to children
+    char *value;  // value of the word on this node in a hat_map
+
+  private:
+    // nodes own their blocks, so they can't be copied
+    htnode(const htnode &);
+    htnode &operator=(const htnode &);
 };
 
 // Stores information required by each array hash node
@@ -153,18 +435,43 @@ struct ahnode {
     char ch;
     bool word;
     htnode *parent;
+    char *value;  // value of the word on this container in a hat_map
 
-    ahnode() : table(NULL), ch('\0'), word(false), parent(NULL) { }
-};
+    ahnode() : table(NULL), ch('\0'), word(false), parent(NULL),
+            value(NULL) { }
 
-// valid values for an htnode_ptr
-enum { NODE_POINTER = 0, BUCKET_POINTER = 1 };
+    ~ahnode() {
+        delete[] value;
+    }
+
+    // Containers are allocated like nodes, see htnode::operator new
+    static void *operator new(size_t size, bool summary) {
+        return ht_allocate(size, summary);
+    }
+
+    static void operator delete(void *p, bool) {
+        ::operator delete(p);
+    }
+
+    static void operator delete(void *p) {
+        ::operator delete(p);
+    }
+
+    // Gets the summary after a container allocated with one
+    htsummary &summary() {
+        return *(htsummary *) (this + 1);
+    }
+
+    const htsummary &summary() const {
+        return *(const htsummary *) (this + 1);
+    }
+};
 
 struct htnode_ptr {
     child_ptr ptr;  // pointer to a node in the trie
     uint8_t type;   // type of the pointer
 
-    htnode_ptr() { ptr.node = NULL; }
+    htnode_ptr() : type(NODE_POINTER) { ptr.node = NULL; }
 
     htnode_ptr(child_ptr ptr, uint8_t type) : ptr(ptr), type(type) { }
 
@@ -201,6 +508,23 @@ struct htnode_ptr {
     htnode *parent() {
         return type == NODE_POINTER ? ptr.node->parent : ptr.bucket->parent;
     }
+
+    // Gets the value of the word on this node or container
+    char *&value() {
+        return type == NODE_POINTER ? ptr.node->value : ptr.bucket->value;
+    }
+
+    // Gets the greatest score under this node or container
+    double &max_score() {
+        return type == NODE_POINTER ? ptr.node->summary().max_score :
+                                      ptr.bucket->summary().max_score;
+    }
+
+    // Gets the digest of the words under this node or container
+    uint64_t &digest() {
+        return type == NODE_POINTER ? ptr.node->summary().digest :
+                                      ptr.bucket->summary().digest;
+    }
 };
 
 template <class T>
@@ -208,6 +532,11 @@ class hat_trie;
 
 /// Trie-based data structure for managing sorted strings. Don't use this
 /// class directly. Use hat_set or hat_map
+///
+/// Const member functions may run on several threads at once. Ordered
+/// queries (ordered_begin, lower_bound, prefix_range, cursors, top_k and
+/// the like) cache a sorted index in each container they reach, which
+/// C++11 builds guard with a lock. Before C++11 they are not thread-safe.
 template <>
 class hat_trie<std::string> {
 
@@ -217,9 +546,13 @@ class hat_trie<std::string> {
     typedef std::string      key_type;
     typedef std::string      value_type;
     typedef std::less<char>  key_compare;
+    typedef double           score_type;
 
     class iterator;
+    class cursor;
     typedef iterator const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef reverse_iterator const_reverse_iterator;
 
     /**
      * Default constructor.
@@ -252,11 +585,36 @@ class hat_trie<std::string> {
         insert(first, last);
     }
 
+    /**
+     * Copy constructor.
+     */
+    hat_trie(const hat_trie &rhs) :
+            _traits(rhs._traits), _ah_traits(rhs._ah_traits),
+            _root(_clone(rhs._root, NULL, rhs._ah_traits.value_size,
+                         rhs._summarized(), rhs._summarized())),
+            _size(rhs._size) {
+    }
+
     virtual ~hat_trie() {
-        delete _root;
+        _delete(_root);
         _root = NULL;
     }
 
+    /**
+     * Assignment operator.
+     */
+    hat_trie &operator=(const hat_trie &rhs) {
+        if (this != &rhs) {
+            _delete(_root);
+            _traits = rhs._traits;
+            _ah_traits = rhs._ah_traits;
+            _root = _clone(rhs._root, NULL, _ah_traits.value_size,
+                           _summarized(), _summarized());
+            _size = rhs._size;
+        }
+        return *this;
+    }
+
     /**
      * Searches for a word in the trie.
      *
@@ -367,7 +725,7 @@ class hat_trie<std::string> {
      * Removes all the elements in the trie.
      */
     void clear() {
-        delete _root;
+        _delete(_root);
         _init();
     }
 
@@ -375,24 +733,16 @@ class hat_trie<std::string> {
      * Inserts a word into the trie.
      *
      * According to the standard, this function should return a
-     * pair<iterator, bool> rather than just a bool. The lack of a
-     * pair returning insert function is intentional because a pair
-     * returning insert takes twice as long as the bool version
-     * implemented now. The slowdown is significant enough to make
-     * insertion time comparable to an STL set (red-black tree), whuch
-     * is unacceptable for a high-performance data structure like a
-     * HAT-trie. Calling insert() then find() is the intended solution.
-     *
-     * I consider this acceptable because iterators are unstable. Like
-     * STL iterators, HAT-trie iterators are invalidated on any call to
-     * insert or erase because memory may be rearranged by a burst
-     * operation. Additionally, in a typical scenario, keys aren't operated
-     * on as they are inserted. Insertion and operation occur in two
-     * different passes, meaning any iterators collected during the
-     * insertion pass would be invalidated by the start of the operation
-     * pass anyway.
-     *
-     * Feel free to notify me if you disagree.
+     * pair<iterator, bool> rather than just a bool. The bool version
+     * came first because building the iterator used to mean a second
+     * descent with find(), which made insertion about as slow as an STL
+     * set. emplace() is the pair returning version. It assembles the
+     * iterator from the position the insertion found, so use it when
+     * the iterator is needed and this function when it isn't.
+     *
+     * Like STL iterators, HAT-trie iterators are invalidated on any call
+     * to insert or erase because memory may be rearranged by a burst
+     * operation.
      *
      * @param word  word to insert
      *
@@ -415,48 +765,98 @@ class hat_trie<std::string> {
      *          was already in the trie
      */
     bool insert(const char *word) {
-        const char *pos = word;
-        htnode_ptr n = _locate(pos);
-        if (*pos == '\0') {
-            // word was found in the trie's structure. Mark its location
-            // as the end of a word.
-            if (n.word() == false) {
-                n.set_word(true);
-                ++_size;
-                return true;
-            }
+        bool inserted;
+        _find_or_insert(word, inserted);
+        return inserted;
+    }
 
-            // word was already in the trie
-            return false;
+    /**
+     * Inserts a word into the trie and gets an iterator to it.
+     *
+     * This is the standard pair-returning insert. The iterator is
+     * assembled from the position insertion already found, so this
+     * costs about as much as the bool version. A burst during the insert
+     * is followed down from the new node rather than from the root.
+     *
+     * O(m)  m = length of the string
+     *
+     * @param key  word to insert
+     * @return  pair of an iterator to the word and true if it was
+     *          inserted, false if it was already in the trie
+     */
+    std::pair<iterator, bool> emplace(const key_type &key) {
+        const std::string &word = ref(key);
+        bool inserted;
+        _slot slot = _find_or_insert(word.c_str(), inserted);
+        return std::make_pair(_make_iterator(word.c_str(), slot), inserted);
+    }
 
-        } else {
-            // word was not found in the trie's structure. Either make a
-            // new bucket for it or insert it into an already
-            // existing bucket
-            ahnode *at = NULL;
-            if (n.type == NODE_POINTER) {
-                // Make a new bucket for word
-                htnode *p = n.ptr.node;
-                int index = *pos;
-
-                at = new ahnode();
-                at->table = new bucket(_ah_traits);
-                at->ch = index;
-                at->word = false;
-
-                // Insert the new bucket into the trie's structure
-                at->parent = p;
-                p->children[index].bucket = at;
-                p->types[index] = BUCKET_POINTER;
-                ++pos;
-            } else if (n.type == BUCKET_POINTER) {
-                // The container for s already exists.
-                at = n.ptr.bucket;
-            }
+    /**
+     * Finds a word in the trie, inserting it first if it isn't there.
+     *
+     * This function is the building block of hat_map. Its value bytes
+     * (array_hash_traits::value_size of them) are stored next to the
+     * word: after it in a container, or in a block owned by the node or
+     * container that marks it. A new word's value bytes are zero.
+     *
+     * @param word      word to find or insert
+     * @param inserted  set to true if @a word was inserted, false if it
+     *                  was already in the trie
+     * @return  pointer to the word's value bytes. They are not aligned.
+     *          Meaningless if the trie stores no values
+     */
+    char *find_or_insert(const char *word, bool &inserted) {
+        return _value(_find_or_insert(word, inserted));
+    }
 
-            // Insert the rest of word into the container.
-            return _insert(at, pos);
+    /**
+     * Sets the score of a word in a scored trie, inserting the word
+     * first if it isn't there (see hat_trie_traits::scored).
+     *
+     * Raising a score only raises the maxima on the path to the root.
+     * Lowering the greatest score of a container rescans the container,
+     * and each node above it rescans its children until a maximum stays
+     * the same.
+     *
+     * O(m)  m = length of the string, plus the rescans
+     *
+     * @param word   word to score
+     * @param score  new score of @a word
+     * @return  true if @a word was inserted, false if it was already in
+     *          the trie
+     */
+    bool set_score(const char *word, score_type score) {
+        bool inserted;
+        _slot slot = _find_or_insert(word, inserted, score);
+        if (inserted == false) {
+            char *value = _value(slot);
+            score_type old = _score(value);
+            memcpy(value, &score, sizeof(score_type));
+            if (score > old) {
+                _raise(slot.n, score);
+            } else {
+                _rescore(slot.n, old);
+            }
         }
+        return inserted;
+    }
+
+    /**
+     * Changes the size of the value stored with every word, converting
+     * each value with @a f. This lets hat_counter widen its counters in
+     * place, without rebuilding the trie.
+     *
+     * O(n)  n = bytes stored in the trie
+     *
+     * @param value_size  new value size. Both it and the current value
+     *                    size must be positive
+     * @param f           functor called as f(const char *from, char *to)
+     *                    for every value
+     */
+    template <class F>
+    void resize_values(int value_size, F f) {
+        _resize_values(_root, value_size, f);
+        _ah_traits.value_size = value_size;
     }
 
     /**
@@ -488,9 +888,7 @@ class hat_trie<std::string> {
      * @return  iterator to @a word in the trie
      */
     iterator insert(const iterator &, const key_type &key) {
-        const std::string &word = ref(key);
-        insert(word);
-        return find(word);
+        return emplace(key).first;
     }
 
     /**
@@ -500,37 +898,20 @@ class hat_trie<std::string> {
      *             that exists somewhere in the trie.
      */
     void erase(const iterator &pos) {
-        htnode *current = NULL;
-        if (pos._position.type == BUCKET_POINTER) {
-            ahnode *b = pos._position.ptr.bucket;
-            if (pos._word) {
-                b->word = false;
-            } else {
-                b->table->erase(pos._container_iterator);
-            }
-
-            if (b->table->size() == 0 && b->word == false) {
-                current = b->parent;
-                delete b->table;
-                delete b;
-
-                // Mark the container's slot in its parent's children
-                // array as NULL.
-                for (int i = 0; i < HT_ALPHABET_SIZE; ++i) {
-                    if (current->children[i].bucket == b) {
-                        current->children[i].bucket = NULL;
-                        break;
-                    }
-                }
-            }
-
+        score_type old = _traits.scored ? _score(pos.value()) : 0;
+        if (_traits.digests) {
+            _adjust_digest(pos._position,
+                           0 - _digest(_digest_state(), pos.key().c_str()));
+        }
+        if (pos._position.type == BUCKET_POINTER && pos._word == false) {
+            pos._position.ptr.bucket->table->erase(pos._container_iterator);
         } else {
-            current = pos._position.ptr.node;
-            current->set_word(false);
+            _clear_word(pos._position);
         }
-        --_size;
-
-        _erase_empty_nodes(current);
+        if (_traits.scored) {
+            _rescore(pos._position, old);
+        }
+        _erase_cleanup(pos._position);
     }
 
     /**
@@ -544,41 +925,45 @@ class hat_trie<std::string> {
     size_type erase(const key_type &key) {
         const char *ps = ref(key).c_str();
         htnode_ptr n = _locate(ps);
-        htnode *current = NULL;
-        int result = 0;
-
-        if (n.type == BUCKET_POINTER) {
-            // The word is either in a container or is represented by the
-            // container itself.
-            ahnode *b = n.ptr.bucket;
-            result = b->table->erase(ps);
-            if (result > 0 && b->table->size() == 0 && b->word == false) {
-                // Erase the container.
-                current = b->parent;
-                delete b->table;
-                delete b;
+        score_type old = 0;
 
-                // Mark the container's slot in its parent's children
-                // array as NULL.
-                for (int i = 0; i < HT_ALPHABET_SIZE; ++i) {
-                    if (current->children[i].bucket == b) {
-                        current->children[i].bucket = NULL;
-                        break;
-                    }
-                }
+        if (*ps == '\0') {
+            // The word is represented by a node or container in the
+            // trie's structure. Clear its word field.
+            if (n.word() == false) {
+                return 0;
+            }
+            if (_traits.scored) {
+                old = _score(n.value());
+            }
+            _clear_word(n);
+        } else if (n.type == BUCKET_POINTER && _traits.scored) {
+            // The word's score is needed before it goes.
+            bucket *table = n.ptr.bucket->table;
+            typename bucket::iterator it = table->find(ps);
+            if (it == table->end()) {
+                return 0;
+            }
+            old = _score(it.value());
+            table->erase(it);
+        } else if (n.type == BUCKET_POINTER) {
+            // The word may be in a container.
+            if (n.ptr.bucket->table->erase(ps) == 0) {
+                return 0;
             }
-
         } else {
-            // The word is represented by a node in the trie. Set the word
-            // field on the node to false.
-            current = n.ptr.node;
-            current->set_word(false);
-            result = 1;
+            // The word's path leaves the trie's structure.
+            return 0;
         }
 
-        _erase_empty_nodes(current);
-        _size -= result;
-        return result;
+        if (_traits.scored) {
+            _rescore(n, old);
+        }
+        if (_traits.digests) {
+            _adjust_digest(n, 0 - _digest(_digest_state(), ref(key).c_str()));
+        }
+        _erase_cleanup(n);
+        return 1;
     }
 
     /**
@@ -612,7 +997,29 @@ class hat_trie<std::string> {
         // Incrementally construct the iterator to return. This code
         // is pretty ugly. See the doc comment for the iterator class
         // for a description of why.
-        iterator result;
+        iterator result(_root, false);
+        result = _least(_root, result._cached_word);
+        return result;
+    }
+
+    /**
+     * Gets an iterator to the lexicographically least element in the
+     * trie. Incrementing the iterator visits the elements in sorted
+     * order.
+     *
+     * Nodes are always visited in order. An ordered iterator also visits
+     * the elements inside each container in order, using a sorted index
+     * the container builds when the iterator first enters it and caches
+     * until the container is modified.
+     *
+     * @return  ordered iterator to the first element in the trie
+     */
+    iterator ordered_begin() const {
+        if (size() == 0) {
+            return end();
+        }
+
+        iterator result(_root, true);
         result = _least(_root, result._cached_word);
         return result;
     }
@@ -620,10 +1027,33 @@ class hat_trie<std::string> {
     /**
      * Gets an iterator to one past the last element in the trie.
      *
+     * Decrementing this iterator visits the elements in reverse sorted
+     * order.
+     *
      * @return iterator to one past the last element in the trie
      */
     iterator end() const {
-        return iterator();
+        return iterator(_root, true);
+    }
+
+    /**
+     * Gets a reverse iterator to the lexicographically greatest element
+     * in the trie. Incrementing it visits the elements in reverse sorted
+     * order.
+     *
+     * @return  reverse iterator to the greatest element in the trie
+     */
+    reverse_iterator rbegin() const {
+        return reverse_iterator(end());
+    }
+
+    /**
+     * Gets a reverse iterator to one past the least element in the trie.
+     *
+     * @return  reverse iterator to the end of a reverse traversal
+     */
+    reverse_iterator rend() const {
+        return reverse_iterator(ordered_begin());
     }
 
     /**
@@ -638,7 +1068,7 @@ class hat_trie<std::string> {
         const char *ps = word.c_str();
         htnode_ptr n = _locate(ps);
 
-        iterator result;
+        iterator result(_root, false);
         if (*ps == '\0') {
             // The word is in the trie at the node returned by _locate
             if (n.word()) {
@@ -672,47 +1102,646 @@ class hat_trie<std::string> {
     }
 
     /**
-     * Swaps the data in two hat_trie objects.
+     * Finds the first element that is not less than @a key.
      *
-     * This function operates in constant time because all it needs to do
-     * is swap a few primitives.
+     * Descends the trie along @a key, then resolves the position inside
+     * the boundary container with a binary search of its sorted index.
      *
-     * @param rhs  hat_trie object to swap data with
+     * @param key  key to search for
+     * @return  ordered iterator to the first element >= @a key, or end()
+     *          if there is none
      */
-    void swap(hat_trie &rhs) {
-        using std::swap;
-        swap(_root, rhs._root);
-        swap(_size, rhs._size);
-        swap(_traits, rhs._traits);
+    iterator lower_bound(const key_type &key) const {
+        return _bound(ref(key).c_str(), false);
     }
 
     /**
-     * @brief Iterates over the elements in a HAT-trie
+     * Finds the first element that is greater than @a key.
      *
-     * A HAT-trie iterator has to maintain a lot of state to determine
-     * its current position. The code to construct iterators is pretty
-     * ugly, but they have to be constructed incrementally because of
-     * the large amount of state they maintain.
+     * @param key  key to search for
+     * @return  ordered iterator to the first element > @a key, or end()
+     *          if there is none
      */
-    class iterator : public std::iterator<std::bidirectional_iterator_tag,
-                                          const key_type> {
-        friend class hat_trie;
+    iterator upper_bound(const key_type &key) const {
+        return _bound(ref(key).c_str(), true);
+    }
 
-      public:
-        /**
-         * Default constructor.
-         */
-        iterator() { }
+    /**
+     * Finds the range of elements that are equal to @a key.
+     *
+     * @param key  key to search for
+     * @return  pair of lower_bound(key) and upper_bound(key). In a
+     *          distinct container the range is empty or holds one element
+     */
+    std::pair<iterator, iterator> equal_range(const key_type &key) const {
+        iterator first = lower_bound(key);
+        iterator last = first;
+        if (last != end() && *last == ref(key)) {
+            ++last;
+        }
+        return std::make_pair(first, last);
+    }
 
-        /**
-         * Moves the iterator forward.
-         *
-         * @return  self-reference
-         */
-        iterator &operator++() {
-            if (_position.type == BUCKET_POINTER) {
-                // If word is set, then this container represents a word as
-                // well as storing words. The first iteration into the
+    /**
+     * Finds the longest element that is a prefix of @a query.
+     *
+     * This function is an extension to the standard STL interface. It
+     * descends the trie along @a query once, remembering the deepest node
+     * that marks a word. If the descent reaches a container, the
+     * container is asked for its longest entry that is a prefix of the
+     * rest of the query, which only looks up the suffix lengths the
+     * container actually stores.
+     *
+     * @param query  string to match
+     * @return  iterator to the longest element that is a prefix of
+     *          @a query, or end() if there is none
+     */
+    iterator longest_prefix(const key_type &query) const {
+        const std::string &word = ref(query);
+        const char *s = word.c_str();
+
+        // Deepest word found so far. An empty string in the trie is
+        // marked on the root.
+        htnode_ptr best;
+        size_t length = 0;
+        typename bucket::iterator entry;
+        bool in_table = false;
+        if (_root->word()) {
+            best = htnode_ptr(_root);
+        }
+
+        htnode *p = _root;
+        while (*s) {
+            unsigned char index = *s;
+            child_ptr v = p->child(index);
+            if (v.node == NULL) {
+                break;
+            }
+            ++s;
+
+            if (p->types[index] == NODE_POINTER) {
+                p = v.node;
+                if (p->word()) {
+                    best = htnode_ptr(p);
+                    length = s - word.c_str();
+                }
+                continue;
+            }
+
+            ahnode *b = v.bucket;
+            if (b->word) {
+                best = htnode_ptr(b);
+                length = s - word.c_str();
+            }
+            typename bucket::iterator it = b->table->longest_prefix(s);
+            if (it != b->table->end()) {
+                best = htnode_ptr(b);
+                length = s - word.c_str();
+                entry = it;
+                in_table = true;
+            }
+            break;
+        }
+
+        iterator result(_root, false);
+        if (best.ptr.node == NULL) {
+            return end();
+        }
+        result = best;
+        result._cached_word.assign(word, 0, length);
+        if (in_table) {
+            result._word = false;
+            result._container_iterator = entry;
+        }
+        return result;
+    }
+
+    /**
+     * Calls @a f on every element that is a prefix of @a query, shortest
+     * first.
+     *
+     * This function is an extension to the standard STL interface. Words
+     * on the nodes along @a query are reported during a single descent.
+     * If the descent reaches a container, the container reports its
+     * entries that are prefixes of the rest of the query, looking up only
+     * the suffix lengths it stores.
+     *
+     * @param query  string to match
+     * @param f      functor called as f(const char *key, size_t length).
+     *               Matches are prefixes of @a query, so @a key always
+     *               points at the start of @a query
+     * @return  @a f
+     */
+    template <class F>
+    F prefixes_of(const key_type &query, F f) const {
+        const std::string &word = ref(query);
+        const char *start = word.c_str();
+        const char *s = start;
+        if (_root->word()) {
+            f(start, 0);
+        }
+
+        htnode *p = _root;
+        while (*s) {
+            unsigned char index = *s;
+            child_ptr v = p->child(index);
+            if (v.node == NULL) {
+                break;
+            }
+            ++s;
+
+            if (p->types[index] == NODE_POINTER) {
+                p = v.node;
+                if (p->word()) {
+                    f(start, s - start);
+                }
+                continue;
+            }
+
+            ahnode *b = v.bucket;
+            if (b->word) {
+                f(start, s - start);
+            }
+            _prefix_reporter<F> reporter = { &f, start, (size_t) (s - start) };
+            b->table->each_prefix(s, reporter);
+            break;
+        }
+        return f;
+    }
+
+    /**
+     * Calls @a f on every element within edit distance @a k of @a query.
+     *
+     * This function is an extension to the standard STL interface. The
+     * trie is walked depth-first carrying one row of the Levenshtein
+     * table per character of the path. A subtree is skipped as soon as
+     * every entry of its row exceeds @a k, since no word under it can
+     * get closer. Inside a container the entries are visited in sorted
+     * order, so each entry reuses the rows of the prefix it shares with
+     * the previous one, and entries that share a pruned prefix are
+     * skipped outright.
+     *
+     * Elements are reported in sorted order.
+     *
+     * @code
+     * // spelling suggestions
+     * trie.fuzzy_search("recieve", 2, suggest);
+     * @endcode
+     *
+     * O(m * v)  m = length of @a query, v = number of trie and container
+     * characters within reach of @a k edits
+     *
+     * @param query  string to match
+     * @param k      largest edit distance to report
+     * @param f      functor called as
+     *               f(const char *key, size_t length, size_t distance)
+     * @return  @a f
+     */
+    template <class F>
+    F fuzzy_search(const key_type &query, size_t k, F f) const {
+        _fuzzy<F> search(ref(query), k, f);
+        if (_root->word() && search.distance(0) <= k) {
+            f(search.key.c_str(), 0, search.distance(0));
+        }
+        search.node(_root, 0);
+        return f;
+    }
+
+    /**
+     * Calls @a f on every element that matches a glob pattern.
+     *
+     * This function is an extension to the standard STL interface. The
+     * pattern syntax is:
+     *
+     * @li @c ? matches any one character
+     * @li @c * matches any sequence of characters, including none
+     * @li @c [abc], @c [a-z] match one character of a class, and
+     *     @c [!a-z] or @c [^a-z] one character outside it. A @c ] right
+     *     after the opening bracket is part of the class
+     * @li @c \ makes the next character literal
+     * @li any other character matches itself
+     *
+     * The pattern is run as a set of pattern positions that is stepped
+     * along the trie. Where every position waits on a literal, only the
+     * children for those literals are looked up, so literal segments
+     * descend directly. Classes only visit the children they accept.
+     * Once a position reaches a trailing @c *, the whole subtree matches
+     * and is reported without further checks. Inside a container each
+     * entry is stepped through the pattern until the position set runs
+     * empty.
+     *
+     * Elements are reported in the same order as begin() visits them.
+     *
+     * @code
+     * trie.match_pattern("b?t*", f);      // bat, bet, bitter, ...
+     * trie.match_pattern("[A-Z]*ah", f);  // Abijah, Noah, ...
+     * @endcode
+     *
+     * @param pattern  glob pattern to match
+     * @param f        functor called as f(const char *key, size_t length)
+     * @return  @a f
+     */
+    template <class F>
+    F match_pattern(const key_type &pattern, F f) const {
+        _glob<F> search(ref(pattern), f);
+        search.node(_root, 0);
+        return f;
+    }
+
+    /**
+     * Finds the @a k words with the greatest scores that start with
+     * @a prefix, in a scored trie (see hat_trie_traits::scored).
+     *
+     * This function is an extension to the standard STL interface. The
+     * search is best-first: a heap holds the words and subtrees found
+     * so far, keyed by score and by the greatest score under each
+     * subtree. A subtree is only opened once it is the best thing on the
+     * heap, and the search stops as soon as the @a k words taken from
+     * the heap beat everything left on it. Subtrees that can't hold one
+     * of the best words are never visited, so the cost depends on how
+     * deep the best words are rather than on the size of the range.
+     * Containers don't keep maxima for their entries, so an opened
+     * container is scanned.
+     *
+     * @code
+     * trie.top_k("th", 3);  // the three best completions of "th"
+     * @endcode
+     *
+     * @param prefix  prefix the words must start with
+     * @param k       number of words to find
+     * @return  up to @a k words and their scores, best first. Equal
+     *          scores are ordered by word
+     */
+    std::vector<std::pair<key_type, score_type> >
+    top_k(const key_type &prefix, size_t k) const {
+        std::vector<std::pair<key_type, score_type> > result;
+        if (k == 0) {
+            return result;
+        }
+
+        std::vector<_candidate> heap;
+        const char *s = ref(prefix).c_str();
+        htnode_ptr n = _locate(s);
+        if (*s == '\0') {
+            _candidate::push(heap, n.max_score(), n, NULL, true);
+        } else if (n.type == BUCKET_POINTER) {
+            // The prefix ends inside a container. Only its entries that
+            // start with the rest of the prefix qualify, and they are
+            // next to each other in sorted order.
+            size_t length = strlen(s);
+            bucket *table = n.ptr.bucket->table;
+            std::vector<_candidate> entries;
+            typename bucket::iterator it;
+            for (it = table->sorted_lower_bound(s); it != table->end() &&
+                    strncmp(*it, s, length) == 0; ++it) {
+                _candidate entry = { _score(it.value()), n, *it, false };
+                entries.push_back(entry);
+            }
+            _push_best(entries, HT_NO_SCORE, k, heap);
+        }
+
+        while (heap.empty() == false) {
+            // Everything left on the heap scores below the kth word.
+            // Ties with it are still taken so that they can be ordered
+            // by word below.
+            if (result.size() >= k && heap.front().score <
+                    result[k - 1].second) {
+                break;
+            }
+            std::pop_heap(heap.begin(), heap.end());
+            _candidate top = heap.back();
+            heap.pop_back();
+            if (top.expand) {
+                if (result.size() >= k) {
+                    _expand(top.n, result[k - 1].second, 0, heap);
+                } else {
+                    _expand(top.n, HT_NO_SCORE, k - result.size(), heap);
+                }
+            } else {
+                key_type word = _path(top.n);
+                if (top.rest) {
+                    word += top.rest;
+                }
+                result.push_back(std::make_pair(word, top.score));
+            }
+        }
+
+        std::sort(result.begin(), result.end(), _better);
+        if (result.size() > k) {
+            result.resize(k);
+        }
+        return result;
+    }
+
+    /**
+     * Replaces the contents of this trie with the words that are in
+     * either of two tries.
+     *
+     * This function is an extension to the standard STL interface. Both
+     * tries are walked together, one node at a time:
+     *
+     * @li a subtree that only one side has is copied whole, without
+     *     looking at its words
+     * @li nodes that both sides have are combined recursively
+     * @li where either side is a container, the larger side is copied
+     *     whole and the words of the smaller side are added to the copy
+     *     from the current node, not from the root
+     *
+     * The result uses the traits of @a lhs, and subtrees copied from
+     * @a rhs are burst to fit its burst policy. Values and scores are
+     * not carried over, so the set operations only take tries without
+     * values that aren't scored (hat_set) and whose array hash traits
+     * match. Either argument may be this trie.
+     *
+     * O(s + c)  s = number of words on the smaller side of each
+     * container, c = nodes and containers copied whole
+     *
+     * @param lhs, rhs  tries to combine
+     * @throw std::invalid_argument  if either trie has values or scores,
+     *                               or their array hash traits differ
+     */
+    void set_union(const hat_trie &lhs, const hat_trie &rhs) {
+        _combine_tries(lhs, rhs, _UNION);
+    }
+
+    /**
+     * Replaces the contents of this trie with the words that are in both
+     * of two tries.
+     *
+     * Walks the tries like set_union(). A subtree that only one side has
+     * is skipped without looking at its words. Where either side is a
+     * container, every word of the smaller side is probed in the larger
+     * side, starting from the current node.
+     *
+     * @param lhs, rhs  tries to intersect
+     * @throw std::invalid_argument  see set_union()
+     */
+    void set_intersection(const hat_trie &lhs, const hat_trie &rhs) {
+        _combine_tries(lhs, rhs, _INTERSECTION);
+    }
+
+    /**
+     * Replaces the contents of this trie with the words of @a lhs that
+     * are not in @a rhs.
+     *
+     * Walks the tries like set_union(). A subtree of @a lhs that
+     * @a rhs doesn't have is copied whole, and a subtree that only
+     * @a rhs has is skipped. Where either side is a container, every
+     * word of @a lhs is probed in @a rhs, starting from the current
+     * node.
+     *
+     * @param lhs  trie to take words from
+     * @param rhs  trie of words to leave out
+     * @throw std::invalid_argument  see set_union()
+     */
+    void set_difference(const hat_trie &lhs, const hat_trie &rhs) {
+        _combine_tries(lhs, rhs, _DIFFERENCE);
+    }
+
+    /**
+     * Calls @a f on every word that is in exactly one of this trie and
+     * @a rhs.
+     *
+     * This function is an extension to the standard STL interface. The
+     * tries are walked together like set_union(). A subtree that only
+     * one side has is reported whole, and where either side is a
+     * container, the words of each side are probed in the other. If both
+     * tries keep digests (see hat_trie_traits::digests), every subtree
+     * whose digest and size match on both sides is skipped, so two large
+     * tries that differ in a few words are compared in time proportional
+     * to the paths leading to those words and the containers holding
+     * them. Each such container is probed word by word, so a lower burst
+     * threshold narrows the work further.
+     *
+     * The words are reported in no particular order.
+     *
+     * @param rhs  trie to compare with
+     * @param f    functor called as f(const char *key, size_t length,
+     *             bool in_lhs), where @a in_lhs is true if the word is in
+     *             this trie and false if it is in @a rhs. The key is only
+     *             valid for the duration of the call
+     * @return  @a f
+     */
+    template <class F>
+    F diff(const hat_trie &rhs, F f) const {
+        std::string key;
+        _diff(htnode_ptr(_root), htnode_ptr(rhs._root), key, f,
+              _traits.digests && rhs._traits.digests);
+        return f;
+    }
+
+    /**
+     * Finds the range of elements that start with @a prefix.
+     *
+     * This function is an extension to the standard STL interface. It
+     * descends the trie along @a prefix once for each end of the range.
+     * Nothing is copied, so the cost is proportional to the length of
+     * @a prefix plus the number of elements visited.
+     *
+     * @param prefix  prefix to search for
+     * @return  pair of ordered iterators [first, last) spanning every
+     *          element that has @a prefix as a prefix
+     */
+    std::pair<iterator, iterator> prefix_range(const key_type &prefix) const {
+        const char *s = ref(prefix).c_str();
+        return std::make_pair(_bound(s, false), _prefix_end(s));
+    }
+
+    /**
+     * Calls @a f on every element in the trie.
+     *
+     * This function is an extension to the standard STL interface. It
+     * visits the elements in the same order as begin(), but walks the
+     * trie depth-first with an explicit stack instead of climbing back up
+     * from each node the way an iterator does, and builds each element in
+     * a single reused buffer.
+     *
+     * @param f  functor called as f(const char *key, size_t length). The
+     *           key is only valid for the duration of the call, and the
+     *           trie must not be modified until for_each returns
+     * @return  @a f
+     */
+    template <class F>
+    F for_each(F f) const {
+        std::string key;
+        _visit(_root, key, f);
+        return f;
+    }
+
+    /**
+     * Calls a copy of @a f on every element in the trie, using several
+     * threads.
+     *
+     * This function is an extension to the standard STL interface. The
+     * trie is cut into partitions of roughly equal size (a subtree, a
+     * container or the word on a node). Each partition covers a
+     * contiguous range of keys, and partition i comes before partition
+     * i + 1 in key order. Every partition gets its own copy of @a f, which
+     * only ever runs on one thread at a time, so functors don't need any
+     * locking. The threads start on equal shares of the partitions and
+     * steal from each other once their own share runs out, which evens
+     * out skewed subtrees.
+     *
+     * Without C++11 thread support, the partitions are visited one after
+     * the other on the calling thread.
+     *
+     * @param f        functor called as f(const char *key, size_t length)
+     * @param threads  number of threads to use, including the caller
+     * @param ordered  true to visit the keys within each partition in
+     *                 sorted order. Concatenating the output of the
+     *                 returned functors then gives a sorted export
+     * @return  the functors used for each partition, in key order
+     */
+    template <class F>
+    std::vector<F> parallel_for_each(F f, unsigned threads,
+                                     bool ordered = false) const {
+        if (threads == 0) {
+            threads = 1;
+        }
+
+        // Cut the trie into about eight partitions per thread so a thread
+        // that finishes early has something to steal.
+        std::vector<_task> tasks;
+        std::string path;
+        size_t grain = _root->size / (threads * 8) + 1;
+        _partition(htnode_ptr(_root), path, grain, tasks);
+
+        std::vector<F> result(tasks.size(), f);
+#if __cplusplus >= 201103L
+        if (threads > tasks.size()) {
+            threads = tasks.size();
+        }
+
+        // Deal out contiguous shares of the partitions.
+        std::vector<std::deque<size_t> > queues(threads);
+        std::vector<std::mutex> locks(threads);
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            queues[i * threads / tasks.size()].push_back(i);
+        }
+
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; ++t) {
+            workers.push_back(std::thread(
+                    _work<F>, t, std::ref(tasks), std::ref(result),
+                    std::ref(queues), std::ref(locks), ordered));
+        }
+        _work<F>(0, tasks, result, queues, locks, ordered);
+        for (size_t t = 0; t < workers.size(); ++t) {
+            workers[t].join();
+        }
+#else
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            _run(tasks[i], result[i], ordered);
+        }
+#endif
+        return result;
+    }
+
+    /**
+     * Calls @a f on every element in the trie that starts with @a prefix.
+     *
+     * See for_each(). Elements in the container the prefix ends in are
+     * found with a binary search on the container's sorted index, so the
+     * cost is proportional to the length of @a prefix plus the number of
+     * elements visited.
+     *
+     * @param prefix  prefix to search for
+     * @param f  functor called as f(const char *key, size_t length)
+     * @return  @a f
+     */
+    template <class F>
+    F for_each_prefix(const key_type &prefix, F f) const {
+        const std::string &word = ref(prefix);
+        std::string key;
+        key.reserve(word.size());
+
+        htnode *p = _root;
+        const char *s = word.c_str();
+        while (*s) {
+            unsigned char index = *s;
+            child_ptr v = p->child(index);
+            if (v.node == NULL) {
+                return f;
+            }
+
+            key += *s;
+            ++s;
+            if (p->types[index] == NODE_POINTER) {
+                p = v.node;
+                continue;
+            }
+
+            ahnode *b = v.bucket;
+            if (*s == '\0') {
+                _visit(htnode_ptr(b), key, f);
+                return f;
+            }
+
+            // Visit the sorted run of elements that start with the rest
+            // of the prefix.
+            size_t rest = strlen(s);
+            size_t length = key.size();
+            typename bucket::iterator it;
+            for (it = b->table->sorted_lower_bound(s);
+                    it != b->table->end() && strncmp(*it, s, rest) == 0;
+                    ++it) {
+                key.resize(length);
+                key.append(*it, it.length());
+                f(key.data(), key.size());
+            }
+            return f;
+        }
+
+        _visit(htnode_ptr(p), key, f);
+        return f;
+    }
+
+    /**
+     * Swaps the data in two hat_trie objects.
+     *
+     * This function operates in constant time because all it needs to do
+     * is swap a few primitives.
+     *
+     * @param rhs  hat_trie object to swap data with
+     */
+    void swap(hat_trie &rhs) {
+        using std::swap;
+        swap(_root, rhs._root);
+        swap(_size, rhs._size);
+        swap(_traits, rhs._traits);
+        swap(_ah_traits, rhs._ah_traits);
+    }
+
+    /**
+     * @brief Iterates over the elements in a HAT-trie
+     *
+     * A HAT-trie iterator has to maintain a lot of state to determine
+     * its current position. The code to construct iterators is pretty
+     * ugly, but they have to be constructed incrementally because of
+     * the large amount of state they maintain.
+     */
+    class iterator : public std::iterator<std::bidirectional_iterator_tag,
+                                          const key_type> {
+        friend class hat_trie;
+
+      public:
+        // Dereferencing builds the word, so it is returned by value.
+        typedef key_type reference;
+
+        /**
+         * Default constructor.
+         */
+        iterator() : _word(false), _ordered(false), _root(NULL) { }
+
+        /**
+         * Moves the iterator forward.
+         *
+         * @return  self-reference
+         */
+        iterator &operator++() {
+            if (_position.type == BUCKET_POINTER) {
+                // If word is set, then this container represents a word as
+                // well as storing words. The first iteration into the
                 // container is over the word represented by the container.
                 if (_word) {
                     // Move into the actual container by setting word to false.
@@ -738,7 +1767,32 @@ class hat_trie<std::string> {
          * @return  self-reference
          */
         iterator &operator--() {
-            return *this;
+            if (_position.ptr.node == NULL) {
+                // Move from end() to the greatest word in the trie.
+                _cached_word.clear();
+                return _enter_back(hat_trie::_greatest(_root, _cached_word));
+            }
+
+            if (_position.type == BUCKET_POINTER && _word == false) {
+                // Move the iterator over the container's elements backward.
+                // Decrementing the first element leaves it in place.
+                typename bucket::iterator prev = _container_iterator;
+                --prev;
+                if (prev != _container_iterator) {
+                    _container_iterator = prev;
+                    return *this;
+                }
+
+                // The word represented by the container comes before the
+                // words stored in it.
+                if (_position.ptr.bucket->word) {
+                    _word = true;
+                    return *this;
+                }
+            }
+
+            // Move to the previous node in the trie.
+            return _enter_back(hat_trie::_prev_word(_position, _cached_word));
         }
 
         /**
@@ -769,17 +1823,43 @@ class hat_trie<std::string> {
          * @return  string this iterator points to
          */
         key_type operator*() const {
+            return key();
+        }
+
+        /**
+         * Gets the word this iterator points to without allocating.
+         *
+         * The word is assembled in a buffer owned by the iterator. The
+         * buffer is reused across increments, so once it has grown to
+         * the longest word visited, scanning the trie with key() does no
+         * heap allocation at all.
+         *
+         * @return  reference to the word. It is only valid until the
+         *          iterator is moved or destroyed
+         */
+        const key_type &key() const {
             if (_word || _position.type == NODE_POINTER) {
-                // Print the word that has been cached over the trie traversal.
+                // The word has been cached over the trie traversal.
                 return _cached_word;
-
-            } else if (_position.type == BUCKET_POINTER) {
-                // Pull a word from the container.
-                return _cached_word + *_container_iterator;
             }
 
-            // should never get here
-            return "";
+            // Pull a word from the container.
+            _key.assign(_cached_word);
+            _key.append(*_container_iterator, _container_iterator.length());
+            return _key;
+        }
+
+        /**
+         * Gets the value bytes of the word this iterator points to.
+         *
+         * @return  pointer to the value, see find_or_insert(). It is not aligned
+         */
+        char *value() const {
+            if (_word || _position.type == NODE_POINTER) {
+                htnode_ptr n = _position;
+                return n.value();
+            }
+            return _container_iterator.value();
         }
 
         /**
@@ -789,10 +1869,18 @@ class hat_trie<std::string> {
          * @return  true iff this iterator points to the same location as
          *          @a rhs
          */
-        bool operator==(const iterator &rhs) {
-            // TODO does iterator comparison need to be on more than
-            // just pointer?
-            return _position.ptr.bucket == rhs._position.ptr.bucket;
+        bool operator==(const iterator &rhs) const {
+            if (_position.ptr.bucket != rhs._position.ptr.bucket) {
+                return false;
+            }
+            if (_position.ptr.bucket == NULL ||
+                    _position.type == NODE_POINTER) {
+                return true;
+            }
+
+            // Both iterators are in the same container.
+            return _word == rhs._word &&
+                   (_word || _container_iterator == rhs._container_iterator);
         }
 
         /**
@@ -801,7 +1889,7 @@ class hat_trie<std::string> {
          * @param rhs  iterator to compare against
          * @return  true iff this iterator is not equal to @a rhs
          */
-        bool operator!=(const iterator &rhs) {
+        bool operator!=(const iterator &rhs) const {
             return !operator==(rhs);
         }
 
@@ -813,10 +1901,19 @@ class hat_trie<std::string> {
         typename bucket::iterator _container_iterator;
         bool _word;
 
+        // Whether containers are traversed in sorted order
+        bool _ordered;
+
+        // Root of the trie, so end() can be decremented
+        htnode *_root;
+
         // Caches the word as we move up and down the trie and
         // implicitly caches the path we followed as well
         std::string _cached_word;
 
+        // Buffer that key() assembles container words in
+        mutable std::string _key;
+
         /**
          * Special-purpose conversion constructor.
          *
@@ -824,156 +1921,2354 @@ class hat_trie<std::string> {
          * this function ensures that the iterator's internal iterator
          * across the elements in the container is properly initialized.
          */
-        iterator(htnode_ptr n) {
+        iterator(htnode_ptr n) : _word(false), _ordered(false), _root(NULL) {
             operator=(n);
         }
-
-        /**
-         * Special-purpose assignment operator.
-         *
-         * If an iterator is assigned to a container pointer, this
-         * function ensures that the iterator's internal iterator across
-         * the elements in the container is properly initialized.
-         */
-        iterator &operator=(htnode_ptr n) {
-            this->_position = n;
-            if (_position.type == BUCKET_POINTER) {
-                _container_iterator = _position.ptr.bucket->table->begin();
-                _word = _position.ptr.bucket->word;
+
+        /**
+         * Constructs an end() iterator into the trie under @a root.
+         */
+        iterator(htnode *root, bool ordered) :
+                _word(false), _ordered(ordered), _root(root) { }
+
+        /**
+         * Special-purpose assignment operator.
+         *
+         * If an iterator is assigned to a container pointer, this
+         * function ensures that the iterator's internal iterator across
+         * the elements in the container is properly initialized.
+         */
+        iterator &operator=(htnode_ptr n) {
+            this->_position = n;
+            if (_position.type == BUCKET_POINTER) {
+                bucket *table = _position.ptr.bucket->table;
+                _container_iterator = _ordered ? table->sorted_begin() :
+                                                 table->begin();
+                _word = _position.ptr.bucket->word;
+            } else {
+                _word = false;
+            }
+            return *this;
+        }
+
+        /**
+         * Moves the iterator to the last word marked by @a n.
+         *
+         * This is the reverse of assigning a container pointer: the
+         * internal iterator is placed on the container's last element, or
+         * on the word represented by the container if it stores none.
+         */
+        iterator &_enter_back(htnode_ptr n) {
+            this->_position = n;
+            _word = false;
+            if (_position.type == BUCKET_POINTER) {
+                bucket *table = _position.ptr.bucket->table;
+                if (table->size() == 0) {
+                    _word = true;
+                } else {
+                    _container_iterator = _ordered ? table->sorted_end() :
+                                                     table->end();
+                    --_container_iterator;
+                }
+            }
+            return *this;
+        }
+
+    };
+
+    /**
+     * Gets a cursor positioned at the root of the trie.
+     *
+     * @return  cursor over the empty prefix
+     */
+    cursor make_cursor() const {
+        return cursor(*this);
+    }
+
+    /**
+     * @brief Walks down the trie one character at a time
+     *
+     * A cursor remembers where the characters fed to it so far lead, so
+     * matching text incrementally doesn't have to search from the root
+     * for every longer prefix. On a node, a step follows one child
+     * pointer. Inside a container, the cursor keeps the range of the
+     * container's sorted index that starts with the characters consumed
+     * in that container, and a step narrows the range with a binary
+     * search on the next character.
+     *
+     * Like iterators, cursors are invalidated by any change to the trie.
+     */
+    class cursor {
+        friend class hat_trie;
+
+      public:
+        /**
+         * Consumes one character.
+         *
+         * @param ch  next character of the prefix
+         * @return  true iff some element starts with the prefix consumed
+         *          so far. Once this returns false, the cursor stays dead
+         *          until it is reset
+         */
+        bool advance(char ch) {
+            _prefix += ch;
+            if (dead()) {
+                return false;
+            }
+            if (ch == '\0') {
+                return _kill();
+            }
+
+            if (_bucket == NULL) {
+                // Follow a child pointer.
+                unsigned char index = ch;
+                child_ptr child = _node->child(index);
+                if (child.node == NULL) {
+                    return _kill();
+                }
+                if (_node->types[index] == NODE_POINTER) {
+                    _node = child.node;
+                } else {
+                    _node = NULL;
+                    _bucket = child.bucket;
+                    _depth = 0;
+                    _first = _bucket->table->sorted_begin();
+                    _last = _bucket->table->sorted_end();
+                }
+                return true;
+            }
+
+            // Narrow the candidates in the container.
+            std::pair<typename bucket::iterator, typename bucket::iterator>
+                    range = _bucket->table->sorted_narrow(_first, _last,
+                                                          _depth, ch);
+            _first = range.first;
+            _last = range.second;
+            ++_depth;
+            if (_first == _last) {
+                return _kill();
+            }
+            return true;
+        }
+
+        /**
+         * Consumes every character of @a s.
+         *
+         * @param s  characters to consume
+         * @return  true iff some element starts with the prefix consumed
+         *          so far
+         */
+        bool advance(const key_type &s) {
+            for (size_t i = 0; i < s.size(); ++i) {
+                advance(s[i]);
+            }
+            return !dead();
+        }
+
+        /**
+         * Moves the cursor back to the root. Keeps the memory used for
+         * the prefix.
+         */
+        void reset() {
+            _node = _trie->_root;
+            _bucket = NULL;
+            _prefix.clear();
+        }
+
+        /**
+         * Checks whether the prefix consumed so far is an element.
+         */
+        bool is_word() const {
+            if (_node) {
+                return _node->word();
+            }
+            if (_bucket == NULL) {
+                return false;
+            }
+            if (_depth == 0) {
+                return _bucket->word;
+            }
+
+            // A word that ends here sorts first in the range.
+            return _first.length() == _depth;
+        }
+
+        /**
+         * Checks whether some element is longer than the prefix consumed
+         * so far and starts with it.
+         */
+        bool has_continuations() const {
+            if (_node) {
+                return _node->child_count > 0;
+            }
+            if (_bucket == NULL) {
+                return false;
+            }
+            if (_first == _last) {
+                return false;
+            }
+
+            // Every word after the first in the range is longer than the
+            // prefix, and so is the first unless it ends here.
+            typename bucket::iterator second = _first;
+            ++second;
+            return second != _last || _first.length() > _depth;
+        }
+
+        /**
+         * Checks whether no element starts with the prefix consumed so
+         * far.
+         */
+        bool dead() const {
+            return _node == NULL && _bucket == NULL;
+        }
+
+        /**
+         * Gets the prefix consumed so far.
+         */
+        const key_type &prefix() const {
+            return _prefix;
+        }
+
+        /**
+         * Gets the elements that start with the prefix consumed so far.
+         *
+         * @return  pair of ordered iterators [first, last)
+         */
+        std::pair<iterator, iterator> range() const {
+            return _trie->prefix_range(_prefix);
+        }
+
+      private:
+        const hat_trie *_trie;
+        htnode *_node;  // current node, or NULL inside a container
+        ahnode *_bucket;  // current container, or NULL on a node
+
+        // Candidates in _bucket: the elements of its sorted index that
+        // start with the _depth characters consumed inside it
+        typename bucket::iterator _first;
+        typename bucket::iterator _last;
+        size_t _depth;
+
+        key_type _prefix;
+
+        cursor(const hat_trie &trie) :
+                _trie(&trie), _node(trie._root), _bucket(NULL), _depth(0) { }
+
+        /// Marks the cursor dead
+        bool _kill() {
+            _node = NULL;
+            _bucket = NULL;
+            return false;
+        }
+    };
+
+  private:
+    // Pending work in a depth-first traversal
+    struct _frame {
+        htnode *node;
+        int pos;  // next character to consider under node
+        size_t length;  // length of the path to node
+    };
+
+    // Passes the matches a container finds in prefixes_of() on to the
+    // caller's functor with the length of the path to the container added
+    template <class F>
+    struct _prefix_reporter {
+        F *f;
+        const char *query;
+        size_t offset;
+
+        void operator()(size_t length) {
+            if (length > 0) {
+                (*f)(query, offset + length);
+            }
+        }
+    };
+
+    // Depth-first search state of fuzzy_search(). Row d of the
+    // Levenshtein table holds the distances between the first d
+    // characters of the path and every prefix of the query.
+    template <class F>
+    struct _fuzzy {
+        const std::string &query;
+        size_t k;
+        F &f;
+        std::string key;  // current path
+        std::vector<size_t> rows;  // row d starts at d * (query.size() + 1)
+
+        _fuzzy(const std::string &query, size_t k, F &f) :
+                query(query), k(k), f(f) {
+            rows.resize(query.size() + 1);
+            for (size_t j = 0; j <= query.size(); ++j) {
+                rows[j] = j;
+            }
+        }
+
+        /// Distance between the first @a d characters of the path and
+        /// the query
+        size_t distance(size_t d) const {
+            return rows[d * (query.size() + 1) + query.size()];
+        }
+
+        /**
+         * Computes row d + 1 from row d for path character @a ch.
+         *
+         * @return  the smallest entry of the new row
+         */
+        size_t step(size_t d, char ch) {
+            size_t m = query.size();
+            if (rows.size() < (d + 2) * (m + 1)) {
+                rows.resize((d + 2) * (m + 1) * 2);
+            }
+            const size_t *prev = &rows[d * (m + 1)];
+            size_t *row = &rows[(d + 1) * (m + 1)];
+            row[0] = d + 1;
+            size_t best = row[0];
+            for (size_t j = 1; j <= m; ++j) {
+                size_t cost = prev[j - 1] + (query[j - 1] != ch);
+                cost = std::min(cost, prev[j] + 1);
+                row[j] = std::min(cost, row[j - 1] + 1);
+                best = std::min(best, row[j]);
+            }
+            return best;
+        }
+
+        /// Searches the children of @a p, which is at depth @a d
+        void node(htnode *p, size_t d) {
+            for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                    i = p->next_child(i + 1)) {
+                if (step(d, (char) i) > k) {
+                    continue;
+                }
+                key += (char) i;
+                if (p->types[i] == NODE_POINTER) {
+                    htnode *child = p->child(i).node;
+                    if (child->word() && distance(d + 1) <= k) {
+                        f(key.c_str(), d + 1, distance(d + 1));
+                    }
+                    node(child, d + 1);
+                } else {
+                    ahnode *b = p->child(i).bucket;
+                    if (b->word && distance(d + 1) <= k) {
+                        f(key.c_str(), d + 1, distance(d + 1));
+                    }
+                    bucket_entries(b->table, d + 1);
+                }
+                key.resize(d);
+            }
+        }
+
+        /// Searches the entries of a container at depth @a d
+        void bucket_entries(bucket *table, size_t d) {
+            const char *prev = "";
+            size_t valid = 0;  // rows computed for prev beyond depth d
+            size_t dead = (size_t) -1;  // length of prev's pruned prefix
+            typename bucket::iterator it;
+            for (it = table->sorted_begin(); it != table->sorted_end();
+                    ++it) {
+                const char *s = *it;
+                size_t length = it.length();
+                size_t shared = 0;
+                while (shared < valid && shared < length &&
+                        s[shared] == prev[shared]) {
+                    ++shared;
+                }
+                if (shared >= dead) {
+                    continue;
+                }
+
+                dead = (size_t) -1;
+                size_t j = shared;
+                while (j < length) {
+                    if (step(d + j, s[j]) > k) {
+                        dead = j + 1;
+                        break;
+                    }
+                    ++j;
+                }
+                prev = s;
+                valid = j < length ? j + 1 : j;
+                if (j == length && distance(d + length) <= k) {
+                    key.resize(d);
+                    key.append(s, length);
+                    f(key.c_str(), d + length, distance(d + length));
+                }
+            }
+            key.resize(d);
+        }
+    };
+
+    // Depth-first search state of match_pattern(). The pattern is
+    // compiled to a list of tokens, and states[d] is the set of token
+    // positions reachable after the first d characters of the path.
+    template <class F>
+    struct _glob {
+        // One character of the pattern
+        struct token {
+            bool star;  // * token
+            int literal;  // the only character accepted, or -1
+            std::bitset<HT_ALPHABET_SIZE> accepts;
+        };
+
+        std::vector<token> tokens;
+        std::vector<bool> done;  // done[i]: tokens i.. are all stars
+        F &f;
+        std::string key;  // current path
+        std::vector<std::vector<size_t> > states;
+
+        _glob(const std::string &pattern, F &f) : f(f) {
+            for (size_t i = 0; i < pattern.size(); ++i) {
+                token t;
+                t.star = false;
+                t.literal = -1;
+                unsigned char ch = pattern[i];
+                if (ch == '*') {
+                    t.star = true;
+                } else if (ch == '?') {
+                    t.accepts.set();
+                } else if (ch == '[' && _class(pattern, i, t.accepts)) {
+                    if (t.accepts.count() == 1) {
+                        t.literal = _first(t.accepts);
+                    }
+                } else {
+                    if (ch == '\\' && i + 1 < pattern.size()) {
+                        ch = pattern[++i];
+                    }
+                    t.literal = ch;
+                    t.accepts.set(ch);
+                }
+                tokens.push_back(t);
+            }
+
+            done.resize(tokens.size() + 1, true);
+            for (size_t i = tokens.size(); i-- > 0; ) {
+                done[i] = tokens[i].star && done[i + 1];
+            }
+
+            states.resize(1);
+            _add(states[0], 0);
+        }
+
+        /**
+         * Parses a character class starting at pattern[i], which is '['.
+         *
+         * @return  false if the class isn't terminated, in which case the
+         *          '[' is a literal. Otherwise @a i is left on the ']'
+         */
+        static bool _class(const std::string &pattern, size_t &i,
+                           std::bitset<HT_ALPHABET_SIZE> &accepts) {
+            size_t j = i + 1;
+            bool negate = j < pattern.size() &&
+                    (pattern[j] == '!' || pattern[j] == '^');
+            if (negate) {
+                ++j;
+            }
+            size_t first = j;
+            for (; j < pattern.size(); ++j) {
+                unsigned char lo = pattern[j];
+                if (lo == ']' && j > first) {
+                    break;
+                }
+                unsigned char hi = lo;
+                if (j + 2 < pattern.size() && pattern[j + 1] == '-' &&
+                        pattern[j + 2] != ']') {
+                    hi = pattern[j + 2];
+                    j += 2;
+                }
+                for (int c = lo; c <= hi; ++c) {
+                    accepts.set(c);
+                }
+            }
+            if (j == pattern.size()) {
+                accepts.reset();
+                return false;
+            }
+            if (negate) {
+                accepts.flip();
+                accepts.reset(0);
+            }
+            i = j;
+            return true;
+        }
+
+        /// Gets the first character a class accepts
+        static int _first(const std::bitset<HT_ALPHABET_SIZE> &accepts) {
+            int c = 0;
+            while (!accepts[c]) {
+                ++c;
+            }
+            return c;
+        }
+
+        /// Adds position @a i and the positions a star lets it skip to
+        void _add(std::vector<size_t> &set, size_t i) const {
+            while (true) {
+                if (std::find(set.begin(), set.end(), i) != set.end()) {
+                    return;
+                }
+                set.push_back(i);
+                if (i == tokens.size() || !tokens[i].star) {
+                    return;
+                }
+                ++i;
+            }
+        }
+
+        /// Steps the positions of depth @a d over @a ch into depth d + 1
+        bool step(size_t d, unsigned char ch) {
+            if (states.size() < d + 2) {
+                states.resize(d + 2);
+            }
+            const std::vector<size_t> &from = states[d];
+            std::vector<size_t> &to = states[d + 1];
+            to.clear();
+            for (size_t j = 0; j < from.size(); ++j) {
+                size_t i = from[j];
+                if (i == tokens.size()) {
+                    continue;
+                }
+                if (tokens[i].star) {
+                    _add(to, i);
+                } else if (tokens[i].accepts[ch]) {
+                    _add(to, i + 1);
+                }
+            }
+            return !to.empty();
+        }
+
+        /// Whether the path to depth @a d matches the whole pattern
+        bool matched(size_t d) const {
+            const std::vector<size_t> &set = states[d];
+            return std::find(set.begin(), set.end(), tokens.size()) !=
+                    set.end();
+        }
+
+        /// Whether every extension of the path to depth @a d matches
+        bool everything(size_t d) const {
+            const std::vector<size_t> &set = states[d];
+            for (size_t j = 0; j < set.size(); ++j) {
+                if (done[set[j]] && set[j] < tokens.size()) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// Searches the node @a p at depth @a d and its subtree
+        void node(htnode *p, size_t d) {
+            if (p->word() && matched(d)) {
+                f(key.data(), key.size());
+            }
+
+            // If every position waits on a literal, look up just those
+            // children. Otherwise try them all.
+            const std::vector<size_t> &set = states[d];
+            bool literal = true;
+            for (size_t j = 0; j < set.size() && literal; ++j) {
+                literal = set[j] == tokens.size() ||
+                        tokens[set[j]].literal >= 0;
+            }
+            if (literal) {
+                std::vector<int> chars;
+                for (size_t j = 0; j < set.size(); ++j) {
+                    if (set[j] < tokens.size()) {
+                        chars.push_back(tokens[set[j]].literal);
+                    }
+                }
+                std::sort(chars.begin(), chars.end());
+                chars.erase(std::unique(chars.begin(), chars.end()),
+                            chars.end());
+                for (size_t j = 0; j < chars.size(); ++j) {
+                    if (p->child(chars[j]).node != NULL) {
+                        child(p, chars[j], d);
+                    }
+                }
+            } else {
+                for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                        i = p->next_child(i + 1)) {
+                    child(p, i, d);
+                }
+            }
+        }
+
+        /// Searches child @a i of @a p, which is at depth @a d
+        void child(htnode *p, int i, size_t d) {
+            if (!step(d, i)) {
+                return;
+            }
+            key += (char) i;
+            htnode_ptr n(p->child(i), p->types[i]);
+            if (everything(d + 1)) {
+                _visit(n, key, f);
+            } else if (n.type == NODE_POINTER) {
+                node(n.ptr.node, d + 1);
+            } else {
+                bucket_entries(n.ptr.bucket, d + 1);
+            }
+            key.resize(d);
+        }
+
+        /// Searches the container @a b at depth @a d
+        void bucket_entries(ahnode *b, size_t d) {
+            if (b->word && matched(d)) {
+                f(key.data(), key.size());
+            }
+            typename bucket::iterator it;
+            for (it = b->table->begin(); it != b->table->end(); ++it) {
+                const char *s = *it;
+                size_t length = it.length();
+                bool match = false;
+                for (size_t j = 0; ; ++j) {
+                    if (everything(d + j)) {
+                        match = true;
+                        break;
+                    }
+                    if (j == length) {
+                        match = matched(d + j);
+                        break;
+                    }
+                    if (!step(d + j, s[j])) {
+                        break;
+                    }
+                }
+                if (match) {
+                    key.append(s, length);
+                    f(key.data(), key.size());
+                    key.resize(d);
+                }
+            }
+        }
+    };
+
+    // Part of the trie visited by one functor in parallel_for_each
+    struct _task {
+        htnode_ptr start;
+        std::string path;  // path to start
+        bool word_only;  // true to visit only the word on start
+    };
+
+    hat_trie_traits _traits;
+    array_hash_traits _ah_traits;
+    htnode *_root;  // pointer to the root of the trie
+    size_type _size;  // number of distinct elements in the trie
+
+    /**
+     * Recursively prints the contents of the trie.
+     *
+     * See the doc comment on print()
+     *
+     * @param out  output stream to print to
+     * @param n  node to start recursing from
+     * @param space  spaces to indent this level of the trie
+     */
+    void _print(std::ostream &out,
+                const htnode_ptr &n,
+                const std::string &space = "") const {
+        if (n.type == BUCKET_POINTER) {
+            ahnode *b = n.ptr.bucket;
+            if (b->ch != '\0') {
+                out << space << b->ch << " *";
+                if (b->word) {
+                    out << "~";
+                }
+                out << std::endl;
+            }
+
+            typename bucket::iterator it;
+            it = b->table->begin();
+            for (it = b->table->begin(); it != b->table->end(); ++it) {
+                out << space + "  " << *it << " ~" << std::endl;
+            }
+
+        } else if (n.type == NODE_POINTER) {
+            htnode *p = n.ptr.node;
+            out << space << p->ch;
+            if (p->word()) {
+                out << " ~";
+            }
+            out << std::endl;
+            for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                    i = p->next_child(i + 1)) {
+                _print(out, htnode_ptr(p->child(i), p->types[i]),
+                       space + "  ");
+            }
+        }
+    }
+
+    /**
+     * Initializes all the fields in a hat_trie as if it had just been
+     * created.
+     */
+    void _init() {
+        _size = 0;
+        _root = new (_summarized()) htnode();
+    }
+
+    /**
+     * Locates the position @a s should be in the trie.
+     *
+     * @param s  string to search for. After this function completes, if
+     *           <code>*s = '\0'</code>, @a s is in the trie part of this
+     *           data structure. If not, @a s is either completed in a
+     *           container or is not in the trie at all.
+     * @return  a htnode_ptr to the location where @a s should appear
+     *          in the trie
+     */
+    htnode_ptr _locate(const char *&s) const {
+        return _locate(s, _root);
+    }
+
+    /**
+     * Locates the position @a s should be in the subtree under @a p.
+     *
+     * @param s  string to search for, relative to @a p. See _locate()
+     * @param p  node to start from
+     * @return  a htnode_ptr to the location where @a s should appear
+     *          under @a p
+     */
+    static htnode_ptr _locate(const char *&s, htnode *p) {
+        child_ptr v;
+        while (*s) {
+            unsigned char index = *s;
+            v = p->child(index);
+            if (v.bucket) {
+                ++s;
+                if (p->types[index] == NODE_POINTER) {
+                    // Keep moving down the trie structure.
+                    p = v.node;
+                } else if (p->types[index] == BUCKET_POINTER) {
+                    // s should appear in the container v
+                    return htnode_ptr(v, BUCKET_POINTER);
+                }
+            } else {
+                // s should appear underneath this node
+                return htnode_ptr(p);
+            }
+        }
+
+        // If we get here, no container was found that could have held
+        // s, meaning node n represents s in the trie.
+        return htnode_ptr(p);
+    }
+
+    /**
+     * Calls @a f on every word in the subtree under @a n.
+     *
+     * @param n    node or container to start from
+     * @param key  path to @a n. Used as the buffer words are built in
+     * @param f    functor called as f(const char *key, size_t length)
+     */
+    template <class F>
+    static void _visit(htnode_ptr n, std::string &key, F &f,
+                       bool ordered = false) {
+        if (n.type == BUCKET_POINTER) {
+            _visit_bucket(n.ptr.bucket, key, f, ordered);
+            return;
+        }
+
+        std::vector<_frame> stack;
+        _frame start = { n.ptr.node, 0, key.size() };
+        if (start.node->word()) {
+            f(key.data(), key.size());
+        }
+        stack.push_back(start);
+
+        while (!stack.empty()) {
+            _frame &top = stack.back();
+            int i = top.node->next_child(top.pos);
+            if (i == HT_ALPHABET_SIZE) {
+                // This subtree is done.
+                stack.pop_back();
+                continue;
+            }
+            top.pos = i + 1;
+            key.resize(top.length);
+            key += (char) i;
+
+            child_ptr child = top.node->child(i);
+            if (top.node->types[i] == BUCKET_POINTER) {
+                _visit_bucket(child.bucket, key, f, ordered);
+            } else {
+                if (child.node->word()) {
+                    f(key.data(), key.size());
+                }
+                _frame next = { child.node, 0, key.size() };
+                stack.push_back(next);
+            }
+        }
+    }
+
+    /**
+     * Calls @a f on every word in a container.
+     *
+     * @param b    container to visit
+     * @param key  path to @a b. Used as the buffer words are built in
+     * @param f    functor called as f(const char *key, size_t length)
+     * @param ordered  true to visit the words in sorted order
+     */
+    template <class F>
+    static void _visit_bucket(ahnode *b, std::string &key, F &f,
+                              bool ordered = false) {
+        if (b->word) {
+            f(key.data(), key.size());
+        }
+        size_t length = key.size();
+        typename bucket::iterator it;
+        for (it = ordered ? b->table->sorted_begin() : b->table->begin();
+                it != b->table->end(); ++it) {
+            key.resize(length);
+            key.append(*it, it.length());
+            f(key.data(), key.size());
+        }
+        key.resize(length);
+    }
+
+    /**
+     * Cuts the subtree under @a n into tasks of at most @a grain words
+     * where possible, in key order.
+     *
+     * @param n      node or container to start from
+     * @param path   path to @a n
+     * @param grain  largest number of words to put in a subtree task
+     * @param tasks  receives the tasks
+     */
+    static void _partition(htnode_ptr n, std::string &path, size_t grain,
+                           std::vector<_task> &tasks) {
+        _task task;
+        task.start = n;
+        task.path = path;
+        task.word_only = false;
+        if (n.type == BUCKET_POINTER || n.ptr.node->size <= grain) {
+            tasks.push_back(task);
+            return;
+        }
+
+        // Split the node. Its own word comes before its children.
+        htnode *p = n.ptr.node;
+        if (p->word()) {
+            task.word_only = true;
+            tasks.push_back(task);
+        }
+        for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                i = p->next_child(i + 1)) {
+            path += (char) i;
+            _partition(htnode_ptr(p->child(i), p->types[i]), path, grain,
+                       tasks);
+            _pop_back(path);
+        }
+    }
+
+    /**
+     * Visits the words in one task.
+     *
+     * @param task     task to run
+     * @param f        functor called as f(const char *key, size_t length)
+     * @param ordered  true to visit the words in sorted order
+     */
+    template <class F>
+    static void _run(const _task &task, F &f, bool ordered) {
+        std::string key = task.path;
+        if (task.word_only) {
+            f(key.data(), key.size());
+        } else {
+            _visit(task.start, key, f, ordered);
+        }
+    }
+
+#if __cplusplus >= 201103L
+    /**
+     * Runs tasks on one thread of parallel_for_each until every queue is
+     * empty. Takes tasks from the front of its own queue, then steals
+     * from the back of the others.
+     *
+     * @param self     index of this thread's queue
+     * @param tasks    every task
+     * @param result   functor for each task
+     * @param queues   indexes of the tasks left for each thread
+     * @param locks    one lock per queue
+     * @param ordered  true to visit the words in sorted order
+     */
+    template <class F>
+    static void _work(unsigned self, const std::vector<_task> &tasks,
+                      std::vector<F> &result,
+                      std::vector<std::deque<size_t> > &queues,
+                      std::vector<std::mutex> &locks, bool ordered) {
+        size_t count = queues.size();
+        for (;;) {
+            size_t next = tasks.size();
+            for (size_t i = 0; i < count && next == tasks.size(); ++i) {
+                size_t victim = (self + i) % count;
+                std::lock_guard<std::mutex> guard(locks[victim]);
+                std::deque<size_t> &queue = queues[victim];
+                if (queue.empty()) {
+                    continue;
+                }
+                if (victim == self) {
+                    next = queue.front();
+                    queue.pop_front();
+                } else {
+                    next = queue.back();
+                    queue.pop_back();
+                }
+            }
+            if (next == tasks.size()) {
+                // Nothing left anywhere.
+                return;
+            }
+            _run(tasks[next], result[next], ordered);
+        }
+    }
+#endif
+
+    /**
+     * Finds the first element that is not less than (or greater than)
+     * @a s.
+     *
+     * @param s      key to search for
+     * @param upper  true to skip over an element equal to @a s
+     * @return  ordered iterator to the boundary element
+     */
+    iterator _bound(const char *s, bool upper) const {
+        iterator result(_root, true);
+        std::string &word = result._cached_word;
+
+        htnode *p = _root;
+        while (*s) {
+            unsigned char index = *s;
+            child_ptr v = p->child(index);
+            if (v.node == NULL) {
+                // Every element under p that continues with a greater
+                // character is greater than s.
+                result = _skip(p, index + 1, word);
+                return result;
+            }
+
+            word += *s;
+            ++s;
+            if (p->types[index] == NODE_POINTER) {
+                p = v.node;
+                continue;
+            }
+
+            // The boundary is in this container or right after it.
+            ahnode *b = v.bucket;
+            if (*s == '\0') {
+                // The container's word field represents s, and all its
+                // other elements are greater.
+                result = htnode_ptr(b);
+                if (upper && b->word) {
+                    ++result;
+                }
+            } else {
+                typename bucket::iterator it = upper ?
+                        b->table->sorted_upper_bound(s) :
+                        b->table->sorted_lower_bound(s);
+                if (it != b->table->end()) {
+                    result._position = htnode_ptr(b);
+                    result._word = false;
+                    result._container_iterator = it;
+                } else {
+                    result = _next_word(htnode_ptr(b), word);
+                }
+            }
+            return result;
+        }
+
+        // s ends at node p. Every other element under p is greater.
+        result = htnode_ptr(p);
+        if (upper || p->word() == false) {
+            result = _next_word(htnode_ptr(p), word);
+        }
+        return result;
+    }
+
+    /**
+     * Finds the first element after all the elements that start with
+     * @a s.
+     *
+     * @param s  prefix to search for
+     * @return  ordered iterator to the element after the prefix range
+     */
+    iterator _prefix_end(const char *s) const {
+        iterator result(_root, true);
+        std::string &word = result._cached_word;
+
+        htnode *p = _root;
+        while (*s) {
+            unsigned char index = *s;
+            child_ptr v = p->child(index);
+            if (v.node == NULL) {
+                // Nothing starts with s. The range is empty.
+                result = _skip(p, index + 1, word);
+                return result;
+            }
+
+            word += *s;
+            ++s;
+            if (p->types[index] == NODE_POINTER) {
+                p = v.node;
+                continue;
+            }
+
+            // The range ends in this container or right after it. Strings
+            // starting with s end right before the least string greater
+            // than s that doesn't start with s, which is s with its last
+            // non-0xff character incremented and everything after that
+            // dropped.
+            ahnode *b = v.bucket;
+            std::string next(s);
+            while (next.size() && (unsigned char) next[next.size() - 1] == 0xff) {
+                _pop_back(next);
+            }
+            if (next.size()) {
+                ++next[next.size() - 1];
+                typename bucket::iterator it =
+                        b->table->sorted_lower_bound(next.c_str());
+                if (it != b->table->end()) {
+                    result._position = htnode_ptr(b);
+                    result._word = false;
+                    result._container_iterator = it;
+                    return result;
+                }
+            }
+            result = _next_word(htnode_ptr(b), word);
+            return result;
+        }
+
+        // s ends at node p. The range is p's whole subtree.
+        if (p == _root) {
+            return end();
+        }
+        int pos = _pop_back(word) + 1;
+        result = _skip(p->parent, pos, word);
+        return result;
+    }
+
+    /**
+     * Where a word is stored: marked by a node or container itself, or
+     * stored in a container's table.
+     */
+    struct _slot {
+        htnode_ptr n;
+        const char *rest;  // suffix stored in n's table, or NULL
+        typename bucket::iterator entry;  // rest's entry in n's table
+
+        _slot(htnode_ptr n) : n(n), rest(NULL) { }
+    };
+
+    /**
+     * A word or subtree on the heap of top_k().
+     */
+    struct _candidate {
+        score_type score;  // score of the word, or greatest score under n
+        htnode_ptr n;
+        const char *rest;  // word's entry in n's table, or NULL
+        bool expand;       // true if n is a subtree still to be opened
+
+        bool operator<(const _candidate &rhs) const {
+            return score < rhs.score;
+        }
+
+        static void push(std::vector<_candidate> &heap, score_type score,
+                         htnode_ptr n, const char *rest, bool expand) {
+            _candidate c = { score, n, rest, expand };
+            heap.push_back(c);
+            std::push_heap(heap.begin(), heap.end());
+        }
+    };
+
+    // set operations of set_union(), set_intersection() and
+    // set_difference()
+    enum _set_op { _UNION, _INTERSECTION, _DIFFERENCE };
+
+    /**
+     * Adds the words it is called with under a node of a trie, keeping
+     * only those found (or not found) under a node of another trie.
+     */
+    struct _adder {
+        hat_trie *trie;
+        htnode *out;       // node to add the words under
+        htnode_ptr other;  // subtree to probe, or NULL to add every word
+        bool found;        // whether a probed word is added when found
+        std::string word;
+
+        void operator()(const char *key, size_t length) {
+            word.assign(key, length);
+            if (other.ptr.node && _contains(other, word.c_str() + 1) != found) {
+                return;
+            }
+            bool inserted;
+            trie->_find_or_insert(out, word.c_str(), inserted);
+        }
+    };
+
+    /**
+     * Passes the words it is called with on to a diff() functor, keeping
+     * only those not found under a node of the other trie.
+     */
+    template <class F>
+    struct _differ {
+        F *f;
+        htnode_ptr other;  // subtree to probe, or NULL to report every word
+        size_t depth;      // length of the path to other
+        bool in_lhs;       // which trie the words come from
+        std::string word;
+
+        void operator()(const char *key, size_t length) {
+            if (other.ptr.node) {
+                word.assign(key, length);
+                if (_contains(other, word.c_str() + depth)) {
+                    return;
+                }
+            }
+            (*f)(key, length, in_lhs);
+        }
+    };
+
+    /**
+     * Finds a word in the trie, inserting it first if it isn't there.
+     *
+     * @param word      word to find or insert
+     * @param inserted  set to true if @a word was inserted, false if it
+     *                  was already in the trie
+     * @param score     score of @a word if it is inserted into a scored
+     *                  trie
+     * @return  where @a word is stored
+     */
+    _slot _find_or_insert(const char *word, bool &inserted,
+                          score_type score = 0) {
+        return _find_or_insert(_root, word, inserted, score);
+    }
+
+    /**
+     * Finds a word in the subtree under a node, inserting it first if it
+     * isn't there.
+     *
+     * @param start     node to start from
+     * @param word      rest of the word below @a start
+     * @param inserted  set to true if @a word was inserted, false if it
+     *                  was already in the trie
+     * @param score     score of @a word if it is inserted into a scored
+     *                  trie
+     * @return  where @a word is stored
+     */
+    _slot _find_or_insert(htnode *start, const char *word, bool &inserted,
+                          score_type score = 0) {
+        uint64_t digest = 0;
+        if (_traits.digests) {
+            digest = _digest(_digest_state(start), word);
+        }
+
+        const char *pos = word;
+        htnode_ptr n = _locate(pos, start);
+        if (*pos == '\0') {
+            // word was found in the trie's structure. Mark its location
+            // as the end of a word.
+            inserted = n.word() == false;
+            if (inserted) {
+                n.set_word(true);
+                n.value() = _new_value(NULL);
+                ++_size;
+                _adjust_size(n, 1);
+                _adjust_digest(n, digest);
+                if (_traits.scored) {
+                    memcpy(n.value(), &score, sizeof(score_type));
+                    _raise(n, score);
+                }
+            }
+            return _slot(n);
+        }
+
+        // word was not found in the trie's structure. Either make a
+        // new bucket for it or insert it into an already existing bucket
+        ahnode *at = NULL;
+        if (n.type == NODE_POINTER) {
+            // Make a new bucket for word
+            htnode *p = n.ptr.node;
+
+            at = new (_summarized()) ahnode();
+            at->table = new bucket(_ah_traits);
+            at->ch = *pos;
+            at->word = false;
+
+            // Insert the new bucket into the trie's structure
+            at->parent = p;
+            p->set_child(*pos, htnode_ptr(at).ptr, BUCKET_POINTER);
+            ++pos;
+        } else if (n.type == BUCKET_POINTER) {
+            // The container for s already exists.
+            at = n.ptr.bucket;
+        }
+
+        // Insert the rest of word into the container.
+        return _insert(at, pos, inserted, score, digest);
+    }
+
+    /**
+     * Inserts a word into a container.
+     *
+     * If the insertion overflows the burst threshold, the container
+     * is burst.
+     *
+     * @param htc       container to insert into
+     * @param s         rest of the word to insert
+     * @param inserted  set to true if @a s is inserted into @a htc,
+     *                  false if it was already there
+     * @param score     score of the word if it is inserted into a scored
+     *                  trie
+     * @param digest    hash of the whole word if the trie keeps digests
+     * @return  where the word is stored
+     */
+    _slot _insert(ahnode *htc, const char *s, bool &inserted,
+                  score_type score, uint64_t digest) {
+        // Try to insert s into the container.
+        _slot result(htc);
+        if (*s == '\0') {
+            inserted = !htc->word;
+            if (inserted) {
+                htc->word = true;
+                htc->value = _new_value(NULL);
+            }
+        } else {
+            result.rest = s;
+            result.entry = htc->table->find_or_insert(s, inserted);
+        }
+
+        if (inserted) {
+            ++_size;
+            _adjust_size(htc, 1);
+            _adjust_digest(htc, digest);
+            if (_traits.scored) {
+                // Score the word before a burst spreads the maxima.
+                memcpy(_value(result), &score, sizeof(score_type));
+                _raise(htc, score);
+            }
+            if (_traits.burst_threshold > 0 && _should_burst(htc->table)) {
+                // burst the bucket into nodes. That moves the word one
+                // level down, under the node that replaces htc.
+                result = _slot_under(_burst(htc), s);
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Finds where a word is stored right after a burst, without
+     * descending from the root.
+     *
+     * @param p  node that replaced the burst container
+     * @param s  rest of the word below @a p
+     * @return  where the word is stored
+     */
+    static _slot _slot_under(htnode *p, const char *s) {
+        if (*s == '\0') {
+            return _slot(p);
+        }
+        ahnode *b = p->child((unsigned char) *s).bucket;
+        _slot result(b);
+        if (s[1] != '\0') {
+            result.rest = s + 1;
+            result.entry = b->table->find(s + 1);
+        }
+        return result;
+    }
+
+    /**
+     * Gets the value bytes of a word.
+     *
+     * @param slot  where the word is stored
+     * @return  pointer to the word's value bytes
+     */
+    static char *_value(_slot slot) {
+        return slot.rest ? slot.entry.value() : slot.n.value();
+    }
+
+    /**
+     * Builds an iterator to a word from where it is stored.
+     *
+     * @param word  the whole word
+     * @param slot  where @a word is stored
+     * @return  iterator to @a word
+     */
+    iterator _make_iterator(const char *word, const _slot &slot) const {
+        iterator result(_root, false);
+        result = slot.n;
+        if (slot.rest) {
+            result._word = false;
+            result._container_iterator = slot.entry;
+            result._cached_word.assign(word, slot.rest);
+        } else {
+            result._cached_word = word;
+        }
+        return result;
+    }
+
+    /**
+     * Makes a block for the value of a word on a node or container.
+     *
+     * @param value  value bytes to copy, or NULL for zeros
+     * @return  the block, or NULL if the trie stores no values
+     */
+    char *_new_value(const char *value) const {
+        return _copy_value(value, _ah_traits.value_size);
+    }
+
+    /**
+     * Copies @a size bytes of value into a new block.
+     *
+     * @param value  value bytes to copy, or NULL for zeros
+     * @param size   size of a value
+     * @return  the block, or NULL if @a size is 0
+     */
+    static char *_copy_value(const char *value, int size) {
+        if (size == 0) {
+            return NULL;
+        }
+        char *result = new char[size];
+        if (value) {
+            memcpy(result, value, size);
+        } else {
+            memset(result, 0, size);
+        }
+        return result;
+    }
+
+    /**
+     * Inserts a word and its value into a container.
+     *
+     * @param table  container to insert into
+     * @param word   word to insert
+     * @param value  value bytes of @a word. Ignored if the container
+     *               stores no values
+     */
+    static void _put(bucket *table, const char *word, const char *value) {
+        int size = table->traits().value_size;
+        if (size == 0) {
+            table->insert(word);
+        } else {
+            bool inserted;
+            memcpy(table->find_or_insert(word, inserted).value(), value,
+                   size);
+        }
+    }
+
+    /**
+     * Removes the word marked by a node or container itself, along with
+     * its value.
+     *
+     * @param n  node or container to clear
+     */
+    static void _clear_word(htnode_ptr n) {
+        n.set_word(false);
+        delete[] n.value();
+        n.value() = NULL;
+    }
+
+    /**
+     * Adds @a delta to the subtree sizes of every node on the path from
+     * @a n to the root.
+     *
+     * @param n      node or container whose word count changed
+     * @param delta  change in the word count
+     */
+    static void _adjust_size(htnode_ptr n, long delta) {
+        htnode *p = n.type == NODE_POINTER ? n.ptr.node : n.ptr.bucket->parent;
+        for (; p; p = p->parent) {
+            p->size += delta;
+        }
+    }
+
+    /**
+     * Determines whether the nodes and containers of this trie are
+     * allocated with an htsummary.
+     */
+    bool _summarized() const {
+        return _traits.scored || _traits.digests;
+    }
+
+    /**
+     * Adds @a delta to the digests of @a n and every node on the path
+     * from it to the root.
+     *
+     * @param n      node or container whose words changed
+     * @param delta  hash of the word added, or its negation for a word
+     *               removed. Digests wrap around
+     */
+    void _adjust_digest(htnode_ptr n, uint64_t delta) {
+        if (_traits.digests == false) {
+            return;
+        }
+        htnode *p = n.ptr.node;
+        if (n.type == BUCKET_POINTER) {
+            n.ptr.bucket->summary().digest += delta;
+            p = n.ptr.bucket->parent;
+        }
+        for (; p; p = p->parent) {
+            p->summary().digest += delta;
+        }
+    }
+
+    /**
+     * Gets the hash state of a path, from which the hash of every word
+     * under it can be finished. Words are hashed with 64-bit FNV-1a,
+     * which runs left to right, and the result is finished by a
+     * mixing step that keeps related words from having related hashes.
+     *
+     * @param n  node or container at the end of the path. The root
+     *           gives the initial state
+     */
+    static uint64_t _digest_state(htnode_ptr n = htnode_ptr()) {
+        uint64_t state = 14695981039346656037ULL;
+        if (n.ptr.node) {
+            state = _digest_step(state, _path(n).c_str());
+        }
+        return state;
+    }
+
+    /**
+     * Runs the bytes of a string through an FNV-1a hash state.
+     */
+    static uint64_t _digest_step(uint64_t state, const char *s) {
+        for (; *s; ++s) {
+            state ^= (unsigned char) *s;
+            state *= 1099511628211ULL;
+        }
+        return state;
+    }
+
+    /**
+     * Finishes the hash of a word.
+     *
+     * @param state  hash state of the path to where @a s continues
+     * @param s      rest of the word
+     * @return  the word's contribution to the digests above it
+     */
+    static uint64_t _digest(uint64_t state, const char *s) {
+        uint64_t h = _digest_step(state, s);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /**
+     * Recomputes every digest under a node from its words.
+     *
+     * @param p      node to start from
+     * @param state  hash state of the path to @a p
+     * @return  the digest of @a p
+     */
+    static uint64_t _compute_digests(htnode *p, uint64_t state) {
+        p->summary().digest = p->word() ? _digest(state, "") : 0;
+        for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                i = p->next_child(i + 1)) {
+            char ch[2] = { (char) i, '\0' };
+            uint64_t next = _digest_step(state, ch);
+            if (p->types[i] == NODE_POINTER) {
+                p->summary().digest += _compute_digests(p->child(i).node, next);
+                continue;
+            }
+            ahnode *b = p->child(i).bucket;
+            b->summary().digest = b->word ? _digest(next, "") : 0;
+            typename bucket::iterator it;
+            for (it = b->table->begin(); it != b->table->end(); ++it) {
+                b->summary().digest += _digest(next, *it);
+            }
+            p->summary().digest += b->summary().digest;
+        }
+        return p->summary().digest;
+    }
+
+    /**
+     * Reads the score at the start of a value.
+     *
+     * @param value  value bytes of a word in a scored trie
+     * @return  the word's score
+     */
+    static score_type _score(const char *value) {
+        score_type result;
+        memcpy(&result, value, sizeof(score_type));
+        return result;
+    }
+
+    /**
+     * Raises the greatest scores on the path from @a n to the root to
+     * at least @a score.
+     *
+     * @param n      node or container that holds a word scoring @a score
+     * @param score  score of the word
+     */
+    static void _raise(htnode_ptr n, score_type score) {
+        htnode *p = n.ptr.node;
+        if (n.type == BUCKET_POINTER) {
+            ahnode *b = n.ptr.bucket;
+            if (b->summary().max_score >= score) {
+                return;
+            }
+            b->summary().max_score = score;
+            p = b->parent;
+        }
+        for (; p && p->summary().max_score < score; p = p->parent) {
+            p->summary().max_score = score;
+        }
+    }
+
+    /**
+     * Recomputes the greatest scores on the path from @a n to the root
+     * after a word under @a n lost the score @a old.
+     *
+     * Nothing changes unless @a old was the greatest score of @a n. The
+     * climb stops at the first node whose greatest score stays the same.
+     *
+     * @param n    node or container that held the word
+     * @param old  score the word had
+     */
+    static void _rescore(htnode_ptr n, score_type old) {
+        if (old < n.max_score()) {
+            return;
+        }
+        htnode *p = n.ptr.node;
+        if (n.type == BUCKET_POINTER) {
+            ahnode *b = n.ptr.bucket;
+            score_type max = _bucket_max(b);
+            if (max == b->summary().max_score) {
+                return;
+            }
+            b->summary().max_score = max;
+            p = b->parent;
+        }
+        for (; p; p = p->parent) {
+            score_type max = _node_max(p);
+            if (max == p->summary().max_score) {
+                return;
+            }
+            p->summary().max_score = max;
+        }
+    }
+
+    /**
+     * Computes the greatest score in a container from its words.
+     *
+     * O(n)  n = size of the container
+     */
+    static score_type _bucket_max(const ahnode *b) {
+        score_type result = b->word ? _score(b->value) : HT_NO_SCORE;
+        typename bucket::iterator it;
+        for (it = b->table->begin(); it != b->table->end(); ++it) {
+            result = std::max(result, _score(it.value()));
+        }
+        return result;
+    }
+
+    /**
+     * Computes the greatest score under a node from its own word and the
+     * greatest scores of its children.
+     */
+    static score_type _node_max(const htnode *p) {
+        score_type result = p->word() ? _score(p->value) : HT_NO_SCORE;
+        for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                i = p->next_child(i + 1)) {
+            htnode_ptr child(p->child(i), p->types[i]);
+            result = std::max(result, child.max_score());
+        }
+        return result;
+    }
+
+    /**
+     * Pushes the words and subtrees directly under @a n onto the heap of
+     * top_k(). Subtrees are pushed whole, with their greatest score. A
+     * container's entries are pushed as words, see _push_best().
+     *
+     * @param n          node or container to open
+     * @param threshold  score of the kth word found so far, or
+     *                   HT_NO_SCORE. Anything below it is left out
+     * @param need       number of words top_k() still has to find
+     * @param heap       heap of candidates
+     */
+    static void _expand(htnode_ptr n, score_type threshold, size_t need,
+                        std::vector<_candidate> &heap) {
+        if (n.word() && _score(n.value()) >= threshold) {
+            _candidate::push(heap, _score(n.value()), n, NULL, false);
+        }
+        if (n.type == NODE_POINTER) {
+            htnode *p = n.ptr.node;
+            for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                    i = p->next_child(i + 1)) {
+                htnode_ptr child(p->child(i), p->types[i]);
+                if (child.max_score() >= threshold) {
+                    _candidate::push(heap, child.max_score(), child, NULL,
+                                     true);
+                }
+            }
+            return;
+        }
+
+        std::vector<_candidate> entries;
+        typename bucket::iterator it;
+        bucket *table = n.ptr.bucket->table;
+        for (it = table->begin(); it != table->end(); ++it) {
+            score_type score = _score(it.value());
+            if (score >= threshold) {
+                _candidate entry = { score, n, *it, false };
+                entries.push_back(entry);
+            }
+        }
+        _push_best(entries, threshold, need, heap);
+    }
+
+    /**
+     * Pushes the words of a container onto the heap of top_k(), keeping
+     * only the best @a need of them (and ties) when there are more.
+     *
+     * @param entries    words to push
+     * @param threshold  score of the kth word found so far, or
+     *                   HT_NO_SCORE. Anything below it is left out
+     * @param need       number of words top_k() still has to find
+     * @param heap       heap of candidates
+     */
+    static void _push_best(std::vector<_candidate> &entries,
+                           score_type threshold, size_t need,
+                           std::vector<_candidate> &heap) {
+        if (need > 0 && entries.size() > need) {
+            // Only the best need entries can still make it.
+            std::nth_element(entries.begin(), entries.end() - need,
+                             entries.end());
+            threshold = (entries.end() - need)->score;
+        }
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].score >= threshold) {
+                heap.push_back(entries[i]);
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+    }
+
+    /**
+     * Builds the path from the root to a node or container.
+     */
+    static key_type _path(htnode_ptr n) {
+        key_type result;
+        for (; n.parent(); n = htnode_ptr(n.parent())) {
+            result += n.ch();
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    /// Orders top_k() results by score, best first, then by word
+    static bool _better(const std::pair<key_type, score_type> &lhs,
+                        const std::pair<key_type, score_type> &rhs) {
+        if (lhs.second != rhs.second) {
+            return lhs.second > rhs.second;
+        }
+        return lhs.first < rhs.first;
+    }
+
+    /**
+     * Restores the trie's invariants after a word has been removed from
+     * @a n.
+     *
+     * Updates the size bookkeeping, removes @a n if it is an empty
+     * container, removes any nodes that were left empty, and merges the
+     * largest sparse subtree above @a n back into a container.
+     *
+     * @param n  node or container a word was just erased from
+     */
+    void _erase_cleanup(htnode_ptr n) {
+        --_size;
+        _adjust_size(n, -1);
+
+        htnode *current = NULL;
+        if (n.type == BUCKET_POINTER) {
+            ahnode *b = n.ptr.bucket;
+            current = b->parent;
+            if (b->table->size() == 0 && b->word == false) {
+                // Erase the container.
+                _unlink(current, b->ch);
+                delete b->table;
+                delete b;
+            }
+        } else {
+            current = n.ptr.node;
+        }
+
+        current = _erase_empty_nodes(current);
+        _merge_sparse(current);
+    }
+
+    /**
+     * Removes a child from its parent's children array.
+     *
+     * O(1). Every node and container stores the character it hangs off
+     * its parent by, which is its index in the children array.
+     *
+     * @param parent  parent of the child to remove
+     * @param ch      character of the child to remove
+     */
+    static void _unlink(htnode *parent, char ch) {
+        parent->clear_child(ch);
+    }
+
+    /**
+     * Merges the largest subtree above @a p that holds no more than
+     * merge_threshold words back into a single container.
+     *
+     * Subtree sizes only grow toward the root, so the subtree to merge is
+     * rooted at the last node on the way up that is still small enough.
+     *
+     * @param p  node to start from
+     */
+    void _merge_sparse(htnode *p) {
+        if (_traits.merge_threshold == 0 ||
+                _traits.merge_threshold >= _traits.burst_threshold) {
+            return;
+        }
+
+        htnode *target = NULL;
+        while (p && p != _root && _should_merge(p)) {
+            target = p;
+            p = p->parent;
+        }
+        if (target) {
+            _merge(target);
+        }
+    }
+
+    /**
+     * Determines whether a subtree is small enough to merge. The merged
+     * container has to stay well below every burst policy, or the next
+     * insert would burst it again.
+     *
+     * Subtree sizes and byte counts only grow toward the root, so once
+     * a node fails this test every node above it does too.
+     *
+     * @param p  root of the subtree. Must not be the root of the trie
+     * @return  true iff @a p should be merged into a container
+     */
+    bool _should_merge(const htnode *p) const {
+        if (p->size > _traits.merge_threshold) {
+            return false;
+        }
+        if (_traits.burst_scan_length > 0 &&
+                p->size * 2 > _ah_traits.slot_count *
+                              _traits.burst_scan_length) {
+            return false;
+        }
+        return _traits.burst_bytes == 0 ||
+               _merged_bytes(p, 0) * 2 <= _traits.burst_bytes;
+    }
+
+    /**
+     * Counts the bytes the words under a node would take up in the
+     * table of a container that replaced it, see array_hash::bytes().
+     *
+     * @param p      node to count under
+     * @param depth  number of characters between the node being merged
+     *               and @a p
+     */
+    size_t _merged_bytes(const htnode *p, size_t depth) const {
+        int value_size = _ah_traits.value_size;
+        size_t result = 0;
+        if (p->word() && depth > 0) {
+            result += bucket::entry_bytes(depth, value_size);
+        }
+        for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                i = p->next_child(i + 1)) {
+            if (p->types[i] == NODE_POINTER) {
+                result += _merged_bytes(p->child(i).node, depth + 1);
+                continue;
+            }
+            // Each word in the container gains the path down to it.
+            const ahnode *b = p->child(i).bucket;
+            if (b->word) {
+                result += bucket::entry_bytes(depth + 1, value_size);
+            }
+            result += b->table->bytes() + b->table->size() * (depth + 1);
+        }
+        return result;
+    }
+
+    /**
+     * Merges a node and everything underneath it into a single
+     * container. This is the reverse of _burst().
+     *
+     * @param node  node to merge. Must not be the root
+     */
+    void _merge(htnode *node) {
+        ahnode *result = new (_summarized()) ahnode();
+        result->table = new bucket(_ah_traits);
+        result->ch = node->ch;
+        result->word = node->word();
+        result->parent = node->parent;
+        result->value = node->value;
+        if (_summarized()) {
+            result->summary() = node->summary();
+        }
+        node->value = NULL;
+
+        std::string suffix;
+        _collect(node, suffix, result->table);
+
+        // Replace the node with the new container.
+        node->parent->set_child(node->ch, htnode_ptr(result).ptr,
+                                BUCKET_POINTER);
+        delete node;
+    }
+
+    /**
+     * Moves every word underneath @a p into @a table and deletes the
+     * nodes and containers that held them.
+     *
+     * @param p       node to collect from. @a p itself is not deleted
+     * @param suffix  path from the node being merged down to @a p
+     * @param table   container to insert the words into
+     */
+    static void _collect(htnode *p, std::string &suffix, bucket *table) {
+        for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                i = p->next_child(i + 1)) {
+            suffix += (char) i;
+            if (p->types[i] == NODE_POINTER) {
+                htnode *child = p->child(i).node;
+                if (child->word()) {
+                    _put(table, suffix.c_str(), child->value);
+                }
+                _collect(child, suffix, table);
+                delete child;
+            } else {
+                ahnode *b = p->child(i).bucket;
+                if (b->word) {
+                    _put(table, suffix.c_str(), b->value);
+                }
+                size_t length = suffix.size();
+                typename bucket::iterator it;
+                for (it = b->table->begin(); it != b->table->end(); ++it) {
+                    suffix += *it;
+                    _put(table, suffix.c_str(), it.value());
+                    suffix.resize(length);
+                }
+                delete b->table;
+                delete b;
+            }
+            _pop_back(suffix);
+            p->clear_child(i);
+        }
+    }
+
+    /**
+     * Changes the size of the values of the words under a node.
+     *
+     * @param p     node to start from
+     * @param size  new value size
+     * @param f     functor that converts a value, see resize_values()
+     */
+    template <class F>
+    static void _resize_values(htnode *p, int size, F &f) {
+        p->value = _resize_value(p->value, size, f);
+        for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                i = p->next_child(i + 1)) {
+            if (p->types[i] == NODE_POINTER) {
+                _resize_values(p->child(i).node, size, f);
+            } else {
+                ahnode *b = p->child(i).bucket;
+                b->value = _resize_value(b->value, size, f);
+                b->table->resize_values(size, f);
+            }
+        }
+    }
+
+    /**
+     * Replaces the value block of a node or container with a converted
+     * one of a new size.
+     *
+     * @param value  value block, or NULL if there is no word
+     * @param size   new value size
+     * @param f      functor that converts a value, see resize_values()
+     * @return  the new value block, or NULL if @a value is NULL
+     */
+    template <class F>
+    static char *_resize_value(char *value, int size, F &f) {
+        if (value == NULL) {
+            return NULL;
+        }
+        char *result = new char[size];
+        f((const char *) value, result);
+        delete[] value;
+        return result;
+    }
+
+    /**
+     * Deletes a node and everything underneath it.
+     *
+     * @param p  node to delete
+     */
+    static void _delete(htnode *p) {
+        for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                i = p->next_child(i + 1)) {
+            if (p->types[i] == NODE_POINTER) {
+                _delete(p->child(i).node);
+            } else {
+                delete p->child(i).bucket->table;
+                delete p->child(i).bucket;
+            }
+        }
+        delete p;
+    }
+
+    /**
+     * Makes a deep copy of a node and everything underneath it.
+     *
+     * @param p       node to copy
+     * @param parent  parent of the copy
+     * @param value_size  size of the values of words on nodes and
+     *                    containers
+     * @param summary  whether to allocate the copies with summaries
+     * @param copy_summary  whether to copy the summaries of @a p's
+     *                      subtree. They must exist
+     * @return  the copy of @a p
+     */
+    static htnode *_clone(const htnode *p, htnode *parent, int value_size,
+                          bool summary, bool copy_summary) {
+        htnode *result = new (summary) htnode(p->ch);
+        result->parent = parent;
+        result->size = p->size;
+        if (copy_summary) {
+            result->summary() = p->summary();
+        }
+        result->set_word(p->word());
+        if (p->value) {
+            result->value = _copy_value(p->value, value_size);
+        }
+        for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                i = p->next_child(i + 1)) {
+            if (p->types[i] == NODE_POINTER) {
+                htnode *child = _clone(p->child(i).node, result, value_size,
+                                       summary, copy_summary);
+                result->set_child(i, htnode_ptr(child).ptr, NODE_POINTER);
+            } else {
+                ahnode *b = _clone_bucket(p->child(i).bucket, result,
+                                          value_size, summary, copy_summary);
+                result->set_child(i, htnode_ptr(b).ptr, BUCKET_POINTER);
             }
-            return *this;
         }
+        return result;
+    }
 
-    };
+    /**
+     * Replaces the contents of this trie with a set operation on two
+     * tries.
+     *
+     * @param lhs, rhs  tries to combine
+     * @param op        operation to apply
+     */
+    void _combine_tries(const hat_trie &lhs, const hat_trie &rhs,
+                        _set_op op) {
+        const array_hash_traits &a = lhs._ah_traits;
+        const array_hash_traits &b = rhs._ah_traits;
+        if (lhs._traits.scored || rhs._traits.scored ||
+                a.value_size != 0 || b.value_size != 0) {
+            throw std::invalid_argument(
+                    "hat_trie: set operations don't carry values or scores");
+        }
+        if (a.slot_count != b.slot_count ||
+                a.allocation_chunk_size != b.allocation_chunk_size ||
+                a.initial_slot_count != b.initial_slot_count ||
+                a.max_load_factor != b.max_load_factor) {
+            // Containers are copied along with their traits.
+            throw std::invalid_argument(
+                    "hat_trie: set operations need equal array hash traits");
+        }
 
-  private:
-    hat_trie_traits _traits;
-    array_hash_traits _ah_traits;
-    htnode *_root;  // pointer to the root of the trie
-    size_type _size;  // number of distinct elements in the trie
+        // Build into a new trie, since lhs or rhs may be this one.
+        hat_trie result(lhs._traits, lhs._ah_traits);
+        result._combine(result._root, lhs._root, rhs._root, op);
+        if (result._traits.digests) {
+            // Copied subtrees come without their digests.
+            _compute_digests(result._root, _digest_state());
+        }
+        swap(result);
+    }
 
     /**
-     * Recursively prints the contents of the trie.
-     *
-     * See the doc comment on print()
+     * Fills a node of this trie with a set operation on the subtrees
+     * under two nodes at the same path in other tries.
      *
-     * @param out  output stream to print to
-     * @param n  node to start recursing from
-     * @param space  spaces to indent this level of the trie
+     * @param out   node to fill. It has no words yet
+     * @param a, b  nodes to combine
+     * @param op    operation to apply
      */
-    void _print(std::ostream &out,
-                const htnode_ptr &n,
-                const std::string &space = "") const {
-        if (n.type == BUCKET_POINTER) {
-            ahnode *b = n.ptr.bucket;
-            if (b->ch != '\0') {
-                out << space << b->ch << " *";
-                if (b->word) {
-                    out << "~";
+    void _combine(htnode *out, const htnode *a, const htnode *b,
+                  _set_op op) {
+        if (_keep(a->word(), b->word(), op)) {
+            out->set_word(true);
+            out->value = _new_value(a->word() ? a->value : b->value);
+            ++_size;
+            _adjust_size(out, 1);
+        }
+
+        for (int i = std::min(a->next_child(0), b->next_child(0));
+                i < HT_ALPHABET_SIZE;
+                i = std::min(a->next_child(i + 1), b->next_child(i + 1))) {
+            htnode_ptr x(a->child(i), a->types[i]);
+            htnode_ptr y(b->child(i), b->types[i]);
+            if (y.ptr.node == NULL) {
+                // Only lhs has this subtree.
+                if (op != _INTERSECTION) {
+                    _attach(out, i, x);
                 }
-                out << std::endl;
+            } else if (x.ptr.node == NULL) {
+                // Only rhs has this subtree.
+                if (op == _UNION) {
+                    _attach(out, i, y);
+                }
+            } else if (x.type == NODE_POINTER && y.type == NODE_POINTER) {
+                htnode *child = new (_summarized()) htnode(i);
+                child->parent = out;
+                out->set_child(i, htnode_ptr(child).ptr, NODE_POINTER);
+                _combine(child, x.ptr.node, y.ptr.node, op);
+                if (child->size == 0) {
+                    _unlink(out, i);
+                    delete child;
+                } else if (_traits.merge_threshold > 0 &&
+                        _traits.merge_threshold < _traits.burst_threshold &&
+                        _should_merge(child)) {
+                    _merge(child);
+                }
+            } else {
+                _combine_mixed(out, i, x, y, op);
             }
+        }
+    }
 
-            typename bucket::iterator it;
-            it = b->table->begin();
-            for (it = b->table->begin(); it != b->table->end(); ++it) {
-                out << space + "  " << *it << " ~" << std::endl;
-            }
+    /**
+     * Applies a set operation under a child of a node of this trie
+     * where at least one side is a container, by probing the side that
+     * takes fewer lookups.
+     *
+     * @param out   node of this trie to add the words under
+     * @param ch    character of the child
+     * @param x, y  child of lhs and child of rhs
+     * @param op    operation to apply
+     */
+    void _combine_mixed(htnode *out, int ch, htnode_ptr x, htnode_ptr y,
+                        _set_op op) {
+        if (x.type == BUCKET_POINTER && y.type == BUCKET_POINTER) {
+            _combine_buckets(out, ch, x.ptr.bucket, y.ptr.bucket, op);
+            return;
+        }
 
-        } else if (n.type == NODE_POINTER) {
-            htnode *p = n.ptr.node;
-            out << space << p->ch;
-            if (p->word()) {
-                out << " ~";
+        bool x_larger = _subtree_size(x) >= _subtree_size(y);
+        htnode_ptr larger = x_larger ? x : y;
+        htnode_ptr smaller = x_larger ? y : x;
+        std::string key(1, (char) ch);
+        _adder adder;
+        adder.trie = this;
+        adder.out = out;
+        if (op == _UNION) {
+            // Copy the larger side and add the smaller side to it.
+            _attach(out, ch, larger);
+            adder.other = htnode_ptr();
+            _visit(smaller, key, adder);
+        } else if (op == _INTERSECTION) {
+            adder.other = larger;
+            adder.found = true;
+            _visit(smaller, key, adder);
+        } else {
+            // Every word of lhs has to be looked at either way.
+            adder.other = y;
+            adder.found = false;
+            _visit(x, key, adder);
+        }
+    }
+
+    /**
+     * Applies a set operation to two containers, building the result
+     * container directly rather than inserting each word from the
+     * node above.
+     *
+     * @param out   node of this trie to put the result under
+     * @param ch    character of the containers
+     * @param x, y  container of lhs and container of rhs
+     * @param op    operation to apply
+     */
+    void _combine_buckets(htnode *out, int ch, const ahnode *x,
+                          const ahnode *y, _set_op op) {
+        bool x_larger = x->table->size() >= y->table->size();
+        const ahnode *larger = x_larger ? x : y;
+        const ahnode *smaller = x_larger ? y : x;
+        typename bucket::iterator it;
+
+        ahnode *result;
+        if (op == _UNION) {
+            // Copy the larger side and add the smaller side to it.
+            result = _clone_bucket(larger, out, _ah_traits.value_size,
+                                   _summarized(), false);
+            for (it = smaller->table->begin(); it != smaller->table->end();
+                    ++it) {
+                result->table->insert(*it);
             }
-            out << std::endl;
-            for (int i = 0; i < HT_ALPHABET_SIZE; ++i) {
-                if (p->children[i].bucket) {
-                    _print(out, htnode_ptr(p->children[i], p->types[i]),
-                           space + "  ");
+        } else {
+            result = new (_summarized()) ahnode();
+            result->table = new bucket(_ah_traits);
+            result->ch = ch;
+            result->parent = out;
+            if (op == _INTERSECTION) {
+                // Probe the larger side for each word of the smaller.
+                for (it = smaller->table->begin();
+                        it != smaller->table->end(); ++it) {
+                    typename bucket::iterator found =
+                            larger->table->find(*it);
+                    if (found != larger->table->end()) {
+                        _put(result->table, *it,
+                             x_larger ? found.value() : it.value());
+                    }
+                }
+            } else {
+                for (it = x->table->begin(); it != x->table->end(); ++it) {
+                    if (y->table->find(*it) == y->table->end()) {
+                        _put(result->table, *it, it.value());
+                    }
                 }
             }
         }
+        result->word = _keep(x->word, y->word, op);
+        if (result->word && result->value == NULL) {
+            result->value = _new_value(x->word ? x->value : y->value);
+        }
+
+        size_t count = _subtree_size(result);
+        if (count == 0) {
+            delete result->table;
+            delete result;
+            return;
+        }
+        out->set_child(ch, htnode_ptr(result).ptr, BUCKET_POINTER);
+        _size += count;
+        _adjust_size(out, count);
+        _burst_all(result);
     }
 
     /**
-     * Initializes all the fields in a hat_trie as if it had just been
-     * created.
+     * Bursts a container, and the containers the burst makes, until none
+     * of them should burst any more.
+     *
+     * @param b  container to check
      */
-    void _init() {
-        _size = 0;
-        _root = new htnode();
+    void _burst_all(ahnode *b) {
+        if (_traits.burst_threshold == 0 || !_should_burst(b->table)) {
+            return;
+        }
+        htnode *p = _burst(b);
+        for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                i = p->next_child(i + 1)) {
+            _burst_all(p->child(i).bucket);
+        }
     }
 
     /**
-     * Locates the position @a s should be in the trie.
+     * Decides whether a word is in the result of a set operation.
      *
-     * @param s  string to search for. After this function completes, if
-     *           <code>*s = '\0'</code>, @a s is in the trie part of this
-     *           data structure. If not, @a s is either completed in a
-     *           container or is not in the trie at all.
-     * @return  a htnode_ptr to the location where @a s should appear
-     *          in the trie
+     * @param a, b  whether the word is in lhs and in rhs
+     * @param op    operation to apply
      */
-    htnode_ptr _locate(const char *&s) const {
-        htnode *p = _root;
-        child_ptr v;
-        while (*s) {
-            int index = *s;
-            v = p->children[index];
-            if (v.bucket) {
-                ++s;
-                if (p->types[index] == NODE_POINTER) {
-                    // Keep moving down the trie structure.
-                    p = v.node;
-                } else if (p->types[index] == BUCKET_POINTER) {
-                    // s should appear in the container v
-                    return htnode_ptr(v, BUCKET_POINTER);
-                }
+    static bool _keep(bool a, bool b, _set_op op) {
+        switch (op) {
+          case _UNION:
+            return a || b;
+          case _INTERSECTION:
+            return a && b;
+          default:
+            return a && !b;
+        }
+    }
+
+    /**
+     * Copies a node or container of another trie under a node of this
+     * trie.
+     *
+     * @param out   node to copy under
+     * @param ch    character to copy under
+     * @param from  node or container to copy
+     */
+    void _attach(htnode *out, int ch, htnode_ptr from) {
+        htnode_ptr copy;
+        if (from.type == NODE_POINTER) {
+            copy = _clone(from.ptr.node, out, _ah_traits.value_size,
+                          _summarized(), false);
+        } else {
+            copy = _clone_bucket(from.ptr.bucket, out, _ah_traits.value_size,
+                                 _summarized(), false);
+        }
+        out->set_child(ch, copy.ptr, copy.type);
+        size_t count = _subtree_size(copy);
+        _size += count;
+        _adjust_size(out, count);
+
+        // The copy may come from a trie that bursts later than this one.
+        _burst_subtree(copy);
+    }
+
+    /**
+     * Bursts every container under a node or container that has
+     * outgrown this trie's burst policy.
+     *
+     * @param n  node or container to check
+     */
+    void _burst_subtree(htnode_ptr n) {
+        if (n.type == BUCKET_POINTER) {
+            _burst_all(n.ptr.bucket);
+            return;
+        }
+        htnode *p = n.ptr.node;
+        for (int i = p->next_child(0); i < HT_ALPHABET_SIZE;
+                i = p->next_child(i + 1)) {
+            _burst_subtree(htnode_ptr(p->child(i), p->types[i]));
+        }
+    }
+
+    /**
+     * Reports the words that are under exactly one of two nodes or
+     * containers at the same path in two tries.
+     *
+     * @param x, y     node or container of lhs and of rhs
+     * @param key      path to @a x and @a y. Used as the buffer words are
+     *                 built in
+     * @param f        diff() functor
+     * @param digests  true if both tries keep digests
+     */
+    template <class F>
+    static void _diff(htnode_ptr x, htnode_ptr y, std::string &key, F &f,
+                      bool digests) {
+        if (digests && x.digest() == y.digest() &&
+                _subtree_size(x) == _subtree_size(y)) {
+            return;
+        }
+
+        // _visit() leaves the buffer longer than it found it.
+        size_t length = key.size();
+        _differ<F> differ;
+        differ.f = &f;
+        differ.depth = length;
+        if (x.type == BUCKET_POINTER || y.type == BUCKET_POINTER) {
+            differ.other = y;
+            differ.in_lhs = true;
+            _visit(x, key, differ);
+            key.resize(length);
+            differ.other = x;
+            differ.in_lhs = false;
+            _visit(y, key, differ);
+            key.resize(length);
+            return;
+        }
+
+        htnode *a = x.ptr.node;
+        htnode *b = y.ptr.node;
+        if (a->word() != b->word()) {
+            f(key.data(), key.size(), a->word());
+        }
+        differ.other = htnode_ptr();
+        for (int i = std::min(a->next_child(0), b->next_child(0));
+                i < HT_ALPHABET_SIZE;
+                i = std::min(a->next_child(i + 1), b->next_child(i + 1))) {
+            htnode_ptr u(a->child(i), a->types[i]);
+            htnode_ptr v(b->child(i), b->types[i]);
+            key += (char) i;
+            if (u.ptr.node && v.ptr.node) {
+                _diff(u, v, key, f, digests);
             } else {
-                // s should appear underneath this node
-                return htnode_ptr(p);
+                // Only one side has this subtree.
+                differ.in_lhs = u.ptr.node != NULL;
+                _visit(differ.in_lhs ? u : v, key, differ);
             }
+            key.resize(length);
         }
+    }
 
-        // If we get here, no container was found that could have held
-        // s, meaning node n represents s in the trie.
-        return htnode_ptr(p);
+    /**
+     * Gets the number of words under a node or container.
+     */
+    static size_t _subtree_size(htnode_ptr n) {
+        if (n.type == NODE_POINTER) {
+            return n.ptr.node->size;
+        }
+        return n.ptr.bucket->table->size() + n.ptr.bucket->word;
     }
 
     /**
-     * Inserts a word into a container.
+     * Determines whether a word is under a node or container.
      *
-     * If the insertion overflows the burst threshold, the container
-     * is burst.
+     * @param n  node or container to search under
+     * @param s  rest of the word below @a n
+     * @return  true iff the word is there
+     */
+    static bool _contains(htnode_ptr n, const char *s) {
+        if (n.type == NODE_POINTER) {
+            n = _locate(s, n.ptr.node);
+        }
+        if (*s == '\0') {
+            return n.word();
+        }
+        if (n.type == NODE_POINTER) {
+            return false;
+        }
+        bucket *table = n.ptr.bucket->table;
+        return table->find(s) != table->end();
+    }
+
+    /**
+     * Makes a deep copy of a container.
      *
-     * @param htc  container to insert into
-     * @param s    word to insert
+     * @param from    container to copy
+     * @param parent  parent of the copy
+     * @param value_size  size of the value of the word on the container
+     * @param summary  whether to allocate the copy with a summary
+     * @param copy_summary  whether to copy the summary of @a from. It
+     *                      must exist
+     * @return  the copy of @a from
+     */
+    static ahnode *_clone_bucket(const ahnode *from, htnode *parent,
+                                 int value_size, bool summary,
+                                 bool copy_summary) {
+        ahnode *result = new (summary) ahnode();
+        result->table = new bucket(*from->table);
+        result->ch = from->ch;
+        result->word = from->word;
+        if (copy_summary) {
+            result->summary() = from->summary();
+        }
+        if (from->value) {
+            result->value = _copy_value(from->value, value_size);
+        }
+        result->parent = parent;
+        return result;
+    }
+
+    /**
+     * Determines whether a container has outgrown the burst policy in
+     * the trie's traits.
      *
-     * @return
-     *      true if @a s is successfully inserted into @a htc, false
-     *      otherwise
+     * @param table  container to check
+     * @return  true iff @a table should be burst
      */
-    bool _insert(ahnode *htc, const char *s) {
-        // Try to insert s into the container.
-        bool result;
-        if (*s == '\0') {
-            result = !htc->word;
-            htc->word = true;
-        } else {
-            result = htc->table->insert(s);
+    bool _should_burst(const bucket *table) const {
+        size_t size = table->size();
+        if (size > _traits.burst_threshold) {
+            return true;
         }
 
-        if (result) {
-            ++_size;
-            if (_traits.burst_threshold > 0 &&
-                    htc->table->size() > _traits.burst_threshold) {
-                // burst the bucket into nodes
-                _burst(htc);
-            }
+        // Bursting a container that holds one string only moves the
+        // string down a level.
+        if (size <= 1) {
+            return false;
+        }
+        if (_traits.burst_bytes > 0 && table->bytes() > _traits.burst_bytes) {
             return true;
         }
-        return false;
+        return _traits.burst_scan_length > 0 &&
+               table->slot_count() == table->traits().slot_count &&
+               size > table->slot_count() * _traits.burst_scan_length;
     }
 
     /**
@@ -983,38 +4278,28 @@ class hat_trie<std::string> {
      * children.
      *
      * @param current  node to start from
+     * @return  the first node on the way up that was not erased
      */
-    void _erase_empty_nodes(htnode *current) {
-        while (current && current != _root && current->word() == false) {
+    htnode *_erase_empty_nodes(htnode *current) {
+        while (current != _root && current->word() == false) {
             // Erase all the nodes that aren't words and don't
             // have any children above the erased node or container.
-            // Start by determining whether the current node has any
-            // children.
-            bool children = false;
-            for (int i = 0; i < HT_ALPHABET_SIZE && !children; ++i) {
-                children |= (bool)current->children[i].bucket;
-            }
-
             // If the current node doesn't have any children and isn't a
             // word, delete it.
-            if (children == false) {
+            if (current->child_count == 0) {
                 htnode *tmp = current;
                 current = current->parent;
-                delete tmp;
 
                 // Mark the slot in current's parent's children array
                 // as NULL.
-                for (int i = 0; i < HT_ALPHABET_SIZE; ++i) {
-                    if (current->children[i].node == tmp) {
-                        current->children[i].node = NULL;
-                        break;
-                    }
-                }
+                _unlink(current, tmp->ch);
+                delete tmp;
             } else {
                 // Stop the while loop.
-                current = NULL;
+                break;
             }
         }
+        return current;
     }
 
     /**
@@ -1046,45 +4331,67 @@ class hat_trie<std::string> {
      * (The HAT-trie is a derivation of a burst-trie.)
      *
      * @param htc  container to burst
+     * @return  the node that replaces @a htc
      */
-    void _burst(ahnode *htc) {
+    htnode *_burst(ahnode *htc) {
         // Construct a new node.
-        htnode *result = new htnode(htc->ch);
+        htnode *result = new (_summarized()) htnode(htc->ch);
         result->set_word(htc->word);
+        result->size = htc->table->size() + htc->word;
+        result->value = htc->value;
+        if (_summarized()) {
+            result->summary() = htc->summary();
+        }
+        htc->value = NULL;
+
+        // Hash state of the path to htc, to rehash the words under it
+        uint64_t state = 0;
+        if (_traits.digests) {
+            state = _digest_state(htc);
+        }
 
         // Make a set of containers for the data in the old container and
         // add them to the new node.
         typename bucket::iterator it;
         for (it = htc->table->begin(); it != htc->table->end(); ++it) {
-            int index = (*it)[0];
+            unsigned char index = (*it)[0];
 
             // Do we need to make a new container?
-            if (result->children[index].bucket == NULL) {
+            if (result->child(index).bucket == NULL) {
                 // Make a new container and position it under the new node.
-                ahnode *insertion = new ahnode();
+                ahnode *insertion = new (_summarized()) ahnode();
                 insertion->table = new bucket(_ah_traits);
                 insertion->ch = (*it)[0];
                 insertion->parent = result;
-                result->children[index].bucket = insertion;
-                result->types[index] = BUCKET_POINTER;
-
-                // Set the new container's word field.
-                insertion->word = (*it)[1] == '\0';
+                result->set_child(index, htnode_ptr(insertion).ptr,
+                                  BUCKET_POINTER);
             }
 
-            // Insert the rest of the word into a container.
-            result->children[index].bucket->table->insert(*it + 1);  /// TODO lolwut?
-            //((_container *)result->children[index])->insert(*(it + 1));
+            // Insert the rest of the word into a container. A word that
+            // ends here is represented by the container's word field.
+            ahnode *child = result->child(index).bucket;
+            if ((*it)[1] == '\0') {
+                child->word = true;
+                child->value = _new_value(it.value());
+            } else {
+                _put(child->table, *it + 1, it.value());
+            }
+            if (_traits.scored) {
+                double &max = child->summary().max_score;
+                max = std::max(max, _score(it.value()));
+            }
+            if (_traits.digests) {
+                child->summary().digest += _digest(state, *it);
+            }
         }
 
         // Position the new node in the trie.
         htnode *p = htc->parent;
         result->parent = p;
-        int index = htc->ch;
-        p->children[index].node = result;
-        p->types[index] = NODE_POINTER;
+        p->set_child(htc->ch, htnode_ptr(result).ptr, NODE_POINTER);
         delete htc->table;
         delete htc;
+        return result;
     }
 
     /**
@@ -1100,15 +4407,14 @@ class hat_trie<std::string> {
         htnode_ptr result;
 
         // Search for the next child under this node starting at pos.
-        for (int i = pos; i < HT_ALPHABET_SIZE && result.ptr.node == NULL; ++i) {
-            if (p->children[i].node) {
-                // Move to the child we just found.
-                result.ptr.node = p->children[i].node;
-                result.type = p->types[i];
-
-                // Add this motion to the word.
-                word += result.ch();
-            }
+        int i = p->next_child(pos);
+        if (i < HT_ALPHABET_SIZE) {
+            // Move to the child we just found.
+            result.ptr = p->child(i);
+            result.type = p->types[i];
+
+            // Add this motion to the word.
+            word += result.ch();
         }
         return result;
     }
@@ -1127,31 +4433,141 @@ class hat_trie<std::string> {
         // Stop early if we get a NULL pointer.
         if (n.ptr.node == NULL) { return htnode_ptr(); }
 
-        htnode_ptr result;
         if (n.type == NODE_POINTER) {
             // Move to the leftmost child under this node.
-            result = _next_child(n.ptr.node, 0, word);
+            return _skip(n.ptr.node, 0, word);
         }
 
-        if (result.ptr.node == NULL) {
-            // This node has no children. Move up in the trie until
-            // we can move right.
-            htnode_ptr next;
-            int pos;
-            htnode *parent = n.parent();
-            while (parent && next.ptr.node == NULL) {
-                // Looks like we can't move to the right. Move up a level
-                // in the trie and try again.
-                pos = _pop_back(word) + 1;
-                next = _next_child(parent, pos, word);
-                n = parent;
-                parent = n.ptr.node->parent;
-            }
-            result = next;
+        // Containers have no children. Move to the right of this one.
+        int pos = _pop_back(word) + 1;
+        return _skip(n.parent(), pos, word);
+    }
+
+    /**
+     * Finds the first node that marks a word under @a p's children
+     * starting at character @a pos, moving up in the trie until it can
+     * move right if there is no such child.
+     *
+     * @param p     node to search under
+     * @param pos   first character to consider under @a p
+     * @param word  cached word in the trie traversal. Must hold the
+     *              path to @a p
+     * @return  a pointer to the node that marks the word, or a NULL
+     *          pointer if there are no more words in the trie
+     */
+    static htnode_ptr _skip(htnode *p, int pos, key_type &word) {
+        htnode_ptr next = _next_child(p, pos, word);
+        while (next.ptr.node == NULL && p->parent) {
+            // Looks like we can't move to the right. Move up a level
+            // in the trie and try again.
+            pos = _pop_back(word) + 1;
+            p = p->parent;
+            next = _next_child(p, pos, word);
         }
 
         // Return the lexicographically least node underneath this one.
-        return _least(result, word);
+        return _least(next, word);
+    }
+
+    /**
+     * Finds the previous child under a node.
+     *
+     * @param p  parent node to search under
+     * @param pos  last position in the children array to consider
+     * @param word  cached word in the trie traversal
+     * @return  a pointer to the previous child under this node starting
+     *          from @a pos, or NULL if there is none
+     */
+    static htnode_ptr _prev_child(htnode *p, int pos, key_type &word) {
+        htnode_ptr result;
+
+        // Search for the previous child under this node starting at pos.
+        int i = p->prev_child(pos);
+        if (i >= 0) {
+            // Move to the child we just found.
+            result.ptr = p->child(i);
+            result.type = p->types[i];
+
+            // Add this motion to the word.
+            word += result.ch();
+        }
+        return result;
+    }
+
+    /**
+     * Finds the previous node that marks a word.
+     *
+     * Every word under a node comes after the word marked by the node
+     * itself, so the previous word is always found to the left of @a n
+     * or above it.
+     *
+     * @param n  node to start from
+     * @param word  cached word in the trie traversal
+     * @return  a pointer to the previous node in the trie that marks a
+     *          word, or a NULL pointer if @a n marks the first word
+     */
+    static htnode_ptr _prev_word(htnode_ptr n, key_type &word) {
+        // Stop early if we get a NULL pointer or the root.
+        if (n.ptr.node == NULL || n.parent() == NULL) { return htnode_ptr(); }
+
+        int pos = _pop_back(word) - 1;
+        return _skip_back(n.parent(), pos, word);
+    }
+
+    /**
+     * Finds the last node that marks a word under @a p's children up to
+     * character @a pos, falling back to @a p itself and then moving up
+     * in the trie if there is no such child.
+     *
+     * This is the mirror image of _skip().
+     *
+     * @param p     node to search under
+     * @param pos   last character to consider under @a p
+     * @param word  cached word in the trie traversal. Must hold the
+     *              path to @a p
+     * @return  a pointer to the node that marks the word, or a NULL
+     *          pointer if there are no previous words in the trie
+     */
+    static htnode_ptr _skip_back(htnode *p, int pos, key_type &word) {
+        htnode_ptr next = _prev_child(p, pos, word);
+        while (next.ptr.node == NULL) {
+            // Nothing to the left. The node itself comes next if it
+            // marks a word, otherwise move up a level and try again.
+            if (p->word()) {
+                return htnode_ptr(p);
+            }
+            if (p->parent == NULL) {
+                return htnode_ptr();
+            }
+            pos = _pop_back(word) - 1;
+            p = p->parent;
+            next = _prev_child(p, pos, word);
+        }
+
+        // Return the lexicographically greatest node underneath this one.
+        return _greatest(next, word);
+    }
+
+    /**
+     * Finds the lexicographically greatest node starting from @a n.
+     *
+     * @param n     current position in the trie
+     * @param word  cached word in the trie traversal
+     * @return  lexicographically greatest node from @a n. This function
+     *          may return @a n itself
+     */
+    static htnode_ptr _greatest(htnode_ptr n, key_type &word) {
+        while (n.ptr.node && n.type == NODE_POINTER) {
+            // Find the rightmost child of this node and move in that
+            // direction. A node without children marks a word.
+            htnode_ptr child = _prev_child(n.ptr.node,
+                                           HT_ALPHABET_SIZE - 1, word);
+            if (child.ptr.node == NULL) {
+                break;
+            }
+            n = child;
+        }
+        return n;
     }
 
     /**
@@ -1181,7 +4597,7 @@ class hat_trie<std::string> {
      * @return  integer that was formerly the most recent path taken
      */
     static int _pop_back(key_type &word) {
-        int result = word[word.size() - 1];
+        int result = (unsigned char) word[word.size() - 1];
         word.erase(word.size() - 1);
         return result;
     }
@@ -1211,15 +4627,22 @@ template <class T>
 bool
 operator<(const stx::hat_trie<T> &lhs,
           const stx::hat_trie<T> &rhs) {
-    return std::lexicographical_compare(lhs.begin(), lhs.end(),
-                                        rhs.begin(), rhs.end());
+    return std::lexicographical_compare(lhs.ordered_begin(), lhs.end(),
+                                        rhs.ordered_begin(), rhs.end());
 }
 template <class T>
 bool
 operator==(const stx::hat_trie<T> &lhs,
            const stx::hat_trie<T> &rhs) {
-    return lhs.size() == rhs.size() &&
-           std::equal(lhs.begin(), lhs.end(), rhs.begin());
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    if (lhs._traits.digests && rhs._traits.digests) {
+        return lhs._root->summary().digest == rhs._root->summary().digest;
+    }
+    // Tries with the same words can lay them out in different orders.
+    return std::equal(lhs.ordered_begin(), lhs.end(),
+                      rhs.ordered_begin());
 }
 template <class T>
 bool
@@ -0,0 +1,1458 @@
+/*
+ * Copyright 2010-2011 Chris Vaszauskas and Tyler Richard
+ *
+ * This file is part of a HAT-trie implementation following the paper
+ * entitled "HAT-trie: A Cache-concious Trie-based Data Structure for
+ * Strings" by Nikolas Askitis and Ranjan Sinha.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Benchmark harness. Reads whitespace separated words from standard input
+// and runs the benchmark named on the command line (all of them if no
+// name is given):
+//
+//   bin/main [benchmark] < test/inputs/kjv
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <iostream>
+#include <map>
+#if __cplusplus >= 201103L
+#include <regex>
+#endif
+#include <set>
+#include <string>
+#include <vector>
+#if __cplusplus >= 201103L
+#include <unordered_map>
+#endif
+
+#include "hat_counter.h"
+#include "hat_map.h"
+#include "hat_scored_map.h"
+#include "hat_set.h"
+
+using namespace std;
+using namespace stx;
+
+// --------
+// HELPERS
+// --------
+
+/// Seconds of processor time since the program started
+static double now() {
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+/// Seconds of wall clock time, for benchmarks that use several threads
+static double wall() {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/// Nanoseconds per operation
+static double ns(double seconds, size_t ops) {
+    return ops ? seconds * 1e9 / ops : 0;
+}
+
+/// Bytes currently allocated on the heap. Only glibc reports them; other
+/// C libraries get 0, and the heap columns read 0.
+static size_t live_bytes() {
+#if defined(__GLIBC__) && \
+        (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#elif defined(__GLIBC__)
+    // mallinfo() counts in an int, which wraps past 2 GB.
+    return (unsigned) mallinfo().uordblks;
+#else
+    return 0;
+#endif
+}
+
+/// Keeps the optimizer from discarding benchmark results
+static volatile size_t sink;
+
+/// Distinct words read from standard input, in first-seen order
+static vector<string> words;
+
+/// The first megabyte of standard input with the whitespace removed
+static string text;
+
+/// Every word read from standard input, in order
+static vector<string> tokens;
+
+/**
+ * Builds a data set of long keys by gluing words together into URLs.
+ *
+ * @param count  number of keys to generate
+ * @return  @a count distinct URL-like keys
+ */
+static vector<string> make_urls(size_t count) {
+    vector<string> result;
+    set<string> seen;
+    size_t n = words.size();
+    size_t i = 0;
+    while (result.size() < count && n > 0) {
+        string url = "http://www." + words[i % n] + ".com/" +
+                     words[(i / n) % n] + "/" +
+                     words[(i * 13 + 5) % n] + "/" +
+                     words[(i * 31 + 11) % n] + ".html";
+        if (seen.insert(url).second) {
+            result.push_back(url);
+        }
+        ++i;
+    }
+    return result;
+}
+
+/**
+ * Builds the @a i th key of a large data set of two-word phrases without
+ * materializing the whole set. Keys are distinct for i < words.size()^2.
+ *
+ * @param i  index of the key
+ * @param key  receives the key
+ */
+static void make_phrase(size_t i, string &key) {
+    size_t n = words.size();
+    key = words[i % n];
+    key += ' ';
+    key += words[(i / n) % n];
+}
+
+// -----------
+// BENCHMARKS
+// -----------
+
+/**
+ * Compares burst policies (key count, byte budget, slot scan length) on
+ * data sets with short and long keys. Reports insertion time, lookup
+ * latency and heap usage of each resulting trie.
+ */
+static void bench_burst() {
+    struct dataset {
+        const char *name;
+        vector<string> keys;
+    } sets[2];
+    sets[0].name = "words";
+    sets[0].keys = words;
+    sets[1].name = "urls";
+    sets[1].keys = make_urls(words.size() * 8);
+
+    struct policy {
+        const char *name;
+        hat_trie_traits traits;
+    } policies[4];
+    policies[0].name = "count 16384";
+    policies[1].name = "bytes 64K";
+    policies[1].traits = hat_trie_traits(16384, 65536);
+    policies[2].name = "scan 8";
+    policies[2].traits = hat_trie_traits(16384, 0, 8);
+    policies[3].name = "bytes+scan";
+    policies[3].traits = hat_trie_traits(16384, 65536, 8);
+
+    // Warm up the allocator so the first measurement isn't penalized.
+    delete new hat_set<string>(words.begin(), words.end());
+
+    printf("%-6s %-12s %10s %12s %12s %12s\n", "data", "policy", "keys",
+           "insert ns", "lookup ns", "heap bytes");
+    for (int d = 0; d < 2; ++d) {
+        const vector<string> &keys = sets[d].keys;
+        for (int p = 0; p < 4; ++p) {
+            size_t before = live_bytes();
+            double start = now();
+            hat_set<string> *h = new hat_set<string>(policies[p].traits);
+            for (size_t i = 0; i < keys.size(); ++i) {
+                h->insert(keys[i]);
+            }
+            double built = now();
+            size_t heap = live_bytes() - before;
+
+            size_t found = 0;
+            const int rounds = 5;
+            for (int r = 0; r < rounds; ++r) {
+                for (size_t i = 0; i < keys.size(); ++i) {
+                    found += h->exists(keys[i]);
+                }
+            }
+            double looked = now();
+            sink = found;
+
+            printf("%-6s %-12s %10lu %12.1f %12.1f %12lu\n", sets[d].name,
+                   policies[p].name, (unsigned long) keys.size(),
+                   ns(built - start, keys.size()),
+                   ns(looked - built, keys.size() * rounds),
+                   (unsigned long) heap);
+            delete h;
+        }
+    }
+}
+
+/**
+ * Compares producing a sorted export of a hat_set with an ordered
+ * traversal against copying an unordered traversal into a std::set and
+ * against sorting the keys with std::sort.
+ */
+static void bench_ordered() {
+    const char *names[] = { "words", "urls" };
+    vector<string> sets[2];
+    sets[0] = words;
+    sets[1] = make_urls(words.size() * 8);
+
+    printf("%-6s %10s %12s %12s %12s %12s %12s\n", "data", "keys",
+           "unordered", "ordered 1st", "ordered 2nd", "std::set",
+           "std::sort");
+    for (int d = 0; d < 2; ++d) {
+        const vector<string> &keys = sets[d];
+        hat_set<string> h(keys.begin(), keys.end());
+        size_t n = keys.size();
+        size_t total = 0;
+
+        // Plain traversal, for reference
+        double start = now();
+        for (hat_set<string>::iterator it = h.begin(); it != h.end(); ++it) {
+            total += (*it).size();
+        }
+        double unordered = now() - start;
+
+        // Ordered traversal, sorting every container on the way
+        start = now();
+        for (hat_set<string>::iterator it = h.ordered_begin();
+                it != h.end(); ++it) {
+            total += (*it).size();
+        }
+        double cold = now() - start;
+
+        // Ordered traversal with the sorted indexes already cached
+        start = now();
+        for (hat_set<string>::iterator it = h.ordered_begin();
+                it != h.end(); ++it) {
+            total += (*it).size();
+        }
+        double warm = now() - start;
+
+        // Copy into a std::set
+        start = now();
+        {
+            set<string> sorted(h.begin(), h.end());
+            for (set<string>::iterator it = sorted.begin();
+                    it != sorted.end(); ++it) {
+                total += it->size();
+            }
+        }
+        double stl_set = now() - start;
+
+        // Copy into a vector and sort it
+        start = now();
+        {
+            vector<string> sorted(h.begin(), h.end());
+            sort(sorted.begin(), sorted.end());
+            for (size_t i = 0; i < sorted.size(); ++i) {
+                total += sorted[i].size();
+            }
+        }
+        double stl_sort = now() - start;
+        sink = total;
+
+        printf("%-6s %10lu %12.1f %12.1f %12.1f %12.1f %12.1f  ns/key\n",
+               names[d], (unsigned long) n, ns(unordered, n), ns(cold, n),
+               ns(warm, n), ns(stl_set, n), ns(stl_sort, n));
+    }
+}
+
+/**
+ * Compares the per-step cost of reverse iteration with forward ordered
+ * iteration, and of paging backward from a bound. std::reverse_iterator
+ * copies the underlying iterator on every dereference, so decrementing
+ * directly is reported separately.
+ */
+static void bench_reverse() {
+    const char *names[] = { "words", "urls" };
+    vector<string> sets[2];
+    sets[0] = words;
+    sets[1] = make_urls(words.size() * 8);
+
+    printf("%-6s %10s %12s %12s %12s %12s\n", "data", "keys", "forward",
+           "decrement", "rbegin", "page of 10");
+    for (int d = 0; d < 2; ++d) {
+        const vector<string> &keys = sets[d];
+        hat_set<string> h(keys.begin(), keys.end());
+        size_t n = keys.size();
+        size_t total = 0;
+
+        // Sort every container up front so neither pass pays for it.
+        for (hat_set<string>::iterator it = h.ordered_begin();
+                it != h.end(); ++it) {
+            total += (*it).size();
+        }
+
+        double start = now();
+        for (hat_set<string>::iterator it = h.ordered_begin();
+                it != h.end(); ++it) {
+            total += (*it).size();
+        }
+        double forward = now() - start;
+
+        start = now();
+        hat_set<string>::iterator first = h.ordered_begin();
+        for (hat_set<string>::iterator it = h.end(); it != first; ) {
+            --it;
+            total += (*it).size();
+        }
+        double decrement = now() - start;
+
+        start = now();
+        for (hat_set<string>::reverse_iterator it = h.rbegin();
+                it != h.rend(); ++it) {
+            total += (*it).size();
+        }
+        double reverse = now() - start;
+
+        // The ten keys before each key, as in "latest N by key" paging
+        start = now();
+        for (size_t i = 0; i < n; ++i) {
+            hat_set<string>::reverse_iterator it(h.lower_bound(keys[i]));
+            for (int j = 0; j < 10 && it != h.rend(); ++j, ++it) {
+                total += (*it).size();
+            }
+        }
+        double paging = now() - start;
+        sink = total;
+
+        printf("%-6s %10lu %12.1f %12.1f %12.1f %12.1f  ns/key (ns/page)\n",
+               names[d], (unsigned long) n, ns(forward, n),
+               ns(decrement, n), ns(reverse, n), ns(paging, n));
+    }
+}
+
+/**
+ * Compares full scans that dereference each element with operator*,
+ * which builds a new string per element, against scans that read the
+ * iterator's reusable key buffer with key(). Short words fit in the
+ * small string buffer of std::string, so the difference shows up mostly
+ * on long keys.
+ */
+static void bench_scan() {
+    const char *names[] = { "words", "urls" };
+    vector<string> sets[2];
+    sets[0] = words;
+    sets[1] = make_urls(words.size() * 8);
+
+    printf("%-6s %10s %12s %12s\n", "data", "keys", "operator*", "key()");
+    for (int d = 0; d < 2; ++d) {
+        const vector<string> &keys = sets[d];
+        hat_set<string> h(keys.begin(), keys.end());
+        size_t n = keys.size();
+        size_t total = 0;
+
+        double start = now();
+        for (hat_set<string>::iterator it = h.begin(); it != h.end(); ++it) {
+            string word = *it;
+            total += word.size();
+        }
+        double copy = now() - start;
+
+        start = now();
+        for (hat_set<string>::iterator it = h.begin(); it != h.end(); ++it) {
+            const string &word = it.key();
+            total += word.size();
+        }
+        double view = now() - start;
+        sink = total;
+
+        printf("%-6s %10lu %12.1f %12.1f  ns/key\n", names[d],
+               (unsigned long) n, ns(copy, n), ns(view, n));
+    }
+}
+
+/// Sums key lengths in a for_each traversal
+struct length_sum {
+    size_t total;
+    void operator()(const char *, size_t length) { total += length; }
+};
+
+/**
+ * Compares full-scan throughput on a 10M-key trie: iterating with
+ * operator*, iterating with key(), and for_each. Also compares
+ * prefix_range against for_each_prefix for one-letter prefixes. The
+ * prefix_range pass includes sorting every container it ends in.
+ */
+static void bench_foreach() {
+    const size_t count = 10000000;
+    hat_set<string> h;
+    string key;
+    for (size_t i = 0; i < count; ++i) {
+        make_phrase(i, key);
+        h.insert(key);
+    }
+    size_t n = h.size();
+    size_t total = 0;
+
+    double start = now();
+    for (hat_set<string>::iterator it = h.begin(); it != h.end(); ++it) {
+        total += (*it).size();
+    }
+    double copy = now() - start;
+
+    start = now();
+    for (hat_set<string>::iterator it = h.begin(); it != h.end(); ++it) {
+        total += it.key().size();
+    }
+    double view = now() - start;
+
+    start = now();
+    length_sum sum = { 0 };
+    total += h.for_each(sum).total;
+    double visit = now() - start;
+
+    // Every element again, grouped by first letter
+    start = now();
+    for (int c = 1; c < 256; ++c) {
+        pair<hat_set<string>::iterator, hat_set<string>::iterator> range =
+                h.prefix_range(string(1, (char) c));
+        for (; range.first != range.second; ++range.first) {
+            total += range.first.key().size();
+        }
+    }
+    double ranged = now() - start;
+
+    start = now();
+    for (int c = 1; c < 256; ++c) {
+        total += h.for_each_prefix(string(1, (char) c), sum).total;
+    }
+    double visit_prefix = now() - start;
+    sink = total;
+
+    printf("%-16s %12s %12s\n", "scan", "ns/key", "Mkeys/s");
+    const char *names[] = { "operator*", "key()", "for_each",
+                            "prefix_range", "for_each_prefix" };
+    double times[] = { copy, view, visit, ranged, visit_prefix };
+    for (int i = 0; i < 5; ++i) {
+        printf("%-16s %12.1f %12.1f\n", names[i], ns(times[i], n),
+               times[i] > 0 ? n / times[i] / 1e6 : 0);
+    }
+}
+
+/**
+ * Compares longest_prefix against trying every prefix of the query with
+ * exists(), longest first, on URL routing rules. Rules are URLs cut back
+ * to the host or to one of their directories, and every query is a
+ * full URL.
+ */
+static void bench_longest_prefix() {
+    vector<string> urls = make_urls(words.size() * 8);
+    hat_set<string> rules;
+    for (size_t i = 0; i < urls.size(); i += 3) {
+        // Keep the host plus 0-2 directories.
+        size_t cut = urls[i].find('/', 11);
+        for (size_t j = 0; j < i / 3 % 3 && cut != string::npos; ++j) {
+            cut = urls[i].find('/', cut + 1);
+        }
+        rules.insert(urls[i].substr(0, cut));
+    }
+
+    size_t n = urls.size();
+    size_t found = 0;
+    double start = now();
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t len = urls[i].size(); len > 0; --len) {
+            if (rules.exists(urls[i].substr(0, len))) {
+                ++found;
+                break;
+            }
+        }
+    }
+    double naive = now() - start;
+
+    start = now();
+    for (size_t i = 0; i < n; ++i) {
+        found += rules.longest_prefix(urls[i]) != rules.end();
+    }
+    double single = now() - start;
+    sink = found;
+
+    printf("%10s %10s %12s %16s\n", "rules", "queries", "exists loop",
+           "longest_prefix");
+    printf("%10lu %10lu %12.1f %16.1f  ns/query\n",
+           (unsigned long) rules.size(), (unsigned long) n, ns(naive, n),
+           ns(single, n));
+}
+
+/// Records the end of every dictionary word found at one text position
+struct segment_ends {
+    vector<size_t> *ends;
+    void operator()(const char *, size_t length) { ends->push_back(length); }
+};
+
+/**
+ * Segments the corpus text (with its whitespace removed) into dictionary
+ * words, where the dictionary is every distinct word of the corpus. At
+ * each position the candidate words are found three ways: prefixes_of,
+ * exists() on every prefix up to the longest dictionary word, and a
+ * cursor fed one character at a time. The fewest-words segmentation is
+ * computed from the candidates to check the methods agree.
+ */
+static void bench_segment() {
+    hat_set<string> dictionary(words.begin(), words.end());
+    size_t longest = 0;
+    for (size_t i = 0; i < words.size(); ++i) {
+        longest = max(longest, words[i].size());
+    }
+
+    const int methods = 3;
+    const char *names[methods] = { "prefixes_of", "exists loop", "cursor" };
+    double times[methods];
+    size_t matches[methods];
+    size_t segments[methods];
+    size_t n = text.size();
+    string query, probe;
+    vector<size_t> ends;
+    hat_set<string>::cursor cursor = dictionary.make_cursor();
+    for (int m = 0; m < methods; ++m) {
+        // best[i] = fewest words covering text[0, i), or n + 1
+        vector<size_t> best(n + 1, n + 1);
+        best[0] = 0;
+        matches[m] = 0;
+        double start = now();
+        for (size_t i = 0; i < n; ++i) {
+            ends.clear();
+            query.assign(text, i, longest);
+            if (m == 0) {
+                segment_ends s = { &ends };
+                dictionary.prefixes_of(query, s);
+            } else if (m == 1) {
+                for (size_t len = 1; len <= query.size(); ++len) {
+                    probe.assign(query, 0, len);
+                    if (dictionary.exists(probe)) {
+                        ends.push_back(len);
+                    }
+                }
+            } else {
+                cursor.reset();
+                for (size_t len = 1; len <= query.size(); ++len) {
+                    if (!cursor.advance(query[len - 1])) {
+                        break;
+                    }
+                    if (cursor.is_word()) {
+                        ends.push_back(len);
+                    }
+                }
+            }
+
+            matches[m] += ends.size();
+            if (best[i] <= n) {
+                for (size_t j = 0; j < ends.size(); ++j) {
+                    best[i + ends[j]] = min(best[i + ends[j]], best[i] + 1);
+                }
+            }
+        }
+        times[m] = now() - start;
+        segments[m] = best[n];
+    }
+
+    printf("dictionary: %lu words, text: %lu bytes\n",
+           (unsigned long) dictionary.size(), (unsigned long) n);
+    printf("%-12s %12s %12s %12s\n", "method", "ns/position", "matches",
+           "segments");
+    for (int m = 0; m < methods; ++m) {
+        printf("%-12s %12.1f %12lu %12lu\n", names[m], ns(times[m], n),
+               (unsigned long) matches[m], (unsigned long) segments[m]);
+    }
+}
+
+/// Counts keys longer than ten characters in a parallel_for_each
+struct long_keys {
+    size_t count;
+    long_keys() : count(0) { }
+    void operator()(const char *, size_t length) { count += length > 10; }
+};
+
+/**
+ * Measures parallel_for_each scaling on a 10M-key trie from one thread up
+ * to twice the number of hardware threads, for an unordered predicate
+ * count and an ordered scan.
+ */
+static void bench_parallel() {
+    const size_t count = 10000000;
+    hat_set<string> h;
+    string key;
+    for (size_t i = 0; i < count; ++i) {
+        make_phrase(i, key);
+        h.insert(key);
+    }
+    size_t n = h.size();
+
+    // Sort every container once so the ordered scans compare fairly.
+    h.parallel_for_each(long_keys(), 1, true);
+
+    unsigned hardware = 1;
+#if __cplusplus >= 201103L
+    hardware = std::max(1u, std::thread::hardware_concurrency());
+#endif
+    printf("hardware threads: %u\n", hardware);
+    printf("%8s %12s %12s %12s %12s %10s\n", "threads", "partitions",
+           "count ns", "speedup", "ordered ns", "speedup");
+    double base = 0, ordered_base = 0;
+    for (unsigned t = 1; t <= hardware * 2; t *= 2) {
+        double start = wall();
+        vector<long_keys> parts = h.parallel_for_each(long_keys(), t);
+        double unordered = wall() - start;
+        size_t total = 0;
+        for (size_t i = 0; i < parts.size(); ++i) {
+            total += parts[i].count;
+        }
+
+        start = wall();
+        vector<long_keys> sorted = h.parallel_for_each(long_keys(), t, true);
+        double ordered = wall() - start;
+        sink = total + sorted.size();
+
+        if (t == 1) {
+            base = unordered;
+            ordered_base = ordered;
+        }
+        printf("%8u %12lu %12.1f %12.2f %12.1f %10.2f\n", t,
+               (unsigned long) parts.size(), ns(unordered, n),
+               base / unordered, ns(ordered, n), ordered_base / ordered);
+    }
+}
+
+/**
+ * Builds a map from every word of the corpus to its first position, then
+ * looks every word up. Reports the cost of each phase and the heap
+ * used by the finished map.
+ *
+ * @param name  name of the map type
+ */
+template <class M>
+static void bench_map_type(const char *name) {
+    size_t n = words.size();
+    const int rounds = 10;
+    size_t before = live_bytes();
+    double start = now();
+    M *m = new M();
+    for (size_t i = 0; i < n; ++i) {
+        m->insert(typename M::value_type(words[i], (int) i));
+    }
+    double built = now();
+    size_t heap = live_bytes() - before;
+
+    size_t total = 0;
+    for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < n; ++i) {
+            total += m->at(words[i]);
+        }
+    }
+    double looked = now();
+    sink = total;
+
+    printf("%-14s %10lu %12.1f %12.1f %12lu %10.1f\n", name,
+           (unsigned long) n, ns(built - start, n),
+           ns(looked - built, n * rounds), (unsigned long) heap,
+           (double) heap / n);
+    delete m;
+}
+
+/**
+ * Compares hat_map against std::map and std::unordered_map on a map from
+ * the corpus words to ints: insertion, lookup, and heap use. Also
+ * reports a hat_set plus a separate unordered_map, which stores every
+ * key twice.
+ */
+static void bench_map() {
+    // Warm up the allocator so the first measurement isn't penalized.
+    delete new hat_set<string>(words.begin(), words.end());
+
+    printf("%-14s %10s %12s %12s %12s %10s\n", "map", "keys", "insert ns",
+           "lookup ns", "heap bytes", "bytes/key");
+    bench_map_type<hat_map<string, int> >("hat_map");
+    bench_map_type<map<string, int> >("std::map");
+#if __cplusplus >= 201103L
+    bench_map_type<unordered_map<string, int> >("unordered_map");
+
+    size_t before = live_bytes();
+    hat_set<string> *keys = new hat_set<string>(words.begin(), words.end());
+    unordered_map<string, int> *values = new unordered_map<string, int>();
+    for (size_t i = 0; i < words.size(); ++i) {
+        (*values)[words[i]] = (int) i;
+    }
+    size_t heap = live_bytes() - before;
+    printf("%-14s %10lu %12s %12s %12lu %10.1f\n", "set+unordered",
+           (unsigned long) words.size(), "-", "-", (unsigned long) heap,
+           (double) heap / words.size());
+    delete keys;
+    delete values;
+#endif
+}
+
+/**
+ * Counts the occurrences of every word of the input. Compares the
+ * single-descent operator[] of hat_map with the find-then-insert
+ * pattern it replaces, which descends the trie twice for every new word
+ * and once more to update it, and with std::unordered_map.
+ */
+static void bench_count() {
+    const int methods = 3;
+    const char *names[methods] = { "find+insert", "operator[]",
+                                   "unordered_map" };
+    double times[methods];
+    size_t checks[methods];
+    size_t n = tokens.size();
+    for (int m = 0; m < methods; ++m) {
+        size_t check = 0;
+        double start = now();
+        if (m == 0) {
+            hat_map<string, size_t> counts;
+            for (size_t i = 0; i < n; ++i) {
+                hat_map<string, size_t>::iterator it = counts.find(tokens[i]);
+                if (it == counts.end()) {
+                    counts.insert(make_pair(tokens[i], (size_t) 0));
+                    it = counts.find(tokens[i]);
+                }
+                ++it.value();
+            }
+            check = counts.size() + counts.at(tokens[0]);
+        } else if (m == 1) {
+            hat_map<string, size_t> counts;
+            for (size_t i = 0; i < n; ++i) {
+                ++counts[tokens[i]];
+            }
+            check = counts.size() + counts.at(tokens[0]);
+#if __cplusplus >= 201103L
+        } else {
+            unordered_map<string, size_t> counts;
+            for (size_t i = 0; i < n; ++i) {
+                ++counts[tokens[i]];
+            }
+            check = counts.size() + counts.at(tokens[0]);
+#endif
+        }
+        times[m] = now() - start;
+        checks[m] = check;
+    }
+
+    printf("%lu words, %lu distinct\n", (unsigned long) n,
+           (unsigned long) words.size());
+    printf("%-14s %12s %12s\n", "method", "ns/word", "check");
+    for (int m = 0; m < methods; ++m) {
+        printf("%-14s %12.1f %12lu\n", names[m], ns(times[m], n),
+               (unsigned long) checks[m]);
+    }
+}
+
+/**
+ * Compares the cost of inserting keys with the bool insert, with
+ * insert() then find() to get an iterator, and with emplace(), which
+ * builds the iterator during the insert.
+ */
+static void bench_emplace() {
+    const char *names[] = { "words", "urls" };
+    vector<string> sets[2];
+    sets[0] = words;
+    sets[1] = make_urls(words.size() * 8);
+
+    // Warm up the allocator so the first measurement isn't penalized.
+    delete new hat_set<string>(words.begin(), words.end());
+
+    printf("%-6s %10s %12s %12s %12s\n", "data", "keys", "insert",
+           "insert+find", "emplace");
+    for (int d = 0; d < 2; ++d) {
+        const vector<string> &keys = sets[d];
+        size_t n = keys.size();
+        size_t total = 0;
+        double times[3];
+        for (int m = 0; m < 3; ++m) {
+            double start = now();
+            hat_set<string> h;
+            for (size_t i = 0; i < n; ++i) {
+                if (m == 0) {
+                    total += h.insert(keys[i]);
+                } else if (m == 1) {
+                    total += h.insert(keys[i]);
+                    total += h.find(keys[i]).key().size();
+                } else {
+                    pair<hat_set<string>::iterator, bool> result =
+                            h.emplace(keys[i]);
+                    total += result.second + result.first.key().size();
+                }
+            }
+            times[m] = now() - start;
+        }
+        sink = total;
+
+        printf("%-6s %10lu %12.1f %12.1f %12.1f  ns/key\n", names[d],
+               (unsigned long) n, ns(times[0], n), ns(times[1], n),
+               ns(times[2], n));
+    }
+}
+
+/**
+ * Counts the occurrences of every word of the input with hat_counter,
+ * hat_map<string, size_t> and std::unordered_map<string, size_t>.
+ * Reports the counting time, the heap used by the finished counts, and
+ * the time to extract the ten most frequent words.
+ */
+static void bench_counter() {
+    const int methods = 3;
+    const char *names[methods] = { "hat_counter", "hat_map",
+                                   "unordered_map" };
+    double times[methods], top_times[methods];
+    size_t heaps[methods];
+    string top[methods];
+    size_t n = tokens.size();
+    const size_t k = 10;
+
+    // Warm up the allocator so the first measurement isn't penalized.
+    delete new hat_set<string>(words.begin(), words.end());
+
+    for (int m = 0; m < methods; ++m) {
+        size_t before = live_bytes();
+        double start = now();
+        if (m == 0) {
+            hat_counter<string> *counts = new hat_counter<string>();
+            for (size_t i = 0; i < n; ++i) {
+                counts->increment(tokens[i]);
+            }
+            times[m] = now() - start;
+            heaps[m] = live_bytes() - before;
+
+            start = now();
+            top[m] = counts->top_k(k)[k - 1].first;
+            top_times[m] = now() - start;
+            delete counts;
+        } else if (m == 1) {
+            hat_map<string, size_t> *counts = new hat_map<string, size_t>();
+            for (size_t i = 0; i < n; ++i) {
+                ++(*counts)[tokens[i]];
+            }
+            times[m] = now() - start;
+            heaps[m] = live_bytes() - before;
+
+            // Partial sort of (count, word) pairs, the usual way to get
+            // the top k out of a map
+            start = now();
+            vector<pair<size_t, string> > all;
+            all.reserve(counts->size());
+            hat_map<string, size_t>::iterator it;
+            for (it = counts->begin(); it != counts->end(); ++it) {
+                all.push_back(make_pair(~it.value(), it.key()));
+            }
+            partial_sort(all.begin(), all.begin() + k, all.end());
+            top[m] = all[k - 1].second;
+            top_times[m] = now() - start;
+            delete counts;
+#if __cplusplus >= 201103L
+        } else {
+            unordered_map<string, size_t> *counts =
+                    new unordered_map<string, size_t>();
+            for (size_t i = 0; i < n; ++i) {
+                ++(*counts)[tokens[i]];
+            }
+            times[m] = now() - start;
+            heaps[m] = live_bytes() - before;
+
+            start = now();
+            vector<pair<size_t, string> > all;
+            all.reserve(counts->size());
+            unordered_map<string, size_t>::iterator it;
+            for (it = counts->begin(); it != counts->end(); ++it) {
+                all.push_back(make_pair(~it->second, it->first));
+            }
+            partial_sort(all.begin(), all.begin() + k, all.end());
+            top[m] = all[k - 1].second;
+            top_times[m] = now() - start;
+            delete counts;
+#endif
+        }
+    }
+
+    printf("%lu words, %lu distinct\n", (unsigned long) n,
+           (unsigned long) words.size());
+    printf("%-14s %10s %12s %12s %10s\n", "method", "ns/word",
+           "heap bytes", "top 10 ms", "10th");
+    for (int m = 0; m < methods; ++m) {
+        printf("%-14s %10.1f %12lu %12.2f %10s\n", names[m],
+               ns(times[m], n), (unsigned long) heaps[m],
+               top_times[m] * 1e3, top[m].c_str());
+    }
+}
+
+/// Counts the matches of a fuzzy_search
+struct match_count {
+    size_t count;
+    void operator()(const char *, size_t, size_t) { ++count; }
+};
+
+/**
+ * Gets the Levenshtein distance between two strings, giving up once it
+ * is certain to exceed @a k. The full-scan baseline of bench_fuzzy.
+ *
+ * @param row  scratch row of at least b.size() + 1 entries
+ * @return  the distance, or k + 1 if it exceeds @a k
+ */
+static size_t bounded_distance(const string &a, const string &b, size_t k,
+                               vector<size_t> &row) {
+    size_t m = b.size();
+    if (max(a.size(), m) - min(a.size(), m) > k) {
+        return k + 1;
+    }
+    for (size_t j = 0; j <= m; ++j) {
+        row[j] = j;
+    }
+    for (size_t i = 1; i <= a.size(); ++i) {
+        size_t diagonal = row[0];
+        size_t best = row[0] = i;
+        for (size_t j = 1; j <= m; ++j) {
+            size_t above = row[j];
+            row[j] = min(min(row[j] + 1, row[j - 1] + 1),
+                         diagonal + (a[i - 1] != b[j - 1]));
+            diagonal = above;
+            best = min(best, row[j]);
+        }
+        if (best > k) {
+            return k + 1;
+        }
+    }
+    return row[m];
+}
+
+/**
+ * Compares fuzzy_search against scanning every word with a bounded
+ * edit distance, for k = 1 and 2. The dictionary is every distinct word
+ * of the input, and each query is a dictionary word with one random
+ * edit (insertion, deletion or substitution).
+ */
+static void bench_fuzzy() {
+    hat_set<string> dictionary(words.begin(), words.end());
+    vector<string> queries;
+    srand(7);
+    for (int i = 0; i < 1000; ++i) {
+        string q = words[rand() % words.size()];
+        size_t pos = rand() % (q.size() + 1);
+        char ch = 'a' + rand() % 26;
+        switch (rand() % 3) {
+        case 0:
+            q.insert(pos, 1, ch);
+            break;
+        case 1:
+            if (pos < q.size()) {
+                q.erase(pos, 1);
+                break;
+            }
+            // fall through
+        default:
+            if (pos < q.size()) {
+                q[pos] = ch;
+            }
+        }
+        queries.push_back(q);
+    }
+
+    vector<size_t> row;
+    printf("dictionary: %lu words, %lu queries\n",
+           (unsigned long) dictionary.size(), (unsigned long) queries.size());
+    printf("%4s %14s %14s %12s %12s\n", "k", "scan us", "fuzzy us",
+           "speedup", "matches");
+    for (size_t k = 1; k <= 2; ++k) {
+        size_t scanned = 0;
+        double start = now();
+        for (size_t q = 0; q < queries.size(); ++q) {
+            row.resize(queries[q].size() + 1);
+            for (size_t i = 0; i < words.size(); ++i) {
+                scanned += bounded_distance(words[i], queries[q], k, row) <= k;
+            }
+        }
+        double scan = now() - start;
+
+        start = now();
+        match_count found = { 0 };
+        for (size_t q = 0; q < queries.size(); ++q) {
+            found = dictionary.fuzzy_search(queries[q], k, found);
+        }
+        double fuzzy = now() - start;
+        sink = scanned;
+
+        size_t n = queries.size();
+        printf("%4lu %14.1f %14.1f %12.1f %5lu / %lu\n", (unsigned long) k,
+               ns(scan, n) / 1e3, ns(fuzzy, n) / 1e3, scan / fuzzy,
+               (unsigned long) found.count, (unsigned long) scanned);
+    }
+}
+
+/// Counts the calls made by a traversal
+struct key_count {
+    size_t count;
+    void operator()(const char *, size_t) { ++count; }
+};
+
+#if __cplusplus >= 201103L
+/// Counts the keys of a scan that match a regex
+struct regex_count {
+    const regex *pattern;
+    size_t count;
+    void operator()(const char *key, size_t length) {
+        count += regex_match(key, key + length, *pattern);
+    }
+};
+
+/**
+ * Translates a glob pattern (no escapes) into an ECMAScript regex.
+ */
+static string glob_to_regex(const string &glob) {
+    string result;
+    for (size_t i = 0; i < glob.size(); ++i) {
+        char ch = glob[i];
+        if (ch == '*') {
+            result += ".*";
+        } else if (ch == '?') {
+            result += '.';
+        } else if (ch == '[') {
+            size_t end = glob.find(']', i + 1);
+            string set = glob.substr(i + 1, end - i - 1);
+            if (!set.empty() && set[0] == '!') {
+                set[0] = '^';
+            }
+            result += "[" + set + "]";
+            i = end;
+        } else if (strchr("\\^$.|+(){}", ch)) {
+            result += '\\';
+            result += ch;
+        } else {
+            result += ch;
+        }
+    }
+    return result;
+}
+#endif
+
+/**
+ * Compares match_pattern against a full scan that tests every key with
+ * std::regex, on the distinct words of the input and on URLs built from
+ * them.
+ */
+static void bench_pattern() {
+#if __cplusplus >= 201103L
+    const char *names[] = { "words", "urls" };
+    vector<string> sets[2];
+    sets[0] = words;
+    sets[1] = make_urls(words.size() * 8);
+    const char *patterns[2][5] = {
+        { "th*", "b?t*", "[A-Z]*ah", "*tion", "*a*e*i*o*" },
+        { "http://www.the.com/*", "http://www.?o?.com/*",
+          "*/[A-Z]*.html", "*/lord/*", "*a*e*i*o*u*" }
+    };
+
+    printf("%-6s %-24s %10s %12s %12s %10s\n", "data", "pattern",
+           "matches", "regex us", "pattern us", "speedup");
+    for (int d = 0; d < 2; ++d) {
+        hat_set<string> h(sets[d].begin(), sets[d].end());
+        for (int p = 0; p < 5; ++p) {
+            regex re(glob_to_regex(patterns[d][p]));
+            regex_count scan = { &re, 0 };
+            double start = now();
+            scan = h.for_each(scan);
+            double scanned = now() - start;
+
+            const int rounds = 10;
+            key_count found = { 0 };
+            start = now();
+            for (int r = 0; r < rounds; ++r) {
+                found = h.match_pattern(patterns[d][p], found);
+            }
+            double matched = (now() - start) / rounds;
+
+            printf("%-6s %-24s %10lu %12.1f %12.1f %10.1f\n", names[d],
+                   patterns[d][p], (unsigned long) scan.count,
+                   scanned * 1e6, matched * 1e6, scanned / matched);
+            if (found.count != scan.count * rounds) {
+                printf("mismatch: %lu\n",
+                       (unsigned long) (found.count / rounds));
+            }
+        }
+    }
+#endif
+}
+
+/**
+ * Compares top_k() on a hat_scored_map with listing every key under the
+ * prefix with prefix_range() and partially sorting them by score, for
+ * autocompletion queries of one to three characters. The queries are
+ * prefixes of the input tokens, so popular prefixes come up as often as
+ * they would from users. Words are scored by frequency, and phrases by
+ * the product of the frequencies of their words. Smaller containers put
+ * more of the trie under the subtree maxima.
+ */
+static void bench_complete() {
+    const char *names[] = { "words", "phrases" };
+    const size_t k = 10;
+    const size_t queries = 1000;
+
+    hat_map<string, double> freq;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        freq[tokens[i]] += 1;
+    }
+
+    const size_t bursts[] = { 16384, 1024 };
+
+    printf("%-8s %8s %6s %6s %12s %12s %10s\n", "data", "keys", "burst",
+           "prefix", "scan us", "top_k us", "speedup");
+    for (int run = 0; run < 4; ++run) {
+        int d = run / 2;
+        hat_scored_map<string> h(hat_trie_traits(bursts[run % 2]));
+        if (d == 0) {
+            for (size_t i = 0; i < words.size(); ++i) {
+                h.insert_or_assign(words[i], freq.at(words[i]));
+            }
+        } else {
+            size_t n = words.size();
+            string key;
+            for (size_t i = 0; i < n * 20; ++i) {
+                make_phrase(i, key);
+                h.insert_or_assign(key, freq.at(words[i % n]) *
+                                        freq.at(words[(i / n) % n]));
+            }
+        }
+
+        for (size_t length = 1; length <= 3; ++length) {
+            vector<string> prefixes;
+            for (size_t i = 0; prefixes.size() < queries; ++i) {
+                const string &token = tokens[(i * 7919) % tokens.size()];
+                if (token.size() >= length) {
+                    prefixes.push_back(token.substr(0, length));
+                }
+            }
+
+            double start = now();
+            vector<pair<double, string> > scanned;
+            for (size_t q = 0; q < queries; ++q) {
+                pair<hat_scored_map<string>::iterator,
+                     hat_scored_map<string>::iterator> range =
+                        h.prefix_range(prefixes[q]);
+                vector<pair<double, string> > all;
+                for (; range.first != range.second; ++range.first) {
+                    all.push_back(make_pair(-range.first.score(),
+                                            range.first.key()));
+                }
+                size_t top = min(k, all.size());
+                partial_sort(all.begin(), all.begin() + top, all.end());
+                sink += top;
+                if (q == queries - 1) {
+                    scanned.assign(all.begin(), all.begin() + top);
+                }
+            }
+            double scan = (now() - start) / queries;
+
+            start = now();
+            vector<hat_scored_map<string>::value_type> best;
+            for (size_t q = 0; q < queries; ++q) {
+                best = h.top_k(prefixes[q], k);
+                sink += best.size();
+            }
+            double search = (now() - start) / queries;
+
+            printf("%-8s %8lu %6lu %6lu %12.2f %12.2f %10.1f\n", names[d],
+                   (unsigned long) h.size(), (unsigned long) bursts[run % 2],
+                   (unsigned long) length,
+                   scan * 1e6, search * 1e6, scan / search);
+            bool same = best.size() == scanned.size();
+            for (size_t i = 0; same && i < best.size(); ++i) {
+                same = best[i].first == scanned[i].second &&
+                       best[i].second == -scanned[i].first;
+            }
+            if (!same) {
+                printf("mismatch on \"%s\"\n", prefixes.back().c_str());
+            }
+        }
+    }
+}
+
+/**
+ * Adds the keys it is called with to a set, keeping only the keys that
+ * are (or are not) in another set.
+ */
+struct set_filter {
+    const hat_set<string> *other;  // set to probe, or NULL to keep all
+    bool found;
+    hat_set<string> *out;
+    string key;
+
+    void operator()(const char *s, size_t length) {
+        key.assign(s, length);
+        if (other == NULL || other->exists(key) == found) {
+            out->insert(key);
+        }
+    }
+};
+
+/**
+ * Builds the @a i th key of a data set of sorted numeric ids with a
+ * word suffix, like dated log keys. Consecutive keys share long
+ * prefixes, so ranges of keys fill whole subtrees.
+ *
+ * @param i    index of the key
+ * @param key  receives the key
+ */
+static void make_id(size_t i, string &key) {
+    char buffer[32];
+    sprintf(buffer, "%010lu/", (unsigned long) (i / 16));
+    key = buffer;
+    key += words[i % 16];
+}
+
+/**
+ * Compares hat_set::set_union, set_intersection and set_difference with
+ * iterating one set and calling exists() on the other, on two sets of
+ * n keys that overlap by half.
+ *
+ * With phrases, both sets hold every first word, so the tries line up
+ * all the way down and every container has words from both sides. With
+ * ids, the sets are two overlapping ranges, so most subtrees are only
+ * on one side and are copied or skipped whole.
+ */
+static void bench_algebra() {
+    const char *names[] = { "union", "intersection", "difference" };
+    const char *layouts[] = { "phrases", "ids" };
+    size_t sizes[] = { 100000, 400000, 1600000 };
+
+    printf("%-8s %-12s %8s %10s %12s %12s %8s %10s\n", "data",
+           "operation", "n", "result", "probe ms", "walk ms", "speedup",
+           "Mkeys/s");
+    for (size_t z = 0; z < 2 * sizeof(sizes) / sizeof(*sizes); ++z) {
+        int layout = z / (sizeof(sizes) / sizeof(*sizes));
+        size_t n = sizes[z % (sizeof(sizes) / sizeof(*sizes))];
+        hat_set<string> a, b;
+        string key;
+        for (size_t i = 0; i < n; ++i) {
+            if (layout == 0) {
+                make_phrase(i, key);
+                a.insert(key);
+                make_phrase(i + n / 2, key);
+            } else {
+                make_id(i, key);
+                a.insert(key);
+                make_id(i + n / 2, key);
+            }
+            b.insert(key);
+        }
+
+        for (int op = 0; op < 3; ++op) {
+            double start = now();
+            hat_set<string> *probed;
+            if (op == 0) {
+                probed = new hat_set<string>(a);
+                set_filter f = { NULL, false, probed, "" };
+                b.for_each(f);
+            } else {
+                probed = new hat_set<string>();
+                set_filter f = { &b, op == 1, probed, "" };
+                a.for_each(f);
+            }
+            double probe = now() - start;
+
+            start = now();
+            hat_set<string> walked;
+            if (op == 0) {
+                walked.set_union(a, b);
+            } else if (op == 1) {
+                walked.set_intersection(a, b);
+            } else {
+                walked.set_difference(a, b);
+            }
+            double walk = now() - start;
+
+            printf("%-8s %-12s %8lu %10lu %12.1f %12.1f %8.1f %10.1f\n",
+                   layouts[layout], names[op], (unsigned long) n,
+                   (unsigned long) walked.size(), probe * 1e3, walk * 1e3,
+                   probe / walk, 2 * n / walk / 1e6);
+            if (walked.size() != probed->size()) {
+                printf("mismatch: %lu\n", (unsigned long) probed->size());
+            }
+            delete probed;
+        }
+    }
+}
+
+struct diff_count {
+    size_t count;
+
+    void operator()(const char *, size_t, bool) {
+        ++count;
+    }
+};
+
+struct missing_count {
+    const hat_set<string> *other;
+    size_t count;
+    string key;
+
+    void operator()(const char *s, size_t length) {
+        key.assign(s, length);
+        count += other->exists(key) == false;
+    }
+};
+
+/**
+ * Measures hat_trie_traits::digests on two sets of n keys that differ in
+ * 16 keys. Reports the cost of keeping digests during insertion, then
+ * compares operator== and finding the differing keys with and without
+ * digests. Without digests, diff() still walks the tries together, but
+ * has to look at every word; the probe column iterates one set and
+ * calls exists() on the other, both ways.
+ */
+static void bench_digest() {
+    const char *layouts[] = { "phrases", "ids" };
+    size_t sizes[] = { 100000, 400000, 1600000 };
+    const size_t changes = 16;
+
+    printf("%-8s %8s %10s %10s %10s %10s %10s %10s %10s\n", "data", "n",
+           "insert ms", "+digests", "== ms", "== us", "probe ms",
+           "diff ms", "+digests us");
+    for (size_t z = 0; z < 2 * sizeof(sizes) / sizeof(*sizes); ++z) {
+        int layout = z / (sizeof(sizes) / sizeof(*sizes));
+        size_t n = sizes[z % (sizeof(sizes) / sizeof(*sizes))];
+        vector<string> keys(n);
+        for (size_t i = 0; i < n; ++i) {
+            if (layout == 0) {
+                make_phrase(i, keys[i]);
+            } else {
+                make_id(i, keys[i]);
+            }
+        }
+
+        hat_trie_traits traits;
+        traits.digests = true;
+        double insert[2];
+        hat_set<string> a[2], b[2];
+        for (int d = 0; d < 2; ++d) {
+            double start = now();
+            a[d] = hat_set<string>(d ? traits : hat_trie_traits());
+            a[d].insert(keys.begin(), keys.end());
+            insert[d] = now() - start;
+
+            // b drops every (n / changes)th key of a and has as many
+            // keys a doesn't.
+            b[d] = hat_set<string>(d ? traits : hat_trie_traits());
+            b[d].insert(keys.rbegin(), keys.rend());
+            for (size_t i = 0; i < changes; ++i) {
+                b[d].erase(keys[i * (n / changes)]);
+                b[d].insert(keys[i * (n / changes)] + "~");
+            }
+        }
+
+        double start = now();
+        bool equal = a[0] == b[0];
+        double plain_equal = now() - start;
+        start = now();
+        const int repeats = 1000;
+        for (int r = 0; r < repeats; ++r) {
+            equal = equal || a[1] == b[1];
+        }
+        double digest_equal = (now() - start) / repeats;
+
+        start = now();
+        missing_count probe = { &b[0], 0, "" };
+        probe = a[0].for_each(probe);
+        missing_count back = { &a[0], 0, "" };
+        back = b[0].for_each(back);
+        double probe_time = now() - start;
+
+        start = now();
+        diff_count plain = { 0 };
+        plain = a[0].diff(b[0], plain);
+        double plain_diff = now() - start;
+        start = now();
+        diff_count digested = { 0 };
+        for (int r = 0; r < repeats; ++r) {
+            digested.count = 0;
+            digested = a[1].diff(b[1], digested);
+        }
+        double digest_diff = (now() - start) / repeats;
+
+        printf("%-8s %8lu %10.1f %9.1f%% %10.1f %10.3f %10.1f %10.1f "
+               "%10.1f\n", layouts[layout], (unsigned long) n,
+               insert[0] * 1e3, (insert[1] / insert[0] - 1) * 100,
+               plain_equal * 1e3, digest_equal * 1e6, probe_time * 1e3,
+               plain_diff * 1e3, digest_diff * 1e6);
+        size_t expected = probe.count + back.count;
+        if (equal || plain.count != expected ||
+                digested.count != expected) {
+            printf("mismatch: %lu %lu %lu\n", (unsigned long) expected,
+                   (unsigned long) plain.count,
+                   (unsigned long) digested.count);
+        }
+    }
+}
+
+struct benchmark {
+    const char *name;
+    void (*run)();
+};
+
+static const benchmark benchmarks[] = {
+    { "burst", bench_burst },
+    { "ordered", bench_ordered },
+    { "reverse", bench_reverse },
+    { "scan", bench_scan },
+    { "foreach", bench_foreach },
+    { "parallel", bench_parallel },
+    { "longest_prefix", bench_longest_prefix },
+    { "segment", bench_segment },
+    { "map", bench_map },
+    { "count", bench_count },
+    { "emplace", bench_emplace },
+    { "counter", bench_counter },
+    { "fuzzy", bench_fuzzy },
+    { "pattern", bench_pattern },
+    { "complete", bench_complete },
+    { "algebra", bench_algebra },
+    { "digest", bench_digest },
+};
+
+int main(int argc, char **argv) {
+    // Read the input words.
+    set<string> seen;
+    string reader;
+    while (cin >> reader) {
+        if (seen.insert(reader).second) {
+            words.push_back(reader);
+        }
+        tokens.push_back(reader);
+        if (text.size() < (1 << 20)) {
+            text += reader;
+        }
+    }
+
+    int count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    bool ran = false;
+    for (int i = 0; i < count; ++i) {
+        if (argc < 2 || strcmp(argv[1], benchmarks[i].name) == 0) {
+            printf("== %s ==\n", benchmarks[i].name);
+            benchmarks[i].run();
+            ran = true;
+        }
+    }
+    if (!ran) {
+        fprintf(stderr, "unknown benchmark: %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
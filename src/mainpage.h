@@ -13,36 +13,56 @@
  * @li @c count(string)
  * @li @c empty()
  * @li @c end()
+ * @li @c equal_range(string)
  * @li @c erase(string)
  * @li @c erase(iterator)
  * @li @c exists(string)
  * @li @c find(string)
  * @li @c insert(record)
  * @li @c insert(iterator, iterator)
+ * @li @c lower_bound(string)
+ * @li @c prefix_range(string)
  * @li @c size()
  * @li @c swap(hat_set &)
+ * @li @c upper_bound(string)
  * @li forward iteraton and iterator dereferencing
+ * @li allocation-free dereferencing with @c iterator::key()
+ * @li reverse iteration with @c rbegin(), @c rend() and @c operator--
+ * @li ordered iteration with @c ordered_begin()
  *
  * In a @c hat_set, @c record is a @c std::string. In a @c hat_map, @c record
  * is a @c pair<std::string, T>.
  *
- * @section Future
+ * @c hat_map also implements @c at(string), @c operator[](string),
+ * @c insert_or_assign(string, T) and @c try_emplace(string, T), and its
+ * iterators have a @c value() accessor. Values are stored next to their
+ * keys, so the mapped type must be trivially copyable, and they are
+ * unaligned: @c operator[], @c at() and @c value() return a
+ * @c mapped_reference that copies the value in and out, not a @c T&.
  *
- * Here is a list of major operations that have yet to be implemented:
+ * @c hat_counter counts how many times each string is added with
+ * @c increment(string, delta), and finds the most frequent strings with
+ * @c top_k(k). Its counters are stored like @c hat_map values and widen
+ * from one to eight bytes as the counts grow.
  *
- * @li reverse iteration
- * @li @c lower_bound(string)
- * @li @c upper_bound(string)
- * @li @c equal_range(string)
- * @li @c match_prefix(string) (an extension)
+ * @c hat_multiset stores each distinct string once with its number of
+ * occurrences. Its iterators visit every occurrence like a
+ * @c std::multiset, and @c counted_begin() visits each distinct string
+ * once with its count.
+ *
+ * @c hat_scored_map maps strings to scores for autocompletion. Every node
+ * and container keeps the greatest score beneath it, so
+ * @c top_k(prefix, k) finds the best completions of a prefix without
+ * visiting every string that starts with it.
  *
  * @section Usage
  *
  * @subsection Installation
- * Copy all the headers into a directory in your PATH and include @c hat_set.h
+ * Copy all the headers into a directory in your PATH and include @c hat_set.h,
+ * @c hat_map.h, @c hat_counter.h, @c hat_multiset.h or @c hat_scored_map.h
  * in your project. Some of the headers require @c stdint.h, which isn't
- * available by default on most Windows platforms. You can find a compatible
- * version of the header on Google.
+ * available by default on most Windows platforms. You can find a
+ * compatible version of the header on Google.
  *
  * All classes are defined in namespace stx.
  *
@@ -72,16 +92,37 @@
  *
  * @li @c exists(string) -- returns true iff there is a record in the trie
  * with a matching key
- * @li @c match_prefix(string) -- returns a set of all strings that have
- * the parameter as a prefix. To be implemented.
+ * @li @c for_each(f) and @c for_each_prefix(string, f) -- call a functor
+ * on every string (with the given prefix) without iterator overhead
+ * @li @c longest_prefix(string) -- finds the longest string that is a
+ * prefix of the parameter
+ * @li @c prefixes_of(string, f) -- calls a functor on every string that
+ * is a prefix of the parameter
+ * @li @c make_cursor() -- returns a cursor that matches a prefix one
+ * character at a time, for tokenizers and streaming matchers
+ * @li @c parallel_for_each(f, threads, ordered) -- visits the strings on
+ * several threads, one functor per partition of the key space
+ * @li @c prefix_range(string) -- returns a pair of iterators spanning all
+ * the strings that have the parameter as a prefix, in sorted order
+ * @li @c fuzzy_search(string, k, f) -- calls a functor on every string
+ * within edit distance k of the parameter
+ * @li @c match_pattern(glob, f) -- calls a functor on every string that
+ * matches a glob pattern with @c ?, @c * and @c [a-z] classes
+ * @li @c set_union(lhs, rhs), @c set_intersection(lhs, rhs),
+ * @c set_difference(lhs, rhs) -- combine two sets by walking both tries
+ * together, copying or skipping subtrees that only one side has
+ * @li @c diff(rhs, f) -- calls a functor on every string that is in only
+ * one of two sets. With @c hat_trie_traits::digests on, subtrees that hold
+ * the same strings are skipped, and operator== takes O(1)
  *
  * @section Deviations
  * The hat@_trie interface differs from the standard in a few ways:
  *
  * @li @c insert(record) -- returns a @c bool rather than a <tt> pair<iterator,
- * bool></tt>. See the HTML documentation for rationale.
- * @li iterator traversals are unordered. Ordered traversals are in the
- * works.
+ * bool></tt>. @c emplace(string) returns the pair. See the HTML
+ * documentation for rationale.
+ * @li traversals starting at @c begin() are unordered inside each
+ * container. Use @c ordered_begin() for a sorted traversal.
  *
  * @section Testing
  * The test files in the test/ directory achieve > 95% coverage of hat_trie.h
@@ -13,6 +13,7 @@
 #include <string>
 #include <set>
 #include <stack>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 #include <boost/foreach.hpp>
@@ -83,6 +84,7 @@ TEST(testFind)
         // dereference to not only the same value, but the same
         // location in memory
         BOOST_CHECK(*(ah.find(*it)) == *it);
+        BOOST_CHECK(it.length() == strlen(*it));
     }
 }
 
@@ -114,6 +116,41 @@ TEST(testTraits)
     check_equal(a, c);
 }
 
+TEST(testSlotGrowth)
+{
+    // Start as a linear list and grow up to 64 slots
+    array_hash_traits traits(64, 32, 1, 2);
+    array_hash<string> ah(traits);
+    BOOST_CHECK_EQUAL(ah.slot_count(), 1);
+
+    set<string> inserted;
+    for (int i = 0; i < 1000; ++i) {
+        string s(1 + i % 13, 'a' + i % 26);
+        s += (char)('a' + i / 26 % 26);
+        s += (char)('a' + i / 676);
+        BOOST_CHECK(ah.insert(s));
+        inserted.insert(s);
+        BOOST_CHECK(ah.slot_count() <= 64);
+        BOOST_CHECK((int) ah.size() <= 2 * ah.slot_count() ||
+                    ah.slot_count() == 64);
+    }
+    BOOST_CHECK_EQUAL(ah.slot_count(), 64);
+    foreach (const string& str, inserted) {
+        BOOST_CHECK(ah.exists(str));
+    }
+    check_equal(ah, inserted);
+
+    // Tables with different slot counts still compare equal
+    array_hash<string> full(inserted.begin(), inserted.end(),
+                            array_hash_traits(512, 32, 512));
+    BOOST_CHECK_EQUAL(full.slot_count(), 512);
+    BOOST_CHECK(ah == full);
+
+    // Clearing starts over at the initial slot count
+    ah.clear();
+    BOOST_CHECK_EQUAL(ah.slot_count(), 1);
+}
+
 TEST(testEraseByString)
 {
     array_hash<string> ah(data.begin(), data.end());
@@ -212,6 +249,76 @@ TEST(testReverseIteration)
     }
 }
 
+TEST(testSortedIteration)
+{
+    array_hash<string> ah(data.begin(), data.end());
+    ah.insert("b");
+    ah.insert("aa");
+    data.insert("b");
+    data.insert("aa");
+
+    // Forward
+    vector<string> forward;
+    for (array_hash<string>::iterator it = ah.sorted_begin(); it != ah.end(); ++it) {
+        forward.push_back(*it);
+    }
+    BOOST_CHECK(forward == vector<string>(data.begin(), data.end()));
+
+    // Backward
+    vector<string> backward;
+    array_hash<string>::iterator it = ah.sorted_end();
+    while (it != ah.sorted_begin()) {
+        --it;
+        backward.push_back(*it);
+    }
+    BOOST_CHECK(backward == vector<string>(data.rbegin(), data.rend()));
+
+    // Bounds
+    BOOST_CHECK_EQUAL(*ah.sorted_lower_bound("ab"), "ab");
+    BOOST_CHECK_EQUAL(*ah.sorted_upper_bound("ab"), "abc");
+    BOOST_CHECK_EQUAL(*ah.sorted_lower_bound("abd"), "b");
+    BOOST_CHECK(ah.sorted_lower_bound("c") == ah.end());
+
+    // Erasing through a sorted iterator, then sorting again
+    ah.erase(ah.sorted_lower_bound("aa"));
+    BOOST_CHECK(!ah.exists("aa"));
+    BOOST_CHECK_EQUAL(*ah.sorted_upper_bound("a"), "ab");
+}
+
+TEST(testLongestPrefix)
+{
+    array_hash<string> ah(data.begin(), data.end());
+    BOOST_CHECK(string(*ah.longest_prefix("abd")) == "ab");
+    BOOST_CHECK(string(*ah.longest_prefix("abcabc")) == "abc");
+    BOOST_CHECK(string(*ah.longest_prefix("b")) == "");
+
+    // Erasing doesn't stop the other lengths from being found
+    ah.erase("ab");
+    ah.erase("");
+    BOOST_CHECK(string(*ah.longest_prefix("abd")) == "a");
+    BOOST_CHECK(ah.longest_prefix("b") == ah.end());
+}
+
+// Records the lengths passed to each_prefix
+struct lengths
+{
+    vector<size_t> found;
+    void operator()(size_t length) { found.push_back(length); }
+};
+
+TEST(testEachPrefix)
+{
+    array_hash<string> ah(data.begin(), data.end());
+    lengths l;
+    ah.each_prefix("abd", l);
+    BOOST_CHECK(l.found.size() == 3);
+    BOOST_CHECK(l.found[0] == 0 && l.found[1] == 1 && l.found[2] == 2);
+
+    l.found.clear();
+    ah.each_prefix("b", l);
+    BOOST_CHECK(l.found.size() == 1 && l.found[0] == 0);
+}
+
 TEST(testIteratorBounds)
 {
     array_hash<string> ah(data.begin(), data.end());
@@ -264,5 +371,36 @@ TEST(testSwap)
     BOOST_CHECK(b == control);
 }
 
+/// Widens one byte values to two bytes, adding 1000
+struct widen {
+    void operator()(const char *from, char *to) const {
+        uint16_t value = (uint8_t) *from + 1000;
+        memcpy(to, &value, sizeof(value));
+    }
+};
+
+TEST(testResizeValues)
+{
+    array_hash_traits traits(512, 32, 1, 4, 1);
+    array_hash<string> ah(traits);
+    bool inserted;
+    foreach (const string &s, data) {
+        *ah.find_or_insert(s.c_str(), inserted).value() = (char) s.size();
+    }
+
+    size_t bytes = ah.bytes();
+    ah.resize_values(2, widen());
+    BOOST_CHECK_EQUAL(ah.traits().value_size, 2);
+    BOOST_CHECK_EQUAL(ah.bytes(), bytes + data.size());
+    BOOST_CHECK_EQUAL(ah.size(), data.size());
+    foreach (const string &s, data) {
+        array_hash<string>::iterator it = ah.find(s.c_str());
+        BOOST_REQUIRE(it != ah.end());
+        uint16_t value;
+        memcpy(&value, it.value(), sizeof(value));
+        BOOST_CHECK_EQUAL(value, s.size() + 1000);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
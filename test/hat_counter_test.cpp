@@ -0,0 +1,153 @@
+/*
+ * hat_counter_test.cpp
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#define TEST BOOST_AUTO_TEST_CASE
+
+#include <string>
+#include <map>
+#include <vector>
+#include <fstream>
+
+#include <boost/test/unit_test.hpp>
+
+#include "../src/hat_counter.h"
+
+using namespace stx;
+using namespace std;
+
+struct HatCounterData
+{
+    map<string, uint64_t> counts;
+    uint64_t total;
+
+    HatCounterData() : total(0)
+    {
+        ifstream file;
+        file.open("test/inputs/kjv");
+        if (!file) {
+            throw "file not opened";
+        }
+
+        string reader;
+        while (file >> reader) {
+            ++counts[reader];
+            ++total;
+        }
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(hatCounter, HatCounterData)
+
+TEST(testIncrement)
+{
+    // A small burst threshold makes counters move through bursts, and
+    // the most frequent words widen the counters to two bytes.
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    hat_counter<string> h(traits);
+    ifstream file("test/inputs/kjv");
+    string word;
+    while (file >> word) {
+        h.increment(word);
+    }
+    BOOST_CHECK_EQUAL(h.size(), counts.size());
+    BOOST_CHECK_EQUAL(h.total(), total);
+    BOOST_CHECK_EQUAL(h.width(), 2);
+
+    map<string, uint64_t>::iterator mit = counts.begin();
+    hat_counter<string>::iterator it;
+    for (it = h.ordered_begin(); it != h.end(); ++it, ++mit) {
+        BOOST_REQUIRE(mit != counts.end());
+        BOOST_CHECK_EQUAL(it.key(), mit->first);
+        BOOST_CHECK_EQUAL(it.count(), mit->second);
+    }
+    BOOST_CHECK_EQUAL(h.count("not a word in the data"), 0u);
+}
+
+TEST(testWiden)
+{
+    hat_counter<string> h;
+    h.increment("a");
+    h.increment("b", 255);
+    BOOST_CHECK_EQUAL(h.width(), 1);
+    BOOST_CHECK_EQUAL(h.increment("b"), 256u);
+    BOOST_CHECK_EQUAL(h.width(), 2);
+    h.increment("c", (uint64_t) 1 << 40);
+    BOOST_CHECK_EQUAL(h.width(), 8);
+    BOOST_CHECK_EQUAL(h.count("a"), 1u);
+    BOOST_CHECK_EQUAL(h.count("b"), 256u);
+    BOOST_CHECK_EQUAL(h.count("c"), (uint64_t) 1 << 40);
+
+    BOOST_CHECK_EQUAL(h.erase("c"), (uint64_t) 1 << 40);
+    BOOST_CHECK_EQUAL(h.total(), 257u);
+    h.clear();
+    BOOST_CHECK_EQUAL(h.width(), 1);
+    BOOST_CHECK(h.empty());
+}
+
+TEST(testTopK)
+{
+    hat_counter<string> h;
+    map<string, uint64_t>::iterator mit;
+    for (mit = counts.begin(); mit != counts.end(); ++mit) {
+        h.increment(mit->first, mit->second);
+    }
+
+    // Highest count first, then string order
+    vector<pair<uint64_t, string> > expected;
+    for (mit = counts.begin(); mit != counts.end(); ++mit) {
+        expected.push_back(make_pair(~mit->second, mit->first));
+    }
+    sort(expected.begin(), expected.end());
+
+    size_t sizes[] = { 0, 1, 10, 1000, counts.size() + 5 };
+    for (int i = 0; i < 5; ++i) {
+        vector<pair<string, uint64_t> > top = h.top_k(sizes[i]);
+        BOOST_CHECK_EQUAL(top.size(), min(sizes[i], counts.size()));
+        for (size_t j = 0; j < top.size(); ++j) {
+            BOOST_CHECK_EQUAL(top[j].first, expected[j].second);
+            BOOST_CHECK_EQUAL(top[j].second, ~expected[j].first);
+        }
+    }
+}
+
+TEST(testDecrement)
+{
+    hat_counter<string> h;
+    hat_counter<string>::iterator it = h.insert("a", 300);
+    BOOST_CHECK_EQUAL(it.key(), "a");
+    BOOST_CHECK_EQUAL(it.count(), 300u);
+    BOOST_CHECK_EQUAL(h.width(), 2);
+
+    BOOST_CHECK_EQUAL(h.decrement("a", 100), 200u);
+    BOOST_CHECK_EQUAL(h.total(), 200u);
+    BOOST_CHECK_EQUAL(h.decrement("a", 500), 0u);
+    BOOST_CHECK(h.empty());
+    BOOST_CHECK_EQUAL(h.total(), 0u);
+    BOOST_CHECK_EQUAL(h.decrement("a"), 0u);
+}
+
+TEST(testZeroDelta)
+{
+    // Adding nothing must not leave a string with a count of 0 behind.
+    hat_counter<string> h;
+    BOOST_CHECK_EQUAL(h.increment("a", 0), 0u);
+    BOOST_CHECK(h.insert("b", 0) == h.end());
+    BOOST_CHECK(h.empty());
+    BOOST_CHECK_EQUAL(h.size(), 0u);
+    BOOST_CHECK_EQUAL(h.count("a"), 0u);
+    BOOST_CHECK(h.find("b") == h.end());
+
+    h.increment("a", 3);
+    BOOST_CHECK_EQUAL(h.increment("a", 0), 3u);
+    hat_counter<string>::iterator it = h.insert("a", 0);
+    BOOST_REQUIRE(it != h.end());
+    BOOST_CHECK_EQUAL(it.count(), 3u);
+    BOOST_CHECK_EQUAL(h.size(), 1u);
+    BOOST_CHECK_EQUAL(h.total(), 3u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,211 @@
+/*
+ * hat_map_test.cpp
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#define TEST BOOST_AUTO_TEST_CASE
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/test/unit_test.hpp>
+
+#include "../src/hat_map.h"
+
+using namespace stx;
+using namespace std;
+
+struct HatMapData
+{
+    map<string, int> data;
+
+    HatMapData()
+    {
+        ifstream file;
+        file.open("test/inputs/kjv");
+        if (!file) {
+            throw "file not opened";
+        }
+
+        string reader;
+        int i = 0;
+        while (file >> reader) {
+            data.insert(make_pair(reader, i++));
+        }
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(hatMap, HatMapData)
+
+template <class T>
+void check_equal(const hat_map<string, T> &h, const map<string, T> &m)
+{
+    BOOST_CHECK_EQUAL(h.size(), m.size());
+    typename map<string, T>::const_iterator mit = m.begin();
+    typename hat_map<string, T>::iterator it;
+    for (it = h.ordered_begin(); it != h.end(); ++it, ++mit) {
+        BOOST_REQUIRE(mit != m.end());
+        BOOST_CHECK_EQUAL(it.key(), mit->first);
+        BOOST_CHECK_EQUAL(it.value(), mit->second);
+    }
+    BOOST_CHECK(mit == m.end());
+}
+
+TEST(testInsertFind)
+{
+    // A small burst threshold makes values move through bursts.
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    hat_map<string, int> h(traits);
+    h.insert(data.begin(), data.end());
+    check_equal(h, data);
+
+    map<string, int>::iterator mit;
+    for (mit = data.begin(); mit != data.end(); ++mit) {
+        hat_map<string, int>::iterator it = h.find(mit->first);
+        BOOST_REQUIRE(it != h.end());
+        BOOST_CHECK_EQUAL(it.value(), mit->second);
+        BOOST_CHECK((*it).second == mit->second);
+    }
+    BOOST_CHECK(h.find("not a word in the data") == h.end());
+
+    // insert doesn't overwrite
+    BOOST_CHECK(h.insert(make_pair(data.begin()->first, -1)) == false);
+    BOOST_CHECK_EQUAL(h.at(data.begin()->first), data.begin()->second);
+}
+
+TEST(testAt)
+{
+    hat_map<string, double> h;
+    h.insert(make_pair(string("pi"), 3.14));
+    h.at("pi") = 2.71;
+    BOOST_CHECK_EQUAL(h.at("pi"), 2.71);
+    BOOST_CHECK_THROW(h.at("e"), out_of_range);
+
+    // A const map hands out copies.
+    const hat_map<string, double> &c = h;
+    double pi = c.at("pi");
+    BOOST_CHECK_EQUAL(pi, 2.71);
+    BOOST_CHECK_THROW(c.at("e"), out_of_range);
+
+    // References copy values in and out, so unaligned values work.
+    hat_map<string, double>::mapped_reference r = h["e"];
+    r += 2.5;
+    r = r + 0.2;
+    BOOST_CHECK_EQUAL(h.at("e"), 2.7);
+    BOOST_CHECK_EQUAL(h["e"]++, 2.7);
+    BOOST_CHECK_EQUAL(c.at("e"), 3.7);
+}
+
+TEST(testErase)
+{
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    hat_map<string, int> h(data.begin(), data.end(), traits);
+
+    // Erasing merges sparse subtrees back into containers, which moves
+    // the remaining values again.
+    map<string, int>::iterator mit = data.begin();
+    while (mit != data.end()) {
+        BOOST_CHECK_EQUAL(h.erase(mit->first), 1u);
+        data.erase(mit++);
+        if (mit != data.end()) {
+            ++mit;
+        }
+    }
+    check_equal(h, data);
+
+    h.erase(h.find(data.begin()->first));
+    data.erase(data.begin());
+    check_equal(h, data);
+}
+
+TEST(testCopy)
+{
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    hat_map<string, int> h(data.begin(), data.end(), traits);
+    hat_map<string, int> copy(h);
+    BOOST_CHECK(copy == h);
+
+    copy.at(data.begin()->first) += 1;
+    BOOST_CHECK(copy != h);
+    BOOST_CHECK_EQUAL(h.at(data.begin()->first), data.begin()->second);
+
+    hat_map<string, int> other;
+    swap(other, copy);
+    BOOST_CHECK(copy.empty());
+    BOOST_CHECK(other != h);
+}
+
+TEST(testRanges)
+{
+    hat_map<string, int> h(data.begin(), data.end());
+    pair<hat_map<string, int>::iterator, hat_map<string, int>::iterator> r =
+            h.prefix_range("bl");
+    map<string, int>::iterator mit = data.lower_bound("bl");
+    for (; r.first != r.second; ++r.first, ++mit) {
+        BOOST_CHECK_EQUAL(r.first.key(), mit->first);
+        BOOST_CHECK_EQUAL(r.first.value(), mit->second);
+    }
+    BOOST_CHECK(mit->first.compare(0, 2, "bl") != 0);
+
+    hat_map<string, int>::iterator it = h.upper_bound("m");
+    BOOST_CHECK_EQUAL(it.key(), data.upper_bound("m")->first);
+    --it;
+    BOOST_CHECK_EQUAL(it.key(), (--data.upper_bound("m"))->first);
+}
+
+TEST(testSubscript)
+{
+    // Count every word of the corpus, bursting containers on the way.
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    hat_map<string, int> h(traits);
+    map<string, int> counts;
+    ifstream file("test/inputs/kjv");
+    string word;
+    while (file >> word) {
+        ++h[word];
+        ++counts[word];
+    }
+    check_equal(h, counts);
+
+    BOOST_CHECK_EQUAL(h["not a word in the data"], 0);
+    BOOST_CHECK_EQUAL(h.size(), counts.size() + 1);
+}
+
+TEST(testInsertOrAssign)
+{
+    hat_map<string, int> h;
+    BOOST_CHECK(h.insert_or_assign("a", 1));
+    BOOST_CHECK(h.insert_or_assign("a", 2) == false);
+    BOOST_CHECK_EQUAL(h.at("a"), 2);
+    BOOST_CHECK_EQUAL(h.size(), 1u);
+}
+
+TEST(testTryEmplace)
+{
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    hat_map<string, int> h(traits);
+    map<string, int>::iterator mit;
+    for (mit = data.begin(); mit != data.end(); ++mit) {
+        pair<hat_map<string, int>::iterator, bool> result =
+                h.try_emplace(mit->first, mit->second);
+        BOOST_CHECK(result.second);
+        BOOST_CHECK_EQUAL(result.first.key(), mit->first);
+        BOOST_CHECK_EQUAL(result.first.value(), mit->second);
+    }
+
+    pair<hat_map<string, int>::iterator, bool> result =
+            h.try_emplace(data.begin()->first, -1);
+    BOOST_CHECK(result.second == false);
+    BOOST_CHECK_EQUAL(result.first.value(), data.begin()->second);
+    check_equal(h, data);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,129 @@
+/*
+ * hat_multiset_test.cpp
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#define TEST BOOST_AUTO_TEST_CASE
+
+#include <string>
+#include <set>
+#include <vector>
+#include <fstream>
+
+#include <boost/test/unit_test.hpp>
+
+#include "../src/hat_multiset.h"
+
+using namespace stx;
+using namespace std;
+
+struct HatMultisetData
+{
+    multiset<string> data;
+    vector<string> words;
+
+    HatMultisetData()
+    {
+        ifstream file;
+        file.open("test/inputs/kjv");
+        if (!file) {
+            throw "file not opened";
+        }
+
+        // Every word of the first chapters, with its repetitions
+        string reader;
+        while (file >> reader && words.size() < 50000) {
+            data.insert(reader);
+            words.push_back(reader);
+        }
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(hatMultiset, HatMultisetData)
+
+void check_equal(const hat_multiset<string> &h, const multiset<string> &m)
+{
+    BOOST_CHECK_EQUAL(h.size(), m.size());
+    multiset<string>::const_iterator mit = m.begin();
+    hat_multiset<string>::iterator it;
+    for (it = h.ordered_begin(); it != h.end(); ++it, ++mit) {
+        BOOST_REQUIRE(mit != m.end());
+        BOOST_CHECK_EQUAL(it.key(), *mit);
+    }
+    BOOST_CHECK(mit == m.end());
+}
+
+TEST(testInsert)
+{
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    hat_multiset<string> h(traits);
+    for (size_t i = 0; i < words.size(); ++i) {
+        hat_multiset<string>::iterator it = h.insert(words[i]);
+        BOOST_CHECK_EQUAL(*it, words[i]);
+        BOOST_CHECK(++it == h.end() || it.key() != words[i]);
+    }
+    check_equal(h, data);
+
+    set<string> distinct(data.begin(), data.end());
+    BOOST_CHECK_EQUAL(h.distinct_size(), distinct.size());
+    for (set<string>::iterator sit = distinct.begin(); sit != distinct.end();
+            ++sit) {
+        BOOST_CHECK_EQUAL(h.count(*sit), data.count(*sit));
+    }
+    BOOST_CHECK_EQUAL(h.count("not a word in the data"), 0u);
+}
+
+TEST(testCountedIteration)
+{
+    hat_multiset<string> h(words.begin(), words.end());
+    size_t total = 0, distinct = 0;
+    hat_multiset<string>::counted_iterator it;
+    for (it = h.ordered_counted_begin(); it != h.counted_end(); ++it) {
+        BOOST_CHECK_EQUAL(it.count(), data.count(it.key()));
+        total += it.count();
+        ++distinct;
+    }
+    BOOST_CHECK_EQUAL(total, data.size());
+    BOOST_CHECK_EQUAL(distinct, h.distinct_size());
+
+    // Reverse expansion visits every occurrence too.
+    multiset<string>::reverse_iterator mit = data.rbegin();
+    hat_multiset<string>::iterator first = h.ordered_begin();
+    for (hat_multiset<string>::iterator e = h.end(); e != first; ++mit) {
+        --e;
+        BOOST_REQUIRE(mit != data.rend());
+        BOOST_CHECK_EQUAL(e.key(), *mit);
+    }
+}
+
+TEST(testErase)
+{
+    hat_multiset<string> h(words.begin(), words.end());
+
+    // Erasing through an iterator removes one occurrence.
+    h.erase(h.find("the"));
+    data.erase(data.find("the"));
+    BOOST_CHECK_EQUAL(h.count("the"), data.count("the"));
+
+    // Erasing a string removes all of them.
+    BOOST_CHECK_EQUAL(h.erase("and"), data.erase("and"));
+    BOOST_CHECK(h.exists("and") == false);
+
+    h.insert("once");
+    h.erase(h.find("once"));
+    BOOST_CHECK(h.exists("once") == false);
+    check_equal(h, data);
+
+    pair<hat_multiset<string>::iterator, hat_multiset<string>::iterator> r =
+            h.equal_range("of");
+    size_t n = 0;
+    for (; r.first != r.second; ++r.first) {
+        BOOST_CHECK_EQUAL(*r.first, "of");
+        ++n;
+    }
+    BOOST_CHECK_EQUAL(n, data.count("of"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,164 @@
+/*
+ * hat_scored_map_test.cpp
+ */
+
+#define BOOST_TEST_DYN_LINK
+
+#define TEST BOOST_AUTO_TEST_CASE
+
+#include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/test/unit_test.hpp>
+
+#include "../src/hat_scored_map.h"
+
+using namespace stx;
+using namespace std;
+
+typedef hat_scored_map<string>::value_type scored;
+
+struct HatScoredMapData
+{
+    map<string, double> data;
+
+    HatScoredMapData()
+    {
+        ifstream file;
+        file.open("test/inputs/kjv");
+        if (!file) {
+            throw "file not opened";
+        }
+
+        // Word frequencies, with plenty of ties
+        string reader;
+        while (file >> reader) {
+            data[reader] += 1;
+        }
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(hatScoredMap, HatScoredMapData)
+
+bool better(const scored &lhs, const scored &rhs)
+{
+    if (lhs.second != rhs.second) {
+        return lhs.second > rhs.second;
+    }
+    return lhs.first < rhs.first;
+}
+
+// Finds the k best words starting with prefix by sorting all of them
+vector<scored> top_k(const map<string, double> &m, const string &prefix,
+                     size_t k)
+{
+    vector<scored> result;
+    map<string, double>::const_iterator it;
+    for (it = m.lower_bound(prefix);
+            it != m.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+            ++it) {
+        result.push_back(*it);
+    }
+    sort(result.begin(), result.end(), better);
+    if (result.size() > k) {
+        result.resize(k);
+    }
+    return result;
+}
+
+void check_top_k(const hat_scored_map<string> &h,
+                 const map<string, double> &m)
+{
+    const char *prefixes[] = { "", "t", "th", "the", "thee", "A", "Ab",
+                               "zz", "b", "bl", "w", "J" };
+    size_t ks[] = { 1, 3, 10, 100 };
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(*prefixes); ++i) {
+        for (size_t j = 0; j < sizeof(ks) / sizeof(*ks); ++j) {
+            vector<scored> expected = top_k(m, prefixes[i], ks[j]);
+            vector<scored> actual = h.top_k(prefixes[i], ks[j]);
+            BOOST_CHECK_EQUAL(actual.size(), expected.size());
+            BOOST_CHECK(actual == expected);
+        }
+    }
+}
+
+TEST(testTopK)
+{
+    hat_scored_map<string> h(data.begin(), data.end());
+    BOOST_CHECK_EQUAL(h.size(), data.size());
+    check_top_k(h, data);
+    BOOST_CHECK(h.top_k("the", 0).empty());
+
+    // Small containers put the prefixes in nodes and in containers.
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    hat_scored_map<string> small(data.begin(), data.end(), traits);
+    check_top_k(small, data);
+}
+
+TEST(testUpdate)
+{
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    hat_scored_map<string> h(traits);
+
+    // Insert in key order with increasing scores, then turn every score
+    // around, so that every maximum has to come down.
+    map<string, double>::iterator it;
+    double score = 0;
+    for (it = data.begin(); it != data.end(); ++it) {
+        BOOST_CHECK(h.insert_or_assign(it->first, score));
+        it->second = score++;
+    }
+    check_top_k(h, data);
+    for (it = data.begin(); it != data.end(); ++it) {
+        it->second = -it->second;
+        BOOST_CHECK(h.insert_or_assign(it->first, it->second) == false);
+    }
+    check_top_k(h, data);
+
+    BOOST_CHECK_EQUAL(h.increment("the", 1e9), data["the"] + 1e9);
+    data["the"] += 1e9;
+    BOOST_CHECK_EQUAL(h.score("the"), data["the"]);
+    BOOST_CHECK_THROW(h.score("not a word in the data"), out_of_range);
+    BOOST_CHECK(h.insert(scored("the", 0)) == false);
+    check_top_k(h, data);
+}
+
+TEST(testErase)
+{
+    // Erasing merges sparse subtrees back into containers.
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    traits.merge_threshold = 2;
+    hat_scored_map<string> h(data.begin(), data.end(), traits);
+
+    // Erase the best words first, so that the maxima keep dropping.
+    vector<scored> best = h.top_k("", 200);
+    for (size_t i = 0; i < best.size(); ++i) {
+        if (i % 2) {
+            BOOST_CHECK_EQUAL(h.erase(best[i].first), 1u);
+        } else {
+            h.erase(h.find(best[i].first));
+        }
+        data.erase(best[i].first);
+    }
+    check_top_k(h, data);
+
+    hat_scored_map<string> copy(h);
+    BOOST_CHECK(copy == h);
+    check_top_k(copy, data);
+    copy.increment(data.begin()->first);
+    BOOST_CHECK(copy != h);
+
+    hat_scored_map<string> other;
+    swap(other, copy);
+    BOOST_CHECK(copy.empty());
+    BOOST_CHECK(copy.top_k("", 5).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,12 @@
 #include <set>
 #include <stack>
 #include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#if __cplusplus >= 201103L
+#include <thread>
+#endif
 
 #include <boost/test/unit_test.hpp>
 #include <boost/foreach.hpp>
@@ -117,6 +123,192 @@ TEST(testInsert)
     BOOST_CHECK(a.size() == data.size());
 }
 
+TEST(testEmplace)
+{
+    // A small burst threshold makes many inserts burst their container.
+    hat_trie_traits traits;
+    traits.burst_threshold = 8;
+    hat_set<string> h(traits);
+    foreach (const string &word, data) {
+        pair<hat_set<string>::iterator, bool> result = h.emplace(word);
+        BOOST_CHECK(result.second);
+        BOOST_CHECK_EQUAL(result.first.key(), word);
+    }
+    BOOST_CHECK(h.size() == data.size());
+
+    // The iterators walk on like the ones find() returns.
+    foreach (const string &word, data) {
+        pair<hat_set<string>::iterator, bool> result = h.emplace(word);
+        BOOST_CHECK(result.second == false);
+        hat_set<string>::iterator it = h.find(word);
+        BOOST_CHECK(result.first == it);
+        BOOST_CHECK(++result.first == ++it);
+    }
+}
+
+TEST(testBurstPolicies)
+{
+    // Byte budget and scan length policies should burst containers
+    // without losing any data
+    hat_set<string> bytes(hat_trie_traits(16384, 1024));
+    hat_set<string> scan(hat_trie_traits(16384, 0, 2),
+                         array_hash_traits(8));
+    bytes.insert(data.begin(), data.end());
+    scan.insert(data.begin(), data.end());
+    check_equal(bytes, data);
+    check_equal(scan, data);
+    foreach (const string& str, data) {
+        BOOST_CHECK(bytes.exists(str));
+        BOOST_CHECK(scan.exists(str));
+    }
+}
+
+// Counts the containers print() shows, which are marked with a '*'
+size_t count_containers(hat_set<string> &h)
+{
+    ostringstream out;
+    h.print(out);
+    istringstream in(out.str());
+    size_t result = 0;
+    string line;
+    while (getline(in, line)) {
+        result += line.find(" *") != string::npos;
+    }
+    return result;
+}
+
+TEST(testMergeOnErase)
+{
+    // Fill a trie with a low burst threshold so it bursts many times,
+    // then erase most of it
+    hat_set<string> h(hat_trie_traits(64, 0, 0, 16));
+    h.insert(data.begin(), data.end());
+    ostringstream before;
+    h.print(before);
+
+    set<string> kept;
+    int i = 0;
+    foreach (const string& str, data) {
+        if (i++ % 100 == 0) {
+            kept.insert(str);
+        } else {
+            BOOST_CHECK_EQUAL(h.erase(str), 1u);
+        }
+    }
+    BOOST_CHECK_EQUAL(h.size(), kept.size());
+    check_equal(h, kept);
+    foreach (const string& str, kept) {
+        BOOST_CHECK(h.exists(str));
+    }
+
+    // Merging should have collapsed most of the burst nodes
+    ostringstream after;
+    h.print(after);
+    BOOST_CHECK(after.str().size() < before.str().size() / 20);
+
+    // The merged trie keeps working normally
+    h.insert(data.begin(), data.end());
+    check_equal(h, data);
+
+    // A merge must leave room under the byte budget, or churning one
+    // word would burst and merge the same subtree on every call.
+    hat_set<string> bytes(hat_trie_traits(16384, 1024, 0, 2000));
+    vector<string> keys;
+    for (int i = 0; i < 2000; ++i) {
+        ostringstream key;
+        key << "k" << i;
+        keys.push_back(key.str());
+    }
+    bytes.insert(keys.begin(), keys.end());
+    for (int i = 0; i < 10; ++i) {
+        bytes.insert("k99999999");
+        size_t containers = count_containers(bytes);
+        BOOST_CHECK_EQUAL(bytes.erase("k99999999"), 1u);
+        BOOST_CHECK_EQUAL(count_containers(bytes), containers);
+    }
+    check_equal(bytes, keys);
+}
+
+TEST(testErase)
+{
+    hat_trie_traits traits;
+    traits.burst_threshold = 2;
+    hat_set<string> h(traits);
+    h.insert("abcde");
+    h.insert("abcd");
+    h.insert("abc");
+    h.insert("b");
+
+    BOOST_CHECK_EQUAL(h.erase("ab"), 0u);
+    BOOST_CHECK_EQUAL(h.erase("abcdef"), 0u);
+    BOOST_CHECK_EQUAL(h.erase("abx"), 0u);
+    BOOST_CHECK_EQUAL(h.size(), 4u);
+    BOOST_CHECK_EQUAL(h.erase("abcd"), 1u);
+    BOOST_CHECK_EQUAL(h.erase("abcd"), 0u);
+    BOOST_CHECK_EQUAL(h.erase("b"), 1u);
+    BOOST_CHECK_EQUAL(h.size(), 2u);
+    BOOST_CHECK(h.exists("abc"));
+    BOOST_CHECK(h.exists("abcde"));
+    BOOST_CHECK(h.exists("abcd") == false);
+}
+
+TEST(testEraseAll)
+{
+    // Erasing everything should unlink every node and container
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(16));
+    foreach (const string& str, data) {
+        BOOST_CHECK_EQUAL(h.erase(str), 1u);
+    }
+    BOOST_CHECK(h.empty());
+    BOOST_CHECK(h.begin() == h.end());
+
+    ostringstream out;
+    h.print(out);
+    BOOST_CHECK_EQUAL(out.str().size(), 2u);  // just the root
+}
+
+TEST(testCopy)
+{
+    hat_set<string> a(data.begin(), data.end(), hat_trie_traits(64));
+    hat_set<string> b(a);
+    check_equal(a, b);
+    b.erase(*data.begin());
+    BOOST_CHECK_EQUAL(a.size(), b.size() + 1);
+    a = b;
+    check_equal(a, b);
+}
+
+TEST(testByteAlphabet)
+{
+    // Every byte value but '\0' should be usable in keys, including
+    // UTF-8 sequences
+    set<string> keys;
+    for (int i = 1; i < 256; ++i) {
+        for (int j = 1; j < 256; j += 7) {
+            string s;
+            s += (char) i;
+            s += (char) j;
+            s += "\xc3\xa9t\xc3\xa9";
+            keys.insert(s);
+            keys.insert(s.substr(0, 1));
+        }
+    }
+
+    hat_set<string> h(hat_trie_traits(8));
+    h.insert(keys.begin(), keys.end());
+    BOOST_CHECK_EQUAL(h.size(), keys.size());
+    check_equal(h, keys);
+    foreach (const string& str, keys) {
+        BOOST_CHECK(h.exists(str));
+    }
+    BOOST_CHECK(h.exists("\xff\xfe") == false);
+
+    foreach (const string& str, keys) {
+        BOOST_CHECK_EQUAL(h.erase(str), 1u);
+    }
+    BOOST_CHECK(h.empty());
+}
+
 TEST(testForwardIteration)
 {
     hat_set<string> h(data.begin(), data.end());
@@ -124,6 +316,374 @@ TEST(testForwardIteration)
     check_equal(s, data);
 }
 
+TEST(testIteratorKey)
+{
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(32));
+    vector<string> expected(h.begin(), h.end());
+    vector<string> keys;
+    for (hat_set<string>::iterator it = h.begin(); it != h.end(); ++it) {
+        keys.push_back(it.key());
+    }
+    BOOST_CHECK(keys == expected);
+
+    // key() and operator* agree in both directions
+    hat_set<string>::iterator it = h.end();
+    while (it != h.ordered_begin()) {
+        --it;
+        BOOST_CHECK(it.key() == *it);
+    }
+}
+
+// Collects the keys passed to a for_each callback
+struct collector
+{
+    vector<string> *keys;
+    void operator()(const char *key, size_t length)
+    {
+        keys->push_back(string(key, length));
+    }
+};
+
+TEST(testForEach)
+{
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(32));
+    vector<string> keys;
+    collector c = { &keys };
+    h.for_each(c);
+    vector<string> expected(h.begin(), h.end());
+    BOOST_CHECK(keys == expected);
+
+    set<string> prefixes;
+    prefixes.insert("");
+    prefixes.insert("zzzz");
+    foreach (const string& str, data) {
+        prefixes.insert(str.substr(0, 1));
+        prefixes.insert(str.substr(0, 3));
+    }
+    foreach (const string& prefix, prefixes) {
+        keys.clear();
+        h.for_each_prefix(prefix, c);
+        sort(keys.begin(), keys.end());
+
+        pair<hat_set<string>::iterator, hat_set<string>::iterator> range =
+                h.prefix_range(prefix);
+        vector<string> matches(range.first, range.second);
+        BOOST_CHECK(keys == matches);
+    }
+}
+
+// Keeps its own copy of the keys passed to a parallel_for_each callback
+struct partition
+{
+    vector<string> keys;
+    void operator()(const char *key, size_t length)
+    {
+        keys.push_back(string(key, length));
+    }
+};
+
+TEST(testParallelForEach)
+{
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(32));
+    vector<string> expected(data.begin(), data.end());
+    for (unsigned threads = 1; threads <= 4; ++threads) {
+        // Ordered partitions concatenate into a sorted export
+        vector<partition> parts = h.parallel_for_each(partition(), threads,
+                                                      true);
+        BOOST_CHECK(parts.size() >= threads);
+        vector<string> keys;
+        for (size_t i = 0; i < parts.size(); ++i) {
+            keys.insert(keys.end(), parts[i].keys.begin(),
+                        parts[i].keys.end());
+        }
+        BOOST_CHECK(keys == expected);
+
+        // Unordered partitions still visit every key once
+        parts = h.parallel_for_each(partition(), threads);
+        keys.clear();
+        for (size_t i = 0; i < parts.size(); ++i) {
+            keys.insert(keys.end(), parts[i].keys.begin(),
+                        parts[i].keys.end());
+        }
+        sort(keys.begin(), keys.end());
+        BOOST_CHECK(keys == expected);
+    }
+
+    hat_set<string> empty;
+    BOOST_CHECK(empty.parallel_for_each(partition(), 4).size() == 1);
+}
+
+#if __cplusplus >= 201103L
+TEST(testConcurrentOrderedQueries)
+{
+    // Every thread reaches the unsorted containers at about the same
+    // time, and all of them have to see complete indexes.
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(32));
+    const hat_set<string> &shared = h;
+    vector<char> sorted(4);
+    vector<thread> threads;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        threads.push_back(thread([&, i]() {
+            sorted[i] = equal(shared.ordered_begin(), shared.end(),
+                              data.begin());
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+        BOOST_CHECK(sorted[i]);
+    }
+}
+#endif
+
+TEST(testCursor)
+{
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(32));
+    hat_set<string>::cursor c = h.make_cursor();
+    BOOST_CHECK(c.has_continuations());
+    BOOST_CHECK(!c.is_word());
+
+    int i = 0;
+    foreach (const string& str, data) {
+        if (i++ % 7) {
+            continue;
+        }
+
+        // Walk past the end of the word to check the dead state too
+        string text = str + "zq";
+        c.reset();
+        for (size_t j = 0; j < text.size(); ++j) {
+            string prefix = text.substr(0, j + 1);
+            set<string>::iterator it = data.lower_bound(prefix);
+            bool alive = it != data.end() &&
+                         it->compare(0, prefix.size(), prefix) == 0;
+            bool word = alive && *it == prefix;
+            bool longer = alive && (!word || ++it != data.end()) &&
+                          it->compare(0, prefix.size(), prefix) == 0;
+
+            BOOST_CHECK(c.advance(text[j]) == alive);
+            BOOST_CHECK(c.prefix() == prefix);
+            BOOST_CHECK(c.is_word() == word);
+            BOOST_CHECK(c.has_continuations() == longer);
+        }
+    }
+
+    // The cursor's range agrees with prefix_range
+    c.reset();
+    c.advance("th");
+    BOOST_CHECK(c.range() == h.prefix_range("th"));
+}
+
+TEST(testLongestPrefix)
+{
+    // Rules at every depth: on nodes, on containers and in containers
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(32));
+    int i = 0;
+    foreach (const string& str, data) {
+        if (i++ % 5) {
+            continue;
+        }
+        string queries[] = { str, str + "s", str + "zzzz", str.substr(1) };
+        foreach (const string& query, queries) {
+            string expected;
+            bool found = false;
+            for (size_t n = query.size(); n > 0 && !found; --n) {
+                if (data.count(query.substr(0, n))) {
+                    expected = query.substr(0, n);
+                    found = true;
+                }
+            }
+            hat_set<string>::iterator it = h.longest_prefix(query);
+            BOOST_CHECK(found == (it != h.end()));
+            if (found) {
+                BOOST_CHECK(*it == expected);
+                BOOST_CHECK(it == h.find(expected));
+            }
+        }
+    }
+    BOOST_CHECK(h.longest_prefix("") == h.end());
+    h.insert("");
+    BOOST_CHECK(*h.longest_prefix("\x01") == "");
+}
+
+TEST(testPrefixesOf)
+{
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(32));
+    h.insert("");
+    data.insert("");
+
+    int i = 0;
+    foreach (const string& str, data) {
+        if (i++ % 5) {
+            continue;
+        }
+        string query = str + "es";
+        vector<string> expected;
+        for (size_t n = 0; n <= query.size(); ++n) {
+            if (data.count(query.substr(0, n))) {
+                expected.push_back(query.substr(0, n));
+            }
+        }
+
+        vector<string> keys;
+        collector c = { &keys };
+        h.prefixes_of(query, c);
+        BOOST_CHECK(keys == expected);
+    }
+}
+
+TEST(testOrderedIteration)
+{
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(512));
+    vector<string> ordered(h.ordered_begin(), h.end());
+    vector<string> expected(data.begin(), data.end());
+    BOOST_CHECK(ordered == expected);
+
+    // The second pass uses the cached sorted indexes
+    vector<string> again(h.ordered_begin(), h.end());
+    BOOST_CHECK(again == expected);
+
+    // Modifying a container invalidates its index
+    h.erase(expected[expected.size() / 2]);
+    h.insert("zzzzzz");
+    expected.erase(expected.begin() + expected.size() / 2);
+    expected.push_back("zzzzzz");
+    sort(expected.begin(), expected.end());
+    vector<string> changed(h.ordered_begin(), h.end());
+    BOOST_CHECK(changed == expected);
+}
+
+TEST(testReverseIteration)
+{
+    // Small containers so the trie has words on nodes, on containers and
+    // inside containers
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(32));
+    h.insert("\xff");
+    data.insert("\xff");
+
+    vector<string> reversed(h.rbegin(), h.rend());
+    vector<string> expected(data.rbegin(), data.rend());
+    BOOST_CHECK(reversed == expected);
+
+    // Walking backward from end() retraces an ordered traversal
+    vector<string> backward;
+    hat_set<string>::iterator it = h.end();
+    while (it != h.ordered_begin()) {
+        --it;
+        backward.push_back(*it);
+    }
+    BOOST_CHECK(backward == expected);
+
+    // Stepping back from an unordered traversal retraces it too
+    vector<string> forward(h.begin(), h.end());
+    it = h.find(forward.back());
+    for (int i = forward.size() - 1; i > 0; --i) {
+        BOOST_CHECK(*it == forward[i]);
+        --it;
+    }
+    BOOST_CHECK(it == h.begin());
+
+    // Reverse paging from a bound
+    hat_set<string>::reverse_iterator rit(h.lower_bound("m"));
+    set<string>::reverse_iterator sit(data.lower_bound("m"));
+    for (int i = 0; i < 10; ++i, ++rit, ++sit) {
+        BOOST_CHECK(*rit == *sit);
+    }
+}
+
+TEST(testBounds)
+{
+    // A low burst threshold gives the trie plenty of nodes as well as
+    // containers to search through
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(32));
+
+    set<string> queries(data);
+    queries.insert("");
+    queries.insert("~");
+    foreach (const string& str, data) {
+        queries.insert(str + "a");
+        queries.insert(str.substr(0, str.size() - 1) + "~");
+        queries.insert(str.substr(0, str.size() / 2));
+    }
+
+    foreach (const string& q, queries) {
+        set<string>::iterator lower = data.lower_bound(q);
+        set<string>::iterator upper = data.upper_bound(q);
+        hat_set<string>::iterator hlower = h.lower_bound(q);
+        hat_set<string>::iterator hupper = h.upper_bound(q);
+
+        if (lower == data.end()) {
+            BOOST_CHECK(hlower == h.end());
+        } else {
+            BOOST_CHECK_EQUAL(*hlower, *lower);
+        }
+        if (upper == data.end()) {
+            BOOST_CHECK(hupper == h.end());
+        } else {
+            BOOST_CHECK_EQUAL(*hupper, *upper);
+        }
+
+        pair<hat_set<string>::iterator, hat_set<string>::iterator> range =
+                h.equal_range(q);
+        BOOST_CHECK(range.first == hlower);
+        BOOST_CHECK(range.second == hupper);
+    }
+
+    // Iterators returned by the bounds continue in order
+    hat_set<string>::iterator it = h.lower_bound("L");
+    set<string>::iterator expected = data.lower_bound("L");
+    for (int i = 0; i < 2000; ++i, ++it, ++expected) {
+        BOOST_CHECK_EQUAL(*it, *expected);
+    }
+}
+
+TEST(testPrefixRange)
+{
+    hat_set<string> h(data.begin(), data.end(), hat_trie_traits(32));
+    h.insert("\xff\xff");
+    h.insert("\xff\xff" "a");
+    data.insert("\xff\xff");
+    data.insert("\xff\xff" "a");
+
+    set<string> prefixes;
+    prefixes.insert("");
+    prefixes.insert("\xff");
+    prefixes.insert("\xff\xff");
+    prefixes.insert("zzzz");
+    foreach (const string& str, data) {
+        prefixes.insert(str.substr(0, 1));
+        prefixes.insert(str.substr(0, 2));
+        prefixes.insert(str.substr(0, 4));
+    }
+
+    foreach (const string& prefix, prefixes) {
+        vector<string> expected;
+        for (set<string>::iterator it = data.lower_bound(prefix);
+                it != data.end() && it->compare(0, prefix.size(), prefix) == 0;
+                ++it) {
+            expected.push_back(*it);
+        }
+
+        pair<hat_set<string>::iterator, hat_set<string>::iterator> range =
+                h.prefix_range(prefix);
+        vector<string> actual(range.first, range.second);
+        BOOST_CHECK(actual == expected);
+    }
+}
+
+TEST(testIteratorEquality)
+{
+    hat_set<string> h;
+    h.insert("ab");
+    h.insert("ac");
+    hat_set<string>::iterator a = h.begin();
+    hat_set<string>::iterator b = a;
+    ++b;
+    BOOST_CHECK(a != b);
+    BOOST_CHECK(a == h.begin());
+    ++b;
+    BOOST_CHECK(b == h.end());
+}
+
 TEST(testSwap)
 {
     hat_set<string> control(data.begin(), data.end());
@@ -160,6 +720,331 @@ TEST(testEquals)
     BOOST_CHECK(a == b);
     BOOST_CHECK(a != c);
     BOOST_CHECK(b != c);
+
+    // The comparisons don't depend on how the words are laid out.
+    vector<string> words(data.rbegin(), data.rend());
+    hat_set<string> d(words.begin(), words.end(), hat_trie_traits(8));
+    BOOST_CHECK(a == d);
+    BOOST_CHECK(!(a < d) && !(d < a));
+    BOOST_CHECK(a <= d && a >= d);
+    d.erase(*data.rbegin());
+    BOOST_CHECK(d < a);
+    BOOST_CHECK(a > d);
+}
+
+/// Levenshtein distance, for checking fuzzy_search
+size_t edit_distance(const string &a, const string &b)
+{
+    vector<size_t> row(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); ++j) {
+        row[j] = j;
+    }
+    for (size_t i = 1; i <= a.size(); ++i) {
+        size_t diagonal = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= b.size(); ++j) {
+            size_t above = row[j];
+            row[j] = min(min(row[j] + 1, row[j - 1] + 1),
+                         diagonal + (a[i - 1] != b[j - 1]));
+            diagonal = above;
+        }
+    }
+    return row[b.size()];
+}
+
+struct fuzzy_matches {
+    vector<pair<string, size_t> > *matches;
+    void operator()(const char *key, size_t length, size_t distance) {
+        matches->push_back(make_pair(string(key, length), distance));
+    }
+};
+
+TEST(testFuzzySearch)
+{
+    hat_trie_traits traits;
+    traits.burst_threshold = 64;
+    hat_set<string> h(data.begin(), data.end(), traits);
+    h.insert("");
+
+    const char *queries[] = { "", "a", "Lord", "recieve", "begat", "zzzz",
+                              "Jerusalem", "xJerusalem" };
+    for (int q = 0; q < 8; ++q) {
+        for (size_t k = 0; k <= 2; ++k) {
+            vector<pair<string, size_t> > expected;
+            expected.push_back(make_pair(string(), strlen(queries[q])));
+            foreach (const string &word, data) {
+                size_t d = edit_distance(word, queries[q]);
+                if (d <= k) {
+                    expected.push_back(make_pair(word, d));
+                }
+            }
+            if (expected[0].second > k) {
+                expected.erase(expected.begin());
+            }
+
+            vector<pair<string, size_t> > matches;
+            fuzzy_matches f = { &matches };
+            h.fuzzy_search(queries[q], k, f);
+            BOOST_CHECK(matches == expected);
+        }
+    }
+}
+
+/// Reference glob matcher, for checking match_pattern
+bool glob_match(const char *p, const char *s)
+{
+    if (*p == '\0') {
+        return *s == '\0';
+    }
+    if (*p == '*') {
+        return glob_match(p + 1, s) || (*s && glob_match(p, s + 1));
+    }
+    if (*s == '\0') {
+        return false;
+    }
+    if (*p == '?') {
+        return glob_match(p + 1, s + 1);
+    }
+    if (*p == '[') {
+        const char *q = p + 1;
+        bool negate = *q == '!' || *q == '^';
+        if (negate) {
+            ++q;
+        }
+        bool in = false;
+        const char *first = q;
+        for (; *q && (*q != ']' || q == first); ++q) {
+            if (q[1] == '-' && q[2] && q[2] != ']') {
+                in = in || (*s >= *q && *s <= q[2]);
+                q += 2;
+            } else {
+                in = in || *s == *q;
+            }
+        }
+        if (*q == ']') {
+            return in != negate && glob_match(q + 1, s + 1);
+        }
+    }
+    if (*p == '\\' && p[1]) {
+        ++p;
+    }
+    return *p == *s && glob_match(p + 1, s + 1);
+}
+
+TEST(testMatchPattern)
+{
+    hat_trie_traits traits;
+    traits.burst_threshold = 64;
+    hat_set<string> h(data.begin(), data.end(), traits);
+    h.insert("");
+    h.insert("a*b");
+
+    const char *patterns[] = { "", "*", "the", "th?", "b*t", "*ah",
+                               "[A-Z]*ah", "J*s*m", "[!a-z]*", "*[0-9]*",
+                               "a\\*b", "a[*]b", "?", "??", "*a*e*i*",
+                               "[]x]*", "[a-c][d-f]*", "zz*", "[abc" };
+    for (int p = 0; p < 19; ++p) {
+        vector<string> expected;
+        expected.push_back("");
+        expected.push_back("a*b");
+        foreach (const string &word, data) {
+            expected.push_back(word);
+        }
+        vector<string> filtered;
+        foreach (const string &word, expected) {
+            if (glob_match(patterns[p], word.c_str())) {
+                filtered.push_back(word);
+            }
+        }
+        sort(filtered.begin(), filtered.end());
+
+        vector<string> matches;
+        collector c = { &matches };
+        h.match_pattern(patterns[p], c);
+        sort(matches.begin(), matches.end());
+        BOOST_CHECK_MESSAGE(matches == filtered, patterns[p]);
+    }
+}
+
+// Checks a set against the expected words, in order and after erasing
+// every other word, which relies on the subtree sizes being right.
+void check_set(hat_set<string> &h, const set<string> &expected)
+{
+    BOOST_CHECK_EQUAL(h.size(), expected.size());
+    BOOST_CHECK(equal(h.ordered_begin(), h.end(), expected.begin()));
+    check_equal(h, expected);
+
+    set<string> rest;
+    bool skip = false;
+    foreach (const string &s, expected) {
+        if (skip) {
+            BOOST_CHECK_EQUAL(h.erase(s), 1u);
+        } else {
+            rest.insert(s);
+        }
+        skip = !skip;
+    }
+    BOOST_CHECK_EQUAL(h.size(), rest.size());
+    check_equal(h, rest);
+}
+
+TEST(testSetAlgebra)
+{
+    set<string> a, b;
+    int i = 0;
+    foreach (const string &s, data) {
+        if (i % 2 == 0) {
+            a.insert(s);
+        }
+        if (i % 3 == 0) {
+            b.insert(s);
+        }
+        ++i;
+    }
+    b.insert("not in the data");
+    b.insert("");
+
+    set<string> both, either, only;
+    set_union(a.begin(), a.end(), b.begin(), b.end(),
+              inserter(either, either.begin()));
+    set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                     inserter(both, both.begin()));
+    set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                   inserter(only, only.begin()));
+
+    // Different burst thresholds on each side line nodes up against
+    // containers, and merging folds sparse results back.
+    size_t thresholds[][2] = { { 16384, 16384 }, { 8, 8 }, { 8, 16384 },
+                               { 16384, 8 }, { 2, 64 } };
+    for (size_t t = 0; t < sizeof(thresholds) / sizeof(*thresholds); ++t) {
+        hat_trie_traits left(thresholds[t][0]), right(thresholds[t][1]);
+        if (t == 4) {
+            left.merge_threshold = 1;
+        }
+        hat_set<string> x(a.begin(), a.end(), left);
+        hat_set<string> y(b.begin(), b.end(), right);
+
+        hat_set<string> h = stx::set_union(x, y);
+        check_set(h, either);
+        h = stx::set_intersection(x, y);
+        check_set(h, both);
+        h = stx::set_difference(x, y);
+        check_set(h, only);
+        h = stx::set_difference(y, x);
+        BOOST_CHECK_EQUAL(h.size(), b.size() - both.size());
+    }
+
+    // The result may replace an argument.
+    hat_set<string> x(a.begin(), a.end());
+    hat_set<string> y(b.begin(), b.end());
+    x.set_intersection(x, y);
+    check_set(x, both);
+    hat_set<string> empty;
+    y.set_difference(y, empty);
+    BOOST_CHECK_EQUAL(y.size(), b.size());
+    y.set_intersection(empty, y);
+    BOOST_CHECK(y.empty());
+
+    // Subtrees copied from a set that bursts later are burst to fit the
+    // result's policy, like a set built directly.
+    hat_set<string> small(hat_trie_traits(8));
+    hat_set<string> large(data.begin(), data.end());
+    hat_set<string> direct(data.begin(), data.end(), hat_trie_traits(8));
+    hat_set<string> h = stx::set_union(small, large);
+    check_equal(h, data);
+    BOOST_CHECK(count_containers(h) > count_containers(direct) / 2);
+
+    // Containers are copied whole, so their traits have to agree.
+    hat_set<string> other(hat_trie_traits(), array_hash_traits(8));
+    BOOST_CHECK_THROW(stx::set_union(other, large), invalid_argument);
+}
+
+struct differences
+{
+    set<string> lhs, rhs;
+
+    void operator()(const char *key, size_t length, bool in_lhs)
+    {
+        string word(key, length);
+        BOOST_CHECK((in_lhs ? lhs : rhs).insert(word).second);
+    }
+};
+
+void check_diff(hat_set<string> &x, hat_set<string> &y,
+                const set<string> &a, const set<string> &b)
+{
+    set<string> only_a, only_b;
+    set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                   inserter(only_a, only_a.begin()));
+    set_difference(b.begin(), b.end(), a.begin(), a.end(),
+                   inserter(only_b, only_b.begin()));
+    differences d = x.diff(y, differences());
+    BOOST_CHECK(d.lhs == only_a);
+    BOOST_CHECK(d.rhs == only_b);
+    BOOST_CHECK((x == y) == (a == b));
+}
+
+TEST(testDigests)
+{
+    // Different burst thresholds and insertion orders lay the same
+    // words out differently.
+    hat_trie_traits big(16384), small(8);
+    big.digests = true;
+    small.digests = true;
+    small.merge_threshold = 2;
+    vector<string> words(data.begin(), data.end());
+    hat_set<string> x(words.begin(), words.end(), big);
+    hat_set<string> y(words.rbegin(), words.rend(), small);
+    check_diff(x, y, data, data);
+
+    // A few changes deep in the tries
+    set<string> a = data, b = data;
+    const char *changes[] = { "", "the", "thee", "zzz", "Abraham",
+                              "Abrahamic", "a word" };
+    for (size_t i = 0; i < sizeof(changes) / sizeof(*changes); ++i) {
+        if (y.erase(changes[i])) {
+            b.erase(changes[i]);
+        } else {
+            y.insert(changes[i]);
+            b.insert(changes[i]);
+        }
+        check_diff(x, y, a, b);
+        check_diff(y, x, b, a);
+    }
+
+    // Erasing every other word merges containers back.
+    bool skip = false;
+    foreach (const string &s, data) {
+        if (skip) {
+            x.erase(s);
+            a.erase(s);
+        }
+        skip = !skip;
+    }
+    check_diff(x, y, a, b);
+    for (set<string>::iterator it = b.begin(); it != b.end(); ) {
+        if (a.count(*it) == 0) {
+            y.erase(y.find(*it));
+            b.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    y.insert(a.begin(), a.end());
+    b.insert(a.begin(), a.end());
+    check_diff(x, y, a, b);
+    BOOST_CHECK(x == y);
+
+    // Copies and the results of set operations keep digests, even when
+    // an argument has none.
+    hat_set<string> copy(y);
+    BOOST_CHECK(copy == x);
+    hat_set<string> plain(data.begin(), data.end());
+    hat_set<string> h = stx::set_intersection(x, plain);
+    check_diff(h, x, a, a);
+    h = stx::set_union(x, plain);
+    check_diff(h, plain, data, data);
+    check_diff(plain, x, data, a);
 }
 
 BOOST_AUTO_TEST_SUITE_END()